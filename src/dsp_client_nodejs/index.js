@@ -1,4 +1,4 @@
 
-import { Client, Message, Command, COMMAND_FN } from './src/index.js';
+import { Client, Message, MESSAGE_VERSION, Command, COMMAND_FN } from './src/index.js';
 
-export { Client, Message, Command, COMMAND_FN };
\ No newline at end of file
+export { Client, Message, MESSAGE_VERSION, Command, COMMAND_FN };
\ No newline at end of file
@@ -1,6 +1,6 @@
 import atob from 'atob';
 import { Command, COMMAND_FN } from './Command.js';
-import { Message } from './Message.js';
+import { Message, MESSAGE_VERSION } from './Message.js';
 
 const _CLASS = '@FaintSignals/ws-dsp-client/Client';
 
@@ -10,10 +10,14 @@ const _CLASS = '@FaintSignals/ws-dsp-client/Client';
 class Client {
     ws = null;
     messages = null;
+    batch = null;
+    batchWindow = 2;
+    topics = null;
     /**
      * Constructor.
      * @param {Object} args    - Generic argument object.
-     * @param {Object} args.ws - Open websocket connection.
+     * @param {Object} args.ws          - Open websocket connection.
+     * @param {number} args.batchWindow - (Optional) Miliseconds sendBatched collects messages for. Defaults to 2.
      */
     constructor(args) {
         if (!args)
@@ -21,7 +25,10 @@ class Client {
         if (!args.ws)
             throw `${_CLASS}: Parameter is required: 'ws'`;
         this.messages = [];
+        this.topics = [];
         this.ws = args.ws;
+        if (args.batchWindow !== undefined)
+            this.batchWindow = args.batchWindow;
         this.listen();
     }
     /**
@@ -41,7 +48,13 @@ class Client {
                             "data_len": data_len,
                             "data": e.data.slice(9, 9 + data_len)
                         }
-                        if (wsMessage.messages[container.id]) {
+                        if (container._version == MESSAGE_VERSION.BATCH) {
+                            wsMessage.receiveBatch(container);
+                        } else if (container._version == MESSAGE_VERSION.SUBSCRIBE) {
+                            // Published results carry the topic id instead of a message id.
+                            if (wsMessage.topics[container.id])
+                                wsMessage.topics[container.id](container);
+                        } else if (wsMessage.messages[container.id]) {
                             if (wsMessage.messages[container.id].debug)
                                 console.debug(`receiving ${container.id}:`, container);
                             wsMessage.messages[container.id].callback(container);
@@ -121,6 +134,63 @@ class Client {
             console.debug('binary: ', serialized);
         this.ws.send(serialized, args.options);
     }
+    /**
+     * Send a message as part of a batch. Messages sent within the batch window go to the server in one
+     * websocket frame and come back in one, which saves the per frame overhead of many small requests.
+     * @param {Object}     args          - Generic argument object.
+     * @param {Message}    args.message  - REQUEST or CAPTURE message to send.
+     * @param {Object}     args.options  - (Optional) Options to pass into websocket send.
+     * @param {function}   args.callback - Execute callback when response is recieved.
+     */
+    sendBatched(args) {
+        if (!args)
+            throw `${_CLASS}: Parameter object is required`;
+        if (!args.message)
+            throw `${_CLASS}: Parameter is required: 'message'`;
+        if (!args.callback)
+            throw `${_CLASS}: Parameter is required: 'callback'`;
+        this.messages[args.message.id] = {
+            "type": "binary",
+            "callback": args.callback
+        };
+        if (!this.batch) {
+            this.batch = { "messages": [], "options": args.options };
+            setTimeout(() => this.flushBatch(), this.batchWindow);
+        }
+        this.batch.messages.push(args.message.serialize());
+    }
+    /**
+     * Send the messages collected by sendBatched now.
+     */
+    flushBatch() {
+        if (!this.batch)
+            return;
+        let batch = this.batch;
+        this.batch = null;
+        this.ws.send(Message.serializeBatch(Math.floor(Math.random() * 4294967295) + 1, batch.messages), batch.options);
+    }
+    /**
+     * Hand each response of a batch response to the callback of its message.
+     * @param {Object} container - Batch response.
+     */
+    receiveBatch(container) {
+        let data = container.data;
+        let src = 0;
+        while (src + 9 <= data.byteLength) {
+            let dataLen = data.readUInt32LE(src + 5);
+            let response = {
+                "_version": data[src],
+                "id": data.readUInt32LE(src + 1),
+                "data_len": dataLen,
+                "data": data.slice(src + 9, src + 9 + dataLen)
+            };
+            src += 9 + dataLen;
+            if (this.messages[response.id]) {
+                this.messages[response.id].callback(response);
+                delete this.messages[response.id];
+            }
+        }
+    }
     /**
      * Send test message to server which will be echoed back.
      * @param {TypedArray} data        - Test data to send
@@ -151,6 +221,180 @@ class Client {
         }, miliseconds);
         return timer;
     }
+    /**
+     * Tell the server the result of a message sent with sendBinary is no longer wanted. Unless the
+     * response is already on its way, the callback of the message receives a response of version
+     * CANCEL without data instead. Messages of streams cannot be cancelled.
+     * @param {Object} args    - Generic argument object.
+     * @param {number} args.id - Id of the message.
+     */
+    cancel(args) {
+        if (!args)
+            throw `${_CLASS}: Parameter object is required`;
+        if (!args.id)
+            throw `${_CLASS}: Parameter is required: 'id'`;
+        let message = new Message({
+            "version": MESSAGE_VERSION.CANCEL,
+            "id": Math.floor(Math.random() * 4294967295) + 1,
+            "stream": args.id,
+            "commands": [],
+            "data": new Uint8Array()
+        });
+        this.ws.send(message.serialize());
+    }
+    /**
+     * Open a stream. The server builds the command chain once and keeps its filter state between blocks.
+     * @param {Object}     args          - Generic argument object.
+     * @param {Command[]}  args.commands - Processing chain for every block of the stream.
+     * @param {Uint8Array} args.data     - (Optional) First block of samples.
+     * @returns {Promise} Resolves with the stream handle and the response to the first block.
+     */
+    streamOpen(args) {
+        if (!args)
+            throw `${_CLASS}: Parameter object is required`;
+        if (!args.commands)
+            throw `${_CLASS}: Parameter is required: 'commands'`;
+        return new Promise((resolve, reject) => {
+            let message = new Message({
+                "version": MESSAGE_VERSION.STREAM_OPEN,
+                "id": Math.floor(Math.random() * 4294967295) + 1,
+                "commands": args.commands,
+                "data": (args.data) ? args.data : new Uint8Array()
+            });
+            this.sendBinary({ "message": message, "callback": (container) => {
+                resolve({ "stream": message.id, "response": container });
+            }, "error": (error) => { reject(error); }});
+        });
+    }
+    /**
+     * Send a block of samples through an open stream.
+     * @param {Object}     args        - Generic argument object.
+     * @param {number}     args.stream - Stream handle from streamOpen.
+     * @param {Uint8Array} args.data   - Samples.
+     * @returns {Promise} Resolves with the response container.
+     */
+    streamData(args) {
+        if (!args)
+            throw `${_CLASS}: Parameter object is required`;
+        if (!args.stream)
+            throw `${_CLASS}: Parameter is required: 'stream'`;
+        if (!args.data)
+            throw `${_CLASS}: Parameter is required: 'data'`;
+        return new Promise((resolve, reject) => {
+            let message = new Message({
+                "version": MESSAGE_VERSION.STREAM_DATA,
+                "id": Math.floor(Math.random() * 4294967295) + 1,
+                "stream": args.stream,
+                "commands": [],
+                "data": args.data
+            });
+            this.sendBinary({ "message": message, "callback": resolve, "error": reject });
+        });
+    }
+    /**
+     * Close a stream and release its state on the server.
+     * @param {Object} args        - Generic argument object.
+     * @param {number} args.stream - Stream handle from streamOpen.
+     * @returns {Promise} Resolves once the server has closed the stream.
+     */
+    streamClose(args) {
+        if (!args)
+            throw `${_CLASS}: Parameter object is required`;
+        if (!args.stream)
+            throw `${_CLASS}: Parameter is required: 'stream'`;
+        return new Promise((resolve, reject) => {
+            let message = new Message({
+                "version": MESSAGE_VERSION.STREAM_CLOSE,
+                "id": Math.floor(Math.random() * 4294967295) + 1,
+                "stream": args.stream,
+                "commands": [],
+                "data": new Uint8Array()
+            });
+            this.sendBinary({ "message": message, "callback": resolve, "error": reject });
+        });
+    }
+    /**
+     * Open a stream whose results go to every subscriber of a topic instead of back to the caller.
+     * Blocks are sent with streamData, which resolves once the server has taken them, and the stream
+     * is closed with streamClose. The server computes each block once however many subscribe.
+     * @param {Object}     args          - Generic argument object.
+     * @param {string}     args.topic    - Topic name.
+     * @param {Command[]}  args.commands - Processing chain for every block of the stream.
+     * @param {Uint8Array} args.data     - (Optional) First block of samples.
+     * @returns {Promise} Resolves with the stream handle.
+     */
+    publishOpen(args) {
+        if (!args)
+            throw `${_CLASS}: Parameter object is required`;
+        if (!args.topic)
+            throw `${_CLASS}: Parameter is required: 'topic'`;
+        if (!args.commands)
+            throw `${_CLASS}: Parameter is required: 'commands'`;
+        return new Promise((resolve, reject) => {
+            let message = new Message({
+                "version": MESSAGE_VERSION.PUBLISH,
+                "id": Math.floor(Math.random() * 4294967295) + 1,
+                "topic": args.topic,
+                "commands": args.commands,
+                "data": (args.data) ? args.data : new Uint8Array()
+            });
+            this.sendBinary({ "message": message, "callback": (container) => {
+                resolve({ "stream": message.id });
+            }, "error": (error) => { reject(error); }});
+        });
+    }
+    /**
+     * Receive the results published to a topic. Results the client is too slow for are skipped.
+     * @param {Object}   args          - Generic argument object.
+     * @param {string}   args.topic    - Topic name. It need not be published yet.
+     * @param {function} args.callback - Called with the response container of each result.
+     * @returns {Promise} Resolves with the topic id, for unsubscribe.
+     */
+    subscribe(args) {
+        if (!args)
+            throw `${_CLASS}: Parameter object is required`;
+        if (!args.topic)
+            throw `${_CLASS}: Parameter is required: 'topic'`;
+        if (!args.callback)
+            throw `${_CLASS}: Parameter is required: 'callback'`;
+        return new Promise((resolve, reject) => {
+            let message = new Message({
+                "version": MESSAGE_VERSION.SUBSCRIBE,
+                "id": Math.floor(Math.random() * 4294967295) + 1,
+                "topic": args.topic,
+                "commands": [],
+                "data": new Uint8Array()
+            });
+            this.sendBinary({ "message": message, "callback": (container) => {
+                let topic = container.data.readUInt32LE(0);
+                this.topics[topic] = args.callback;
+                resolve(topic);
+            }, "error": (error) => { reject(error); }});
+        });
+    }
+    /**
+     * Stop receiving the results of a topic.
+     * @param {Object} args       - Generic argument object.
+     * @param {number} args.topic - Topic id from subscribe.
+     * @returns {Promise} Resolves once the server has unsubscribed.
+     */
+    unsubscribe(args) {
+        if (!args)
+            throw `${_CLASS}: Parameter object is required`;
+        if (!args.topic)
+            throw `${_CLASS}: Parameter is required: 'topic'`;
+        delete this.topics[args.topic];
+        return new Promise((resolve, reject) => {
+            let message = new Message({
+                "version": MESSAGE_VERSION.UNSUBSCRIBE,
+                "id": Math.floor(Math.random() * 4294967295) + 1,
+                "stream": args.topic,
+                "commands": [],
+                "data": new Uint8Array()
+            });
+            this.sendBinary({ "message": message, "callback": resolve, "error": reject });
+        });
+    }
     /**
      * Parse IQ stream from base64 encoding
      * @param {Object} args        - Generic argument object.
@@ -209,6 +453,52 @@ class Client {
         });
         return promise;
     }
+    /**
+     * Power spectrum from IQ data, computed and quantized by the server.
+     * @param {Object}     args            - Generic argument object.
+     * @param {TypedArray} args.samples    - Interleaved IQ data. Can be 8, 16, or 32 in sample size.
+     * @param {number}     args.sampleRate - Sample rate in Hz.
+     * @param {number}     args.window     - (Optional) 0 none, 1 Hann (default), 2 Blackman-Harris, 3 Kaiser.
+     * @param {number}     args.dbMin      - (Optional) dB mapped to 0. Defaults to -120.
+     * @param {number}     args.dbMax      - (Optional) dB mapped to 255. Defaults to 0.
+     * @return {Uint8Array} - One dB value per bin, from -fs/2 to fs/2.
+     */
+    async spectrum(args) {
+        if (!args)
+            throw `${_CLASS}: Parameter object is required`;
+        if (!args.samples)
+            throw `${_CLASS}: Parameter is required: 'samples'`;
+        if (!args.sampleRate)
+            throw `${_CLASS}: Parameter is required: 'sampleRate'`;
+        let promise = new Promise((resolve, reject) => {
+            let sampleSize = args.samples.byteLength / args.samples.length;
+            let idMax = 65535;
+            // Sample rate, format, window, kaiser beta, flags (fftshift), mode (dB), type (uint8), dB min, dB max.
+            let params = new ArrayBuffer(36);
+            let view = new DataView(params);
+                view.setUint32(0, args.sampleRate, true);
+                view.setUint32(4, sampleSize, true);
+                view.setUint32(8, args.window ?? 1, true);
+                view.setFloat32(12, 8.6, true);
+                view.setUint32(16, 1, true);
+                view.setUint32(20, 2, true);
+                view.setUint32(24, 2, true);
+                view.setFloat32(28, args.dbMin ?? -120, true);
+                view.setFloat32(32, args.dbMax ?? 0, true);
+            let message = new Message({ 
+                "version": 1, 
+                "id": Math.floor(Math.random() * idMax),
+                "commands": [
+                    new Command({ "type": COMMAND_FN.FFT, "paramsLen": params.byteLength, "params": new Uint8Array(params) })
+                ],
+                "data": new Uint8Array(args.samples.buffer)
+            });
+            this.sendBinary({ "debug": false, "message": message, "callback": (message) => {
+                resolve(new Uint8Array(message.data));
+            }, "error": (error) => { reject(error); }});    
+        });
+        return promise;
+    }
 }
 
 export { Client }
\ No newline at end of file
@@ -4,7 +4,15 @@ const _CLASS = '@FaintSignals/dsp-client-nodejs/Command';
 const COMMAND_FN = {
     ECHO: 1,
     FFT: 2,
-    FIRFILT: 3
+    FIRFILT: 3,
+    FASTFILT: 4,
+    CONVERT: 5,
+    STFT: 6,
+    DECIM: 7,
+    INTERP: 8,
+    RESAMP: 9,
+    DDC: 10,
+    CHANNELIZE: 11
 };
 
 class Command {
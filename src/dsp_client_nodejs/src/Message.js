@@ -1,11 +1,30 @@
 
 const _CLASS = '@FaintSignals/dsp-client-nodejs/Message';
 
+const MESSAGE_VERSION = {
+    REQUEST: 1,
+    STREAM_OPEN: 2,
+    STREAM_DATA: 3,
+    STREAM_CLOSE: 4,
+    CAPTURE: 5,
+    BATCH: 6,
+    PUBLISH: 7,
+    SUBSCRIBE: 8,
+    UNSUBSCRIBE: 9,
+    SCHEDULED: 10,
+    CANCEL: 11
+};
+
 class Message {
     version = null;
     id = null;
     commands = null;
     data = null;
+    stream = null;
+    capture = null;
+    topic = null;
+    priority = null;
+    deadline = null;
     /**
      * Constructor.
      * @param {Object}      args            - Generic argument object.
@@ -13,6 +32,17 @@ class Message {
      * @param {number}      args.id         - Unique message identifier.
      * @param {Command[]}   args.commands   - Array of @FaintSignals/dsp-client-nodejs/Command.
      * @param {Uint8Array}  args.data       - Byte array of binary data.
+     * @param {number}      args.stream     - (Optional) Stream handle for STREAM_DATA and STREAM_CLOSE, topic id
+     *                                        for UNSUBSCRIBE, request id for CANCEL.
+     * @param {Object}      args.capture    - (Optional) For CAPTURE, data read on the server instead of sent:
+     *                                        { name, offset, length } of a file in the server capture
+     *                                        directory. Length 0 reads to the end of the file.
+     * @param {string}      args.topic      - (Optional) Topic name for PUBLISH and SUBSCRIBE.
+     * @param {number}      args.priority   - (Optional) For REQUEST, CAPTURE and BATCH, 0 (bulk) to 3 (interactive).
+     *                                        Queued messages of higher priority run first. Defaults to 1.
+     * @param {number}      args.deadline   - (Optional) For REQUEST, CAPTURE and BATCH, milliseconds after which the
+     *                                        result is no longer wanted. The server then answers with a response
+     *                                        of version CANCEL and no data instead.
      */
     constructor(args) {
         if (!args)
@@ -21,12 +51,17 @@ class Message {
             throw `${_CLASS}: Parameter is required: 'id'`;
         if (!args.commands)
             throw `${_CLASS}: Parameter is required: 'commands'`;
-        if (!args.data)
+        if (!args.data && !args.capture)
             throw `${_CLASS}: Parameter is required: 'data'`;
         this.version  = args.version;
         this.id       = args.id;
         this.commands = args.commands;
         this.data     = args.data;
+        this.stream   = (args.stream) ? args.stream : null;
+        this.capture  = (args.capture) ? args.capture : null;
+        this.topic    = (args.topic) ? args.topic : null;
+        this.priority = (args.priority !== undefined) ? args.priority : null;
+        this.deadline = (args.deadline !== undefined) ? args.deadline : null;
     }
     /**
      * Parse a byte array into Message object.
@@ -63,13 +98,28 @@ class Message {
         return message;
     }
     /**
-     * Get byte stream of command object.
+     * Get byte stream of command object. Messages with a priority or deadline are sent as SCHEDULED.
      * @returns Uint8Array - Processing command byte stream.
      */
     serialize() {
+        let message = this.serializeMessage();
+        if (this.priority === null && this.deadline === null)
+            return message;
+        return Message.serializeScheduled(message, (this.priority !== null) ? this.priority : 1, this.deadline || 0);
+    }
+    /**
+     * Get byte stream of the message itself, without scheduling envelope.
+     * @returns Uint8Array - Processing command byte stream.
+     */
+    serializeMessage() {
         // Calculate byte array size.
         let version       = new Uint8Array([this.version]);
         let id            = new Uint8Array((new Uint32Array([this.id])).buffer);
+        if (this.version == MESSAGE_VERSION.STREAM_DATA || this.version == MESSAGE_VERSION.STREAM_CLOSE ||
+            this.version == MESSAGE_VERSION.UNSUBSCRIBE || this.version == MESSAGE_VERSION.CANCEL)
+            return this.serializeStream(version, id);
+        if (this.version == MESSAGE_VERSION.SUBSCRIBE)
+            return this.serializeSubscribe(version, id);
         let commandsCount = new Uint8Array((new Uint32Array([this.commands.length])).buffer);
         let commands      = new Uint8Array();
         let dst = 0;
@@ -81,12 +131,19 @@ class Message {
             commands = newCmds;
         });
         let dataLen = new Uint8Array((new Uint32Array([(this.data) ? this.data.byteLength : 0])).buffer);
+        if (this.version == MESSAGE_VERSION.CAPTURE)
+            return this.serializeCapture(version, id, commandsCount, commands);
+        // Published streams name their topic between the commands and the data.
+        let topic    = (this.version == MESSAGE_VERSION.PUBLISH) ? new TextEncoder().encode(this.topic) : new Uint8Array();
+        let topicLen = (this.version == MESSAGE_VERSION.PUBLISH) ? new Uint8Array((new Uint32Array([topic.byteLength])).buffer) : new Uint8Array();
         // Compile byte array size.
         let stream = new Uint8Array(
             version.byteLength +
             id.byteLength +
             commandsCount.byteLength +
             commands.byteLength +
+            topicLen.byteLength +
+            topic.byteLength +
             dataLen.byteLength +
             ((this.data) ? this.data.byteLength : 0)
         );
@@ -95,10 +152,126 @@ class Message {
         stream.set(id,            dst);   dst += id.byteLength;
         stream.set(commandsCount, dst);   dst += commandsCount.byteLength;
         stream.set(commands,      dst);   dst += commands.byteLength;
+        stream.set(topicLen,      dst);   dst += topicLen.byteLength;
+        stream.set(topic,         dst);   dst += topic.byteLength;
         stream.set(dataLen,       dst);   dst += dataLen.byteLength;
         stream.set(this.data,     dst);   dst += this.data.byteLength;
         return stream;
     }
+    /**
+     * Get byte stream of a batch: many serialized messages sent, and answered, as one.
+     * @param {number}       id         - Unique identifier of the batch.
+     * @param {Uint8Array[]} serialized - Serialized REQUEST or CAPTURE messages.
+     * @returns Uint8Array - Batch byte stream.
+     */
+    static serializeBatch(id, serialized) {
+        let dataLen = serialized.reduce((len, message) => len + 4 + message.byteLength, 0);
+        let stream = new Uint8Array(1 + 4 + 4 + dataLen);
+        let view = new DataView(stream.buffer);
+        let dst = 0;
+        view.setUint8(dst, MESSAGE_VERSION.BATCH);   dst += 1;
+        view.setUint32(dst, id, true);               dst += 4;
+        view.setUint32(dst, dataLen, true);          dst += 4;
+        serialized.forEach((message) => {
+            view.setUint32(dst, message.byteLength, true);   dst += 4;
+            stream.set(message, dst);                        dst += message.byteLength;
+        });
+        return stream;
+    }
+    /**
+     * Get byte stream of a scheduled message: priority and deadline in front of a serialized message.
+     * @param {Uint8Array} serialized - Serialized REQUEST, CAPTURE or BATCH message.
+     * @param {number}     priority   - 0 (bulk) to 3 (interactive).
+     * @param {number}     deadline   - Milliseconds after which the result is no longer wanted, 0 for none.
+     * @returns Uint8Array - Scheduled message byte stream.
+     */
+    static serializeScheduled(serialized, priority, deadline) {
+        let stream = new Uint8Array(1 + 4 + 4 + serialized.byteLength);
+        let view = new DataView(stream.buffer);
+        view.setUint8(0, MESSAGE_VERSION.SCHEDULED);
+        view.setUint32(1, priority, true);
+        view.setUint32(5, deadline, true);
+        stream.set(serialized, 9);
+        return stream;
+    }
+    /**
+     * Get byte stream of a capture request. The capture reference takes the place of the data.
+     * @param {Uint8Array} version       - Serialized version.
+     * @param {Uint8Array} id            - Serialized id.
+     * @param {Uint8Array} commandsCount - Serialized command count.
+     * @param {Uint8Array} commands      - Serialized commands.
+     * @returns Uint8Array - Message byte stream.
+     */
+    serializeCapture(version, id, commandsCount, commands) {
+        let name    = new TextEncoder().encode(this.capture.name);
+        let nameLen = new Uint8Array((new Uint32Array([name.byteLength])).buffer);
+        let offset  = new Uint8Array((new BigUint64Array([BigInt(this.capture.offset || 0)])).buffer);
+        let dataLen = new Uint8Array((new Uint32Array([this.capture.length || 0])).buffer);
+        let stream = new Uint8Array(
+            version.byteLength +
+            id.byteLength +
+            commandsCount.byteLength +
+            commands.byteLength +
+            nameLen.byteLength +
+            name.byteLength +
+            offset.byteLength +
+            dataLen.byteLength
+        );
+        let dst = 0;
+        stream.set(version,       dst);   dst += version.byteLength;
+        stream.set(id,            dst);   dst += id.byteLength;
+        stream.set(commandsCount, dst);   dst += commandsCount.byteLength;
+        stream.set(commands,      dst);   dst += commands.byteLength;
+        stream.set(nameLen,       dst);   dst += nameLen.byteLength;
+        stream.set(name,          dst);   dst += name.byteLength;
+        stream.set(offset,        dst);   dst += offset.byteLength;
+        stream.set(dataLen,       dst);   dst += dataLen.byteLength;
+        return stream;
+    }
+    /**
+     * Get byte stream of a subscription to a topic. Only the topic name is sent.
+     * @param {Uint8Array} version - Serialized version.
+     * @param {Uint8Array} id      - Serialized id.
+     * @returns Uint8Array - Message byte stream.
+     */
+    serializeSubscribe(version, id) {
+        let topic    = new TextEncoder().encode(this.topic);
+        let topicLen = new Uint8Array((new Uint32Array([topic.byteLength])).buffer);
+        let stream = new Uint8Array(version.byteLength + id.byteLength + topicLen.byteLength + topic.byteLength);
+        let dst = 0;
+        stream.set(version,       dst);   dst += version.byteLength;
+        stream.set(id,            dst);   dst += id.byteLength;
+        stream.set(topicLen,      dst);   dst += topicLen.byteLength;
+        stream.set(topic,         dst);   dst += topic.byteLength;
+        return stream;
+    }
+    /**
+     * Get byte stream of a message addressed to an open stream, to a topic to unsubscribe from, or to
+     * a request to cancel. Commands are not sent.
+     * @param {Uint8Array} version - Serialized version.
+     * @param {Uint8Array} id      - Serialized id.
+     * @returns Uint8Array - Message byte stream.
+     */
+    serializeStream(version, id) {
+        let handle  = new Uint8Array((new Uint32Array([this.stream])).buffer);
+        let close   = (this.version != MESSAGE_VERSION.STREAM_DATA);
+        let dataLen = new Uint8Array((new Uint32Array([(this.data) ? this.data.byteLength : 0])).buffer);
+        let stream = new Uint8Array(
+            version.byteLength +
+            id.byteLength +
+            handle.byteLength +
+            ((close) ? 0 : dataLen.byteLength + this.data.byteLength)
+        );
+        let dst = 0;
+        stream.set(version,       dst);   dst += version.byteLength;
+        stream.set(id,            dst);   dst += id.byteLength;
+        stream.set(handle,        dst);   dst += handle.byteLength;
+        if (!close) {
+            stream.set(dataLen,   dst);   dst += dataLen.byteLength;
+            stream.set(this.data, dst);   dst += this.data.byteLength;
+        }
+        return stream;
+    }
 }
 
-export { Message }
+export { Message, MESSAGE_VERSION }
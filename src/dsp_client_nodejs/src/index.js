@@ -3,6 +3,6 @@
  */
 import { Client } from './Client.js';
 import { Command, COMMAND_FN } from './Command.js';
-import { Message } from './Message.js';
+import { Message, MESSAGE_VERSION } from './Message.js';
 
-export { Client, Command, COMMAND_FN, Message }
+export { Client, Command, COMMAND_FN, Message, MESSAGE_VERSION }
@@ -3,33 +3,341 @@
  * @brief Websocket server subprotocol for digital signal processing requests
  */
 
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/random.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <liquid/liquid.h>
 
 #include "fs_ws_dsp_command.c"
+#include "fs_ws_dsp_buffer.c"
+#include "fs_ws_dsp_arena.c"
+#include "fs_ws_dsp_convert.c"
 #include "fs_ws_dsp_message.c"
+#include "fs_ws_dsp_capture.c"
+#include "fs_ws_dsp_cache.c"
+#include "fs_ws_dsp_fft.c"
+#include "fs_ws_dsp_window.c"
 #include "fs_ws_dsp_cmd_echo.c"
 #include "fs_ws_dsp_cmd_fft.c"
 #include "fs_ws_dsp_cmd_firfilt.c"
+#include "fs_ws_dsp_cmd_fastfilt.c"
+#include "fs_ws_dsp_cmd_convert.c"
+#include "fs_ws_dsp_cmd_stft.c"
+#include "fs_ws_dsp_cmd_resamp.c"
+#include "fs_ws_dsp_cmd_ddc.c"
+#include "fs_ws_dsp_cmd_channelize.c"
+#include "fs_ws_dsp_pool.c"
+#include "fs_ws_dsp_fork.c"
+#include "fs_ws_dsp_topic.c"
+#include "fs_ws_dsp_stream.c"
+#include "fs_ws_dsp_result.c"
+#include "fs_ws_dsp_local.c"
+#include "fs_ws_dsp_metrics.c"
 
-struct fs_ws_dsp_message fs_ws_dsp_process(struct fs_ws_dsp_message request) {
+/* Run one command of a chain. Commands set the response version only once they have produced their
+ * output, so a command that leaves it unset has failed. Returns -1 then. Unknown commands are skipped. */
+static int fs_ws_dsp_process_command(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request,
+                                     struct fs_ws_dsp_message *response) {
+    uint8_t version = response->_version;
+
+    response->_version = 0;
+    if (command->type == FS_WS_DSP_CMD_ECHO)
+        fs_ws_dsp_cmd_echo(command, request, response);
+    else if (command->type == FS_WS_DSP_CMD_FFT)
+        fs_ws_dsp_cmd_fft(command, request, response);
+    else if (command->type == FS_WS_DSP_CMD_FIRFILT)
+        fs_ws_dsp_cmd_firfilt(command, request, response);
+    else if (command->type == FS_WS_DSP_CMD_FASTFILT)
+        fs_ws_dsp_cmd_fastfilt(command, request, response);
+    else if (command->type == FS_WS_DSP_CMD_CONVERT)
+        fs_ws_dsp_cmd_convert(command, request, response);
+    else if (command->type == FS_WS_DSP_CMD_STFT)
+        fs_ws_dsp_cmd_stft(command, request, response);
+    else if (command->type == FS_WS_DSP_CMD_DECIM || command->type == FS_WS_DSP_CMD_INTERP || command->type == FS_WS_DSP_CMD_RESAMP)
+        fs_ws_dsp_cmd_resamp(command, request, response);
+    else if (command->type == FS_WS_DSP_CMD_DDC)
+        fs_ws_dsp_cmd_ddc(command, request, response);
+    else if (command->type == FS_WS_DSP_CMD_CHANNELIZE)
+        fs_ws_dsp_cmd_channelize(command, request, response);
+    else
+        response->_version = version;
+    return command->type >= FS_WS_DSP_CMD_ECHO && command->type <= FS_WS_DSP_CMD_CHANNELIZE && !response->_version ? -1 : 0;
+}
+
+/* Stages that work sample by sample, keeping their history in the command, so any cut of their input
+ * on a block boundary gives the same output. interp / decim is the rate change, decim the block.
+ * Conversion qualifies unless it removes DC: the mean of a piece differs from the mean of the whole. */
+static int fs_ws_dsp_stage_streaming(struct fs_ws_dsp_command *command, unsigned int *interp, unsigned int *decim) {
+    *interp = 1;
+    *decim  = 1;
+    if (command->type == FS_WS_DSP_CMD_CONVERT)
+        return !(fs_ws_dsp_command_param_u32(command, 8, 0) & FS_WS_DSP_CONVERT_DC);
+    if (command->type == FS_WS_DSP_CMD_FIRFILT)
+        return 1;
+    return !fs_ws_dsp_resamp_factors(command, interp, decim);
+}
+
+/* Add a streaming stage to a chain. block is the piece size in input samples that hands every stage
+ * whole blocks, num / den the rate at the current stage and samples the count it produces. */
+static int fs_ws_dsp_stage_chain(unsigned int interp, unsigned int decim, uint64_t *block, uint64_t *num, uint64_t *den, uint64_t *samples) {
+    unsigned int g;
+    *block  *= decim / fs_ws_dsp_resamp_gcd((unsigned int)(*block * *num / *den % decim), decim);
+    *num    *= interp;
+    *den    *= decim;
+    g        = fs_ws_dsp_resamp_gcd((unsigned int)(*num % *den), (unsigned int)*den);
+    *num    /= g;
+    *den    /= g;
+    *samples = *samples / decim * interp;
+    if (*block > FS_WS_DSP_INCREMENTAL_BLOCK_MAX || *num > FS_WS_DSP_INCREMENTAL_BLOCK_MAX || *den > FS_WS_DSP_INCREMENTAL_BLOCK_MAX)
+        return -1;
+    return 0;
+}
+
+/* Run the streaming stages from first on tile by tile, so each tile passes through all of them while it
+ * is still in cache, instead of each stage streaming the whole block through memory. Returns the number
+ * of commands run, 0 if the stages are better run one at a time, -1 if a stage failed on a tile. */
+static int fs_ws_dsp_process_fused(struct fs_ws_dsp_message request, uint32_t first, struct fs_ws_dsp_message *response) {
+    struct fs_ws_dsp_message tile_request, tile_response;
+    struct fs_ws_dsp_arena tiles;
+    uint64_t samples, out_samples, block = 1, num = 1, den = 1, tile, offset, n;
+    unsigned int sample_size, interp, decim;
+    size_t done = 0, len;
+    uint32_t last, i;
+    char *out;
+
+    // Raw request data for the first stage, else the float samples of the previous stage.
+    if (response->data == NULL) {
+        sample_size = fs_ws_dsp_format_frame(fs_ws_dsp_command_param_u32(request.commands[first], 4, FS_WS_DSP_FORMAT_INT8));
+        if (sample_size == 0)
+            return 0;
+        samples = request.data_len / sample_size;
+    } else {
+        sample_size = sizeof(float complex);
+        samples = response->data_len / sample_size;
+    }
+    out_samples = samples;
+    for (last = first; last < request.commands_count; last++)
+        if (!fs_ws_dsp_stage_streaming(request.commands[last], &interp, &decim) ||
+            fs_ws_dsp_stage_chain(interp, decim, &block, &num, &den, &out_samples))
+            break;
+    // A lone stage only gains when conversion is fused into it.
+    tile = block * (FS_WS_DSP_TILE_SAMPLES / block > 0 ? FS_WS_DSP_TILE_SAMPLES / block : 1);
+    if (last == first || (last - first == 1 && response->data != NULL) || samples < 2 * tile)
+        return 0;
+    if (out_samples > UINT32_MAX / sizeof(float complex))
+        return 0;
+    out = fs_ws_dsp_arena_borrow(response->arena, response->data, out_samples * sizeof(float complex));
+    if (!out)
+        return 0;
+
+    // Tiles borrow their buffers from a small arena of their own, the block result stays in the main one.
+    fs_ws_dsp_arena_init(&tiles, 0);
+    for (offset = 0; offset < samples; offset += n) {
+        n = samples - offset < tile ? samples - offset : tile;
+        tile_request = request;
+        memset(&tile_response, 0, sizeof(struct fs_ws_dsp_message));
+        tile_response.id    = request.id;
+        tile_response.arena = &tiles;
+        if (response->data == NULL) {
+            tile_request.data     = request.data + offset * sample_size;
+            tile_request.data_len = n * sample_size;
+        } else {
+            tile_response.data     = response->data + offset * sample_size;
+            tile_response.data_len = n * sample_size;
+        }
+        for (i = first; i < last; i++)
+            if (fs_ws_dsp_process_command(request.commands[i], tile_request, &tile_response))
+                break;
+        // The tiles before were fine, but a result with a piece missing is no result.
+        if (i < last) {
+            fs_ws_dsp_arena_free(&tiles);
+            return -1;
+        }
+        if (tile_response.data == NULL)
+            continue;
+        len = tile_response.data_len;
+        if (len > out_samples * sizeof(float complex) - done)
+            len = out_samples * sizeof(float complex) - done;
+        memcpy(out + done, tile_response.data, len);
+        done += len;
+    }
+    fs_ws_dsp_arena_free(&tiles);
+
+    response->_version       = 1;
+    response->id             = request.id;
+    response->commands_count = 0;
+    response->commands       = NULL;
+    response->data_len       = done;
+    response->data           = out;
+    return (int)(last - first);
+}
+
+/* Answer for a request whose result is no longer wanted. Drops what was computed so far. */
+static struct fs_ws_dsp_message fs_ws_dsp_process_cancel(struct fs_ws_dsp_message response) {
+    struct fs_ws_dsp_message cancel;
+    memset(&cancel, 0, sizeof(struct fs_ws_dsp_message));
+    cancel._version = FS_WS_DSP_MSG_CANCEL;
+    cancel.id       = response.id;
+    cancel.arena    = response.arena;
+    fs_ws_dsp_message_free(response);
+    return cancel;
+}
+
+/* Answer for a request a command failed on. Drops what was computed so far. */
+static struct fs_ws_dsp_message fs_ws_dsp_process_failed(struct fs_ws_dsp_message response) {
+    struct fs_ws_dsp_message failed;
+    memset(&failed, 0, sizeof(struct fs_ws_dsp_message));
+    failed.id     = response.id;
+    failed.arena  = response.arena;
+    failed.failed = 1;
+    fs_ws_dsp_message_free(response);
+    return failed;
+}
+
+struct fs_ws_dsp_message fs_ws_dsp_process(struct fs_ws_dsp_message request, struct fs_ws_dsp_arena *arena) {
     struct fs_ws_dsp_message response;
+    uint32_t i = 0;
+    uint64_t start;
+    int fused;
+    memset(&response, 0, sizeof(struct fs_ws_dsp_message));
+    response.id    = request.id;
+    response.arena = arena;
+    while (i < request.commands_count) {
+        if (i > 0 && request.job && !fs_ws_dsp_job_wanted(request.job))
+            return fs_ws_dsp_process_cancel(response);
+        start = fs_ws_dsp_metrics_now_ns();
+        fused = fs_ws_dsp_process_fused(request, i, &response);
+        if (fused < 0)
+            return fs_ws_dsp_process_failed(response);
+        if (fused > 0) {
+            fs_ws_dsp_metrics_time_command(FS_WS_DSP_METRICS_FUSED, fs_ws_dsp_metrics_now_ns() - start);
+            i += (uint32_t)fused;
+            continue;
+        }
+        if (fs_ws_dsp_process_command(request.commands[i], request, &response))
+            return fs_ws_dsp_process_failed(response);
+        fs_ws_dsp_metrics_time_command(request.commands[i]->type, fs_ws_dsp_metrics_now_ns() - start);
+        i++;
+    }
+    return response;
+}
+
+struct fs_ws_dsp_message fs_ws_dsp_process_batch(struct fs_ws_dsp_message request, struct fs_ws_dsp_arena *arena) {
+    struct fs_ws_dsp_message response, sub, result;
+    char *src = request.data, *end = src + request.data_len, *batch = NULL, *grown;
+    size_t done = 0, size = 0, need;
+    uint32_t sub_len;
+
     memset(&response, 0, sizeof(struct fs_ws_dsp_message));
-    response.id = request.id;
-    if (request.commands_count > 0) {
-        struct fs_ws_dsp_command **dst = request.commands;
-        for (int i = 0; i < request.commands_count; i++) {
-            struct fs_ws_dsp_command *command = *dst++;            
-            if (command->type == FS_WS_DSP_CMD_ECHO)
-                fs_ws_dsp_cmd_echo(command, request, &response);
-            if (command->type == FS_WS_DSP_CMD_FFT)
-                fs_ws_dsp_cmd_fft(command, request, &response);
-            if (command->type == FS_WS_DSP_CMD_FIRFILT)
-                fs_ws_dsp_cmd_firfilt(command, request, &response);
+    response._version = FS_WS_DSP_MSG_BATCH;
+    response.id       = request.id;
+    response.arena    = arena;
+    while (end - src >= 4) {
+        if (request.job && !fs_ws_dsp_job_wanted(request.job)) {
+            fs_ws_dsp_buffer_put(batch);
+            return fs_ws_dsp_process_cancel(response);
+        }
+        memcpy(&sub_len, src, 4);
+        src += 4;
+        if (sub_len > (size_t)(end - src))
+            break;
+        memset(&result, 0, sizeof(struct fs_ws_dsp_message));
+        result._version = FS_WS_DSP_MSG_REQUEST;
+        // Sub-messages are parsed where they lie in the batch. One that cannot be is answered without data.
+        if (fs_ws_dsp_message_parse(&sub, src, sub_len) ||
+            (sub._version != FS_WS_DSP_MSG_REQUEST && sub._version != FS_WS_DSP_MSG_CAPTURE)) {
+            fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_MALFORMED, 1);
+        } else if (sub._version == FS_WS_DSP_MSG_CAPTURE && fs_ws_dsp_capture_map(&sub)) {
+            fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_UNAVAILABLE, 1);
+        } else {
+            sub.job    = request.job;
+            sub.shared = request.shared;
+            result     = fs_ws_dsp_process_cached(sub, arena);
+            // So is one that failed.
+            if (result.failed)
+                result._version = FS_WS_DSP_MSG_REQUEST;
+        }
+        result.id = sub.id;
+        fs_ws_dsp_message_free_view(sub);
+        src += sub_len;
+
+        // Each result only lives until the next sub-message reuses the arena, so collect them.
+        need = done + fs_ws_dsp_message_serialize_size(result);
+        if (need > UINT32_MAX) {
+            fs_ws_dsp_message_free(result);
+            break;
+        }
+        if (need > size) {
+            grown = fs_ws_dsp_buffer_get(arena->headroom + (need > 2 * size ? need : 2 * size));
+            if (!grown) {
+                fs_ws_dsp_message_free(result);
+                break;
+            }
+            if (batch)
+                memcpy(grown + arena->headroom, batch + arena->headroom, done);
+            fs_ws_dsp_buffer_put(batch);
+            batch = grown;
+            size  = fs_ws_dsp_buffer_size(batch) - arena->headroom;
         }
+        fs_ws_dsp_message_serialize_into(result, batch + arena->headroom + done);
+        done = need;
+        fs_ws_dsp_message_free(result);
+    }
+    // Left in the arena, the batch is sent like the result of a single request.
+    if (batch) {
+        fs_ws_dsp_arena_adopt(arena, NULL, batch);
+        response.data     = batch + arena->headroom;
+        response.data_len = done;
     }
     return response;
 }
 
+int fs_ws_dsp_process_incremental(struct fs_ws_dsp_message request, uint32_t data_len, uint32_t *frame, uint64_t *out_len) {
+    struct fs_ws_dsp_command *command;
+    unsigned int sample_size, interp, decim;
+    uint64_t samples, block = 1, num = 1, den = 1;
+    uint32_t i;
+
+    if (request.commands_count == 0)
+        return 0;
+    command = request.commands[0];
+    if (command->type == FS_WS_DSP_CMD_ECHO) {
+        // Echo of echo is still the request data, byte for byte.
+        for (i = 1; i < request.commands_count; i++)
+            if (request.commands[i]->type != FS_WS_DSP_CMD_ECHO)
+                return 0;
+        *frame   = 1;
+        *out_len = data_len;
+        return 1;
+    }
+    sample_size = fs_ws_dsp_format_frame(fs_ws_dsp_command_param_u32(command, 4, FS_WS_DSP_FORMAT_INT8));
+    if (sample_size == 0)
+        return 0;
+    samples = data_len / sample_size;
+    // Pieces are large enough for the fast filter to keep its overlap-save form, so it streams here too.
+    for (i = 0; i < request.commands_count; i++) {
+        command = request.commands[i];
+        if (command->type == FS_WS_DSP_CMD_FASTFILT)
+            continue;
+        if (!fs_ws_dsp_stage_streaming(command, &interp, &decim) ||
+            fs_ws_dsp_stage_chain(interp, decim, &block, &num, &den, &samples))
+            return 0;
+    }
+    // The response head announces the length in 32 bits.
+    if (samples > UINT32_MAX / sizeof(float complex))
+        return 0;
+    *frame   = block * sample_size;
+    *out_len = samples * sizeof(float complex);
+    return 1;
+}
+
 void fs_ws_dsp_debug(char *data, size_t data_len) {
     int i;
     fprintf(stderr, "\n");
@@ -41,39 +349,21 @@ void fs_ws_dsp_debug(char *data, size_t data_len) {
     return;
 }
 
-float complex *fs_ws_dsp_samples_8to32(char complex *samples, int n_samples) {
-    float complex *x = (float complex*) malloc(n_samples * sizeof(float complex));
-    int i;
-    char complex *src = samples;
-    float complex *dst = x;
-    for (i = 0; i < n_samples; i++) {
-        *dst++ = (float complex)*src++; 
+float complex *fs_ws_dsp_samples_input(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request,
+                                       struct fs_ws_dsp_message *response, unsigned int *n_len) {
+    uint32_t format = fs_ws_dsp_command_param_u32(command, 4, FS_WS_DSP_FORMAT_INT8);
+    unsigned int frame = fs_ws_dsp_format_frame(format);
+    float complex *x;
+
+    if (response->data != NULL) {
+        *n_len = response->data_len / sizeof(float complex);
+        return (float complex *)response->data;
     }
+    if (frame == 0)
+        return NULL;
+    x = fs_ws_dsp_arena_borrow(response->arena, NULL, request.data_len / frame * sizeof(float complex));
+    if (!x)
+        return NULL;
+    *n_len = fs_ws_dsp_convert(format, request.data, request.data_len, x, 1.0f);
     return x;
 }
-
-int interpolator() {
-    unsigned int M  = 4;     // interpolation factor
-    unsigned int m  = 12;    // filter delay [symbols]
-    float        As = 60.0f; // filter stop-band attenuation [dB]
-
-    // create interpolator from prototype
-    firinterp_crcf interp = firinterp_crcf_create_kaiser(M,m,As);
-    float complex x = 1.0f + 0.5f * I;  // input sample
-    float complex y[M];      // interpolated output buffer
-
-    // repeat on input sample data as needed
-    {
-        firinterp_crcf_execute(interp, x, y);
-    }
-
-    // destroy interpolator object
-    firinterp_crcf_destroy(interp);
-
-	int i;
-	for (i = 0; i < M; i++) {
-		printf("%f + i%f\n", creal(y[i]), cimag(y[i]));
-	}
-
-    return 0;
-}
\ No newline at end of file
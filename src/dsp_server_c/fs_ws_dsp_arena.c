@@ -0,0 +1,74 @@
+/**
+ * @file fs_ws_dsp_arena.c
+ * @brief Reusable scratch buffers that processing stages borrow their output space from.
+ */
+
+void fs_ws_dsp_arena_init(struct fs_ws_dsp_arena *arena, size_t headroom) {
+    memset(arena, 0, sizeof(struct fs_ws_dsp_arena));
+    arena->headroom = headroom;
+}
+
+static int fs_ws_dsp_arena_slot(struct fs_ws_dsp_arena *arena, const void *data) {
+    int i;
+    const char *p = (const char *)data;
+    for (i = 0; i < 2; i++) {
+        if (arena->slot[i].base &&
+            p >= arena->slot[i].base + arena->headroom &&
+            p <  arena->slot[i].base + arena->headroom + arena->slot[i].size)
+            return i;
+    }
+    return -1;
+}
+
+void *fs_ws_dsp_arena_borrow(struct fs_ws_dsp_arena *arena, const void *input, size_t size) {
+    struct fs_ws_dsp_arena_buf *buf;
+    // Take the buffer input is not in. Either will do when input lives elsewhere.
+    buf = &arena->slot[fs_ws_dsp_arena_slot(arena, input) == 0 ? 1 : 0];
+    if (!buf->base || buf->size < size) {
+        // Contents need not survive, so swap for a larger buffer rather than realloc and copy.
+        fs_ws_dsp_buffer_put(buf->base);
+        buf->base = fs_ws_dsp_buffer_get(arena->headroom + size);
+        buf->size = buf->base ? fs_ws_dsp_buffer_size(buf->base) - arena->headroom : 0;
+        if (!buf->base)
+            return NULL;
+    }
+    return buf->base + arena->headroom;
+}
+
+int fs_ws_dsp_arena_owns(struct fs_ws_dsp_arena *arena, const void *data) {
+    return arena != NULL && data != NULL && fs_ws_dsp_arena_slot(arena, data) >= 0;
+}
+
+int fs_ws_dsp_arena_detach(struct fs_ws_dsp_arena *arena, const void *data, char **buffer) {
+    int i = fs_ws_dsp_arena_slot(arena, data);
+    if (i < 0 || (const char *)data != arena->slot[i].base + arena->headroom)
+        return -1;
+    *buffer = arena->slot[i].base;
+    arena->slot[i].base = NULL;
+    arena->slot[i].size = 0;
+    return 0;
+}
+
+void fs_ws_dsp_arena_adopt(struct fs_ws_dsp_arena *arena, const void *input, char *buffer) {
+    struct fs_ws_dsp_arena_buf *buf = &arena->slot[fs_ws_dsp_arena_slot(arena, input) == 0 ? 1 : 0];
+    fs_ws_dsp_buffer_put(buf->base);
+    buf->base = buffer;
+    buf->size = fs_ws_dsp_buffer_size(buffer) - arena->headroom;
+}
+
+void fs_ws_dsp_arena_trim(struct fs_ws_dsp_arena *arena) {
+    int i;
+    for (i = 0; i < 2; i++) {
+        if (arena->slot[i].size > FS_WS_DSP_ARENA_KEEP) {
+            fs_ws_dsp_buffer_put(arena->slot[i].base);
+            arena->slot[i].base = NULL;
+            arena->slot[i].size = 0;
+        }
+    }
+}
+
+void fs_ws_dsp_arena_free(struct fs_ws_dsp_arena *arena) {
+    fs_ws_dsp_buffer_put(arena->slot[0].base);
+    fs_ws_dsp_buffer_put(arena->slot[1].base);
+    fs_ws_dsp_arena_init(arena, arena->headroom);
+}
@@ -0,0 +1,127 @@
+/**
+ * @file fs_ws_dsp_bench.c
+ * @brief Benchmark of signal processing kernels.
+ * @details Times direct form FIR filtering against overlap-save fast convolution over a range of
+ *          filter lengths, and reports the filter length where fast convolution starts to win. Feed
+ *          that number to ws_server with --fastfilt-crossover. Then times sample format conversion
+ *          with each kernel set the CPU supports.
+ *
+ *          fs_ws_dsp_bench [samples]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include "include/fs_ws_dsp.h"
+#include "fs_ws_dsp.c"
+
+static double bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_convert(unsigned int n_len) {
+    static const char *isas[] = { "scalar", "sse2", "avx2" };
+    static const uint32_t formats[] = { FS_WS_DSP_FORMAT_INT8, FS_WS_DSP_FORMAT_UINT8, FS_WS_DSP_FORMAT_INT16,
+                                        FS_WS_DSP_FORMAT_PACKED12, FS_WS_DSP_FORMAT_FLOAT32 };
+    size_t raw_len = (size_t)n_len * 8;
+    char *raw = (char *) malloc(raw_len);
+    float complex *x = (float complex *) malloc(n_len * sizeof(float complex));
+    unsigned int f, k, n;
+    size_t i;
+    double t;
+
+    if (!raw || !x) {
+        free(raw);
+        free(x);
+        return;
+    }
+    for (i = 0; i < raw_len; i++)
+        raw[i] = (char)rand();
+    printf("\n%8s", "format");
+    for (k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+        printf(" %8s ns/smp", isas[k]);
+    printf("\n");
+    for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        printf("%8u", formats[f]);
+        for (k = 0; k < sizeof(isas) / sizeof(isas[0]); k++) {
+            if (fs_ws_dsp_convert_select(isas[k])) {
+                printf(" %15s", "-");
+                continue;
+            }
+            t = bench_now();
+            n = fs_ws_dsp_convert(formats[f], raw, (size_t)n_len * fs_ws_dsp_format_frame(formats[f]), x, 1.0f / 128);
+            t = bench_now() - t;
+            printf(" %15.3f", t * 1e9 / n);
+        }
+        printf("\n");
+    }
+    free(raw);
+    free(x);
+}
+
+int main(int argc, const char **argv) {
+    unsigned int n_len = argc > 1 ? (unsigned int)atoi(argv[1]) : 1 << 20;
+    unsigned int h_len, i;
+    unsigned int crossover = 0;
+    double t_direct, t_fast, error, e;
+    float complex *x = (float complex *) malloc(n_len * sizeof(float complex));
+    float complex *y_direct = (float complex *) malloc(n_len * sizeof(float complex));
+    float complex *y_fast = (float complex *) malloc(n_len * sizeof(float complex));
+    float *h;
+    firfilt_crcf q;
+    struct fs_ws_dsp_ols *ols;
+
+    if (!x || !y_direct || !y_fast)
+        return 1;
+    srand(1);
+    for (i = 0; i < n_len; i++)
+        x[i] = (rand() / (float)RAND_MAX - 0.5f) + (rand() / (float)RAND_MAX - 0.5f) * I;
+
+    printf("%u samples\n", n_len);
+    printf("%8s %8s %14s %14s %12s\n", "taps", "nfft", "direct ns/smp", "ols ns/smp", "max error");
+    for (h_len = 8; h_len <= 4096; h_len <<= 1) {
+        h = (float *) malloc(h_len * sizeof(float));
+        liquid_firdes_kaiser(h_len, 0.10f, 60.0f, 0, h);
+
+        q = firfilt_crcf_create(h, h_len);
+        t_direct = bench_now();
+        firfilt_crcf_execute_block(q, x, n_len, y_direct);
+        t_direct = bench_now() - t_direct;
+        firfilt_crcf_destroy(q);
+
+        ols = fs_ws_dsp_ols_create(h, h_len, "", 0);
+        t_fast = bench_now();
+        fs_ws_dsp_ols_execute(ols, x, n_len, y_fast);
+        t_fast = bench_now() - t_fast;
+
+        error = 0;
+        for (i = 0; i < n_len; i++) {
+            e = cabsf(y_direct[i] - y_fast[i]);
+            if (e > error)
+                error = e;
+        }
+        printf("%8u %8u %14.2f %14.2f %12.2e\n", h_len, ols->nfft,
+               t_direct * 1e9 / n_len, t_fast * 1e9 / n_len, error);
+        if (!crossover && t_fast < t_direct)
+            crossover = h_len;
+
+        fs_ws_dsp_ols_destroy(ols);
+        free(h);
+    }
+    if (crossover)
+        printf("overlap-save is faster from %u taps (built in default %u)\n", crossover, FS_WS_DSP_FASTFILT_CROSSOVER);
+    else
+        printf("overlap-save never faster up to 4096 taps\n");
+
+    bench_convert(n_len);
+
+    free(x);
+    free(y_direct);
+    free(y_fast);
+    return 0;
+}
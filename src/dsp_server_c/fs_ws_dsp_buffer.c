@@ -0,0 +1,98 @@
+/**
+ * @file fs_ws_dsp_buffer.c
+ * @brief Process wide pool of buffers in power of two size classes, shared by worker arenas and send queues.
+ */
+
+static pthread_mutex_t fs_ws_dsp_buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fs_ws_dsp_buffer *fs_ws_dsp_buffer_free[FS_WS_DSP_BUFFER_CLASSES];
+static size_t fs_ws_dsp_buffer_pooled = 0;
+
+static struct fs_ws_dsp_buffer *fs_ws_dsp_buffer_of(const char *buffer) {
+    return (struct fs_ws_dsp_buffer *)(buffer - offsetof(struct fs_ws_dsp_buffer, data));
+}
+
+char *fs_ws_dsp_buffer_get(size_t size) {
+    struct fs_ws_dsp_buffer *buffer;
+    unsigned int k = 0;
+
+    while (k < FS_WS_DSP_BUFFER_CLASSES && ((size_t)FS_WS_DSP_BUFFER_MIN << k) < size)
+        k++;
+    if (k == FS_WS_DSP_BUFFER_CLASSES)
+        return NULL;
+    // Larger buffers are never pooled, so rounding them up to a class would only waste memory.
+    if (size > FS_WS_DSP_BUFFER_LARGEST) {
+        buffer = aligned_alloc(16, (sizeof(struct fs_ws_dsp_buffer) + size + 15) & ~(size_t)15);
+        if (!buffer)
+            return NULL;
+        buffer->size = size;
+        buffer->next = NULL;
+        atomic_init(&buffer->refs, 1);
+        return buffer->data;
+    }
+
+    pthread_mutex_lock(&fs_ws_dsp_buffer_lock);
+    buffer = fs_ws_dsp_buffer_free[k];
+    if (buffer) {
+        fs_ws_dsp_buffer_free[k] = buffer->next;
+        fs_ws_dsp_buffer_pooled -= buffer->size;
+    }
+    pthread_mutex_unlock(&fs_ws_dsp_buffer_lock);
+
+    if (!buffer) {
+        buffer = aligned_alloc(16, sizeof(struct fs_ws_dsp_buffer) + ((size_t)FS_WS_DSP_BUFFER_MIN << k));
+        if (!buffer)
+            return NULL;
+        buffer->size = (size_t)FS_WS_DSP_BUFFER_MIN << k;
+    }
+    buffer->next = NULL;
+    atomic_init(&buffer->refs, 1);
+    return buffer->data;
+}
+
+size_t fs_ws_dsp_buffer_size(const char *buffer) {
+    return fs_ws_dsp_buffer_of(buffer)->size;
+}
+
+void fs_ws_dsp_buffer_hold(char *data, unsigned int count) {
+    atomic_fetch_add_explicit(&fs_ws_dsp_buffer_of(data)->refs, count, memory_order_relaxed);
+}
+
+void fs_ws_dsp_buffer_put(char *data) {
+    struct fs_ws_dsp_buffer *buffer;
+    unsigned int k = 0;
+
+    if (!data)
+        return;
+    buffer = fs_ws_dsp_buffer_of(data);
+    // A sole holder cannot race with anyone, shared buffers wait for their last holder.
+    if (atomic_load_explicit(&buffer->refs, memory_order_acquire) != 1 &&
+        atomic_fetch_sub_explicit(&buffer->refs, 1, memory_order_acq_rel) != 1)
+        return;
+    if (buffer->size <= FS_WS_DSP_BUFFER_LARGEST) {
+        while (((size_t)FS_WS_DSP_BUFFER_MIN << k) < buffer->size)
+            k++;
+        pthread_mutex_lock(&fs_ws_dsp_buffer_lock);
+        if (fs_ws_dsp_buffer_pooled + buffer->size <= FS_WS_DSP_BUFFER_POOLED) {
+            buffer->next = fs_ws_dsp_buffer_free[k];
+            fs_ws_dsp_buffer_free[k] = buffer;
+            fs_ws_dsp_buffer_pooled += buffer->size;
+            buffer = NULL;
+        }
+        pthread_mutex_unlock(&fs_ws_dsp_buffer_lock);
+    }
+    free(buffer);
+}
+
+void fs_ws_dsp_buffer_clear() {
+    struct fs_ws_dsp_buffer *buffer;
+    unsigned int k;
+    pthread_mutex_lock(&fs_ws_dsp_buffer_lock);
+    for (k = 0; k < FS_WS_DSP_BUFFER_CLASSES; k++) {
+        while ((buffer = fs_ws_dsp_buffer_free[k])) {
+            fs_ws_dsp_buffer_free[k] = buffer->next;
+            free(buffer);
+        }
+    }
+    fs_ws_dsp_buffer_pooled = 0;
+    pthread_mutex_unlock(&fs_ws_dsp_buffer_lock);
+}
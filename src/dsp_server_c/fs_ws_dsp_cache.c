@@ -0,0 +1,219 @@
+/**
+ * @file fs_ws_dsp_cache.c
+ * @brief Thread-safe, bounded LRU cache of processing objects.
+ */
+
+uint64_t fs_ws_dsp_hash(const void *data, size_t data_len) {
+    // FNV-1a
+    const uint8_t *src = (const uint8_t *)data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+    for (i = 0; i < data_len; i++) {
+        hash ^= src[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+#define FS_WS_DSP_HASH_P1 0x9e3779b185ebca87ULL
+#define FS_WS_DSP_HASH_P2 0xc2b2ae3d27d4eb4fULL
+#define FS_WS_DSP_HASH_P3 0x165667b19e3779f9ULL
+#define FS_WS_DSP_HASH_P4 0x85ebca77c2b2ae63ULL
+#define FS_WS_DSP_HASH_P5 0x27d4eb2f165667c5ULL
+
+static inline uint64_t fs_ws_dsp_hash_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fs_ws_dsp_hash_round(uint64_t acc, uint64_t input) {
+    acc += input * FS_WS_DSP_HASH_P2;
+    return fs_ws_dsp_hash_rotl(acc, 31) * FS_WS_DSP_HASH_P1;
+}
+
+static inline uint64_t fs_ws_dsp_hash_merge(uint64_t hash, uint64_t lane) {
+    hash ^= fs_ws_dsp_hash_round(0, lane);
+    return hash * FS_WS_DSP_HASH_P1 + FS_WS_DSP_HASH_P4;
+}
+
+uint64_t fs_ws_dsp_hash_bulk(const void *data, size_t data_len, uint64_t seed) {
+    // xxHash64, reading at any alignment.
+    const uint8_t *src = (const uint8_t *)data;
+    const uint8_t *end = src + data_len;
+    uint64_t hash, v1, v2, v3, v4, word;
+    uint32_t half;
+
+    if (data_len >= 32) {
+        v1 = seed + FS_WS_DSP_HASH_P1 + FS_WS_DSP_HASH_P2;
+        v2 = seed + FS_WS_DSP_HASH_P2;
+        v3 = seed;
+        v4 = seed - FS_WS_DSP_HASH_P1;
+        for (; end - src >= 32; src += 32) {
+            memcpy(&word, src, 8);      v1 = fs_ws_dsp_hash_round(v1, word);
+            memcpy(&word, src + 8, 8);  v2 = fs_ws_dsp_hash_round(v2, word);
+            memcpy(&word, src + 16, 8); v3 = fs_ws_dsp_hash_round(v3, word);
+            memcpy(&word, src + 24, 8); v4 = fs_ws_dsp_hash_round(v4, word);
+        }
+        hash = fs_ws_dsp_hash_rotl(v1, 1) + fs_ws_dsp_hash_rotl(v2, 7) +
+               fs_ws_dsp_hash_rotl(v3, 12) + fs_ws_dsp_hash_rotl(v4, 18);
+        hash = fs_ws_dsp_hash_merge(hash, v1);
+        hash = fs_ws_dsp_hash_merge(hash, v2);
+        hash = fs_ws_dsp_hash_merge(hash, v3);
+        hash = fs_ws_dsp_hash_merge(hash, v4);
+    } else {
+        hash = seed + FS_WS_DSP_HASH_P5;
+    }
+    hash += data_len;
+    for (; end - src >= 8; src += 8) {
+        memcpy(&word, src, 8);
+        hash ^= fs_ws_dsp_hash_round(0, word);
+        hash = fs_ws_dsp_hash_rotl(hash, 27) * FS_WS_DSP_HASH_P1 + FS_WS_DSP_HASH_P4;
+    }
+    if (end - src >= 4) {
+        memcpy(&half, src, 4);
+        hash ^= (uint64_t)half * FS_WS_DSP_HASH_P1;
+        hash = fs_ws_dsp_hash_rotl(hash, 23) * FS_WS_DSP_HASH_P2 + FS_WS_DSP_HASH_P3;
+        src += 4;
+    }
+    for (; src < end; src++) {
+        hash ^= *src * FS_WS_DSP_HASH_P5;
+        hash = fs_ws_dsp_hash_rotl(hash, 11) * FS_WS_DSP_HASH_P1;
+    }
+    hash ^= hash >> 33;
+    hash *= FS_WS_DSP_HASH_P2;
+    hash ^= hash >> 29;
+    hash *= FS_WS_DSP_HASH_P3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/* Unlink entry from its bucket and the LRU list. Caller holds the lock. */
+static void fs_ws_dsp_cache_unlink(struct fs_ws_dsp_cache *cache, struct fs_ws_dsp_cache_entry *entry) {
+    struct fs_ws_dsp_cache_entry **slot = &cache->buckets[entry->hash % FS_WS_DSP_CACHE_BUCKETS];
+    while (*slot != entry)
+        slot = &(*slot)->bucket_next;
+    *slot = entry->bucket_next;
+
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        cache->lru_head = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        cache->lru_tail = entry->lru_prev;
+
+    cache->stats.count--;
+    cache->stats.bytes -= entry->size;
+}
+
+/* Unlink least recently used entries until within bounds. Caller holds the lock.
+ * Returns the evicted entries chained through bucket_next so they can be destroyed unlocked. */
+static struct fs_ws_dsp_cache_entry *fs_ws_dsp_cache_trim(struct fs_ws_dsp_cache *cache) {
+    struct fs_ws_dsp_cache_entry *evicted = NULL;
+    struct fs_ws_dsp_cache_entry *entry;
+    while (cache->lru_tail &&
+           (cache->stats.count > cache->capacity ||
+            (cache->max_bytes && cache->stats.bytes > cache->max_bytes))) {
+        entry = cache->lru_tail;
+        fs_ws_dsp_cache_unlink(cache, entry);
+        entry->bucket_next = evicted;
+        evicted = entry;
+        cache->stats.evictions++;
+    }
+    return evicted;
+}
+
+static void fs_ws_dsp_cache_release(struct fs_ws_dsp_cache *cache, struct fs_ws_dsp_cache_entry *evicted) {
+    struct fs_ws_dsp_cache_entry *next;
+    while (evicted) {
+        next = evicted->bucket_next;
+        cache->destroy(evicted->value);
+        free(evicted);
+        evicted = next;
+    }
+}
+
+void *fs_ws_dsp_cache_take(struct fs_ws_dsp_cache *cache, const void *key, size_t key_len) {
+    uint64_t hash = fs_ws_dsp_hash(key, key_len);
+    struct fs_ws_dsp_cache_entry *entry;
+    void *value = NULL;
+
+    pthread_mutex_lock(&cache->lock);
+    for (entry = cache->buckets[hash % FS_WS_DSP_CACHE_BUCKETS]; entry; entry = entry->bucket_next) {
+        if (entry->hash == hash && entry->key_len == key_len && !memcmp(entry->key, key, key_len))
+            break;
+    }
+    if (entry) {
+        fs_ws_dsp_cache_unlink(cache, entry);
+        cache->stats.hits++;
+        value = entry->value;
+    } else {
+        cache->stats.misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    free(entry);
+    return value;
+}
+
+void fs_ws_dsp_cache_put(struct fs_ws_dsp_cache *cache, const void *key, size_t key_len, void *value, size_t size) {
+    struct fs_ws_dsp_cache_entry *entry = malloc(sizeof(struct fs_ws_dsp_cache_entry) + key_len);
+    struct fs_ws_dsp_cache_entry **slot;
+    struct fs_ws_dsp_cache_entry *evicted;
+    if (!entry) {
+        cache->destroy(value);
+        return;
+    }
+    entry->hash     = fs_ws_dsp_hash(key, key_len);
+    entry->size     = size;
+    entry->value    = value;
+    entry->key_len  = key_len;
+    entry->lru_prev = NULL;
+    memcpy(entry->key, key, key_len);
+
+    pthread_mutex_lock(&cache->lock);
+    slot = &cache->buckets[entry->hash % FS_WS_DSP_CACHE_BUCKETS];
+    entry->bucket_next = *slot;
+    *slot = entry;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head)
+        cache->lru_head->lru_prev = entry;
+    else
+        cache->lru_tail = entry;
+    cache->lru_head = entry;
+    cache->stats.count++;
+    cache->stats.bytes += size;
+    evicted = fs_ws_dsp_cache_trim(cache);
+    pthread_mutex_unlock(&cache->lock);
+
+    fs_ws_dsp_cache_release(cache, evicted);
+}
+
+void fs_ws_dsp_cache_bound(struct fs_ws_dsp_cache *cache, unsigned int capacity, size_t max_bytes) {
+    struct fs_ws_dsp_cache_entry *evicted;
+    pthread_mutex_lock(&cache->lock);
+    cache->capacity  = capacity;
+    cache->max_bytes = max_bytes;
+    evicted = fs_ws_dsp_cache_trim(cache);
+    pthread_mutex_unlock(&cache->lock);
+    fs_ws_dsp_cache_release(cache, evicted);
+}
+
+void fs_ws_dsp_cache_stats(struct fs_ws_dsp_cache *cache, struct fs_ws_dsp_cache_stats *stats) {
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void fs_ws_dsp_cache_clear(struct fs_ws_dsp_cache *cache) {
+    struct fs_ws_dsp_cache_entry *evicted = NULL;
+    struct fs_ws_dsp_cache_entry *entry;
+    pthread_mutex_lock(&cache->lock);
+    while ((entry = cache->lru_head)) {
+        fs_ws_dsp_cache_unlink(cache, entry);
+        entry->bucket_next = evicted;
+        evicted = entry;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    fs_ws_dsp_cache_release(cache, evicted);
+}
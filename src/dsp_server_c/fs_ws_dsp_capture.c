@@ -0,0 +1,111 @@
+/**
+ * @file fs_ws_dsp_capture.c
+ * @brief Captures recorded on the server host, referenced by requests instead of uploaded.
+ */
+
+static int fs_ws_dsp_capture_dirfd = -1;
+
+int fs_ws_dsp_capture_dir(const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    fs_ws_dsp_capture_close();
+    fs_ws_dsp_capture_dirfd = fd;
+    return 0;
+}
+
+/* Names are plain file names: no path separators, no hidden files and so no "." or "..". Only the
+ * copy is checked, as a local client may still be writing to the memory the name lies in. */
+static int fs_ws_dsp_capture_name(const char *name, uint32_t name_len, char *dest) {
+    if (name_len == 0 || name_len > FS_WS_DSP_CAPTURE_NAME_MAX)
+        return -1;
+    memcpy(dest, name, name_len);
+    dest[name_len] = '\0';
+    if (dest[0] == '.' || memchr(dest, '/', name_len) || memchr(dest, '\0', name_len))
+        return -1;
+    return 0;
+}
+
+/* Read length bytes from offset. A file that turns out shorter than it was has changed under us. */
+static int fs_ws_dsp_capture_read(int fd, char *dest, uint64_t length, uint64_t offset) {
+    ssize_t n;
+    while (length > 0) {
+        n = pread(fd, dest, length, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        dest   += n;
+        length -= (uint64_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+int fs_ws_dsp_capture_map(struct fs_ws_dsp_message *message) {
+    char name[FS_WS_DSP_CAPTURE_NAME_MAX + 1];
+    uint64_t offset = message->capture_offset, start, length = message->data_len;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if (fs_ws_dsp_capture_dirfd < 0 || fs_ws_dsp_capture_name(message->capture, message->capture_len, name))
+        return -1;
+    // Links could lead out of the directory.
+    fd = openat(fs_ws_dsp_capture_dirfd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || offset > (uint64_t)st.st_size) {
+        close(fd);
+        return -1;
+    }
+    if (length == 0)
+        length = (uint64_t)st.st_size - offset;
+    if (length > FS_WS_DSP_CAPTURE_MAX || length > (uint64_t)st.st_size - offset) {
+        close(fd);
+        return -1;
+    }
+    message->data_len = (uint32_t)length;
+    if (length == 0) {
+        close(fd);
+        return 0;
+    }
+    // A mapped file truncated under a worker ends the process with SIGBUS. Only files nobody may
+    // write to are mapped. Others are read into memory of their own, so later changes cannot reach it.
+    if (st.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)) {
+        map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map != MAP_FAILED && fs_ws_dsp_capture_read(fd, map, length, offset)) {
+            munmap(map, length);
+            map = MAP_FAILED;
+        }
+        close(fd);
+        if (map == MAP_FAILED) {
+            message->data_len = 0;
+            return -1;
+        }
+        message->map     = map;
+        message->map_len = length;
+        message->data    = map;
+        return 0;
+    }
+    // Mappings start on a page, the data wherever the offset points.
+    start = offset & ~((uint64_t)sysconf(_SC_PAGESIZE) - 1);
+    map = mmap(NULL, offset - start + length, PROT_READ, MAP_PRIVATE, fd, (off_t)start);
+    close(fd);
+    if (map == MAP_FAILED) {
+        message->data_len = 0;
+        return -1;
+    }
+    // Stages read it front to back, once: read ahead and drop pages behind.
+    madvise(map, offset - start + length, MADV_SEQUENTIAL);
+    message->map     = map;
+    message->map_len = offset - start + length;
+    message->data    = (char *)map + (offset - start);
+    return 0;
+}
+
+void fs_ws_dsp_capture_close() {
+    if (fs_ws_dsp_capture_dirfd >= 0)
+        close(fs_ws_dsp_capture_dirfd);
+    fs_ws_dsp_capture_dirfd = -1;
+}
@@ -0,0 +1,113 @@
+/**
+ * @file fs_ws_dsp_cmd_channelize.c
+ * @brief Polyphase filterbank channelizer.
+ */
+
+static void fs_ws_dsp_channelizer_destroy(void *value) {
+    struct fs_ws_dsp_channelizer *channelizer = (struct fs_ws_dsp_channelizer *)value;
+    if (channelizer->q)
+        firpfbch_crcf_destroy(channelizer->q);
+    free(channelizer->y);
+    free(channelizer);
+}
+
+static struct fs_ws_dsp_cache fs_ws_dsp_channelizer_cache = FS_WS_DSP_CACHE_INITIALIZER(
+    FS_WS_DSP_CHANNELIZE_CACHE, 0, fs_ws_dsp_channelizer_destroy);
+
+static struct fs_ws_dsp_channelizer *fs_ws_dsp_channelizer_acquire(struct fs_ws_dsp_command *command) {
+    struct fs_ws_dsp_channelizer *channelizer;
+    unsigned int channels = fs_ws_dsp_command_param_u32(command, 8, 4);
+    unsigned int m = fs_ws_dsp_command_param_u32(command, 12, 4);
+    float As = fs_ws_dsp_command_param_f32(command, 16, 60.0f);
+    char key[12];
+
+    if (channels < 2 || channels > FS_WS_DSP_CHANNELIZE_MAX || m == 0 || m > FS_WS_DSP_RESAMP_FACTOR_MAX)
+        return NULL;
+    memcpy(key,     &channels, 4);
+    memcpy(key + 4, &m,        4);
+    memcpy(key + 8, &As,       4);
+    channelizer = fs_ws_dsp_cache_take(&fs_ws_dsp_channelizer_cache, key, sizeof key);
+    if (channelizer) {
+        firpfbch_crcf_reset(channelizer->q);
+        channelizer->rest_len = 0;
+        return channelizer;
+    }
+
+    channelizer = malloc(sizeof(struct fs_ws_dsp_channelizer) + sizeof key);
+    if (!channelizer)
+        return NULL;
+    memset(channelizer, 0, sizeof(struct fs_ws_dsp_channelizer));
+    channelizer->channels = channels;
+    channelizer->key_len  = sizeof key;
+    memcpy(channelizer->key, key, sizeof key);
+    channelizer->y = (float complex *) malloc(2 * channels * sizeof(float complex));
+    channelizer->rest = channelizer->y + channels;
+    channelizer->q = firpfbch_crcf_create_kaiser(LIQUID_ANALYZER, channels, m, As);
+    if (!channelizer->y || !channelizer->q) {
+        fs_ws_dsp_channelizer_destroy(channelizer);
+        return NULL;
+    }
+    return channelizer;
+}
+
+static void fs_ws_dsp_cmd_channelize_release(struct fs_ws_dsp_command *command) {
+    struct fs_ws_dsp_channelizer *channelizer = (struct fs_ws_dsp_channelizer *)command->state;
+    fs_ws_dsp_cache_put(&fs_ws_dsp_channelizer_cache, channelizer->key, channelizer->key_len, channelizer,
+                        2 * channelizer->channels * sizeof(float complex));
+    command->state = NULL;
+}
+
+void fs_ws_dsp_cmd_channelize(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response) {
+    struct fs_ws_dsp_channelizer *channelizer = (struct fs_ws_dsp_channelizer *)command->state;
+    float complex *x, *y, *block;
+    unsigned int n_len, channels, blocks, used = 0, t, k;
+
+    x = fs_ws_dsp_samples_input(command, request, response, &n_len);
+    if (!x)
+        return;
+    // The filterbank stays with the command, so a stream keeps its history.
+    if (!channelizer) {
+        channelizer = fs_ws_dsp_channelizer_acquire(command);
+        if (!channelizer)
+            return;
+        command->state   = channelizer;
+        command->release = fs_ws_dsp_cmd_channelize_release;
+    }
+    channels = channelizer->channels;
+    blocks   = (channelizer->rest_len + n_len) / channels;
+
+    // Channels are gathered one after another, which scatters every block, so write to the other buffer.
+    y = x;
+    if (blocks > 0) {
+        y = fs_ws_dsp_arena_borrow(response->arena, x, (size_t)blocks * channels * sizeof(float complex));
+        if (!y)
+            return;
+    }
+    for (t = 0; t < blocks; t++) {
+        // A block the previous message of a stream began is completed from the front of this one.
+        if (channelizer->rest_len > 0) {
+            used = channels - channelizer->rest_len;
+            memcpy(channelizer->rest + channelizer->rest_len, x, used * sizeof(float complex));
+            channelizer->rest_len = 0;
+            block = channelizer->rest;
+        } else {
+            block = x + used;
+            used += channels;
+        }
+        firpfbch_crcf_analyzer_execute(channelizer->q, block, channelizer->y);
+        for (k = 0; k < channels; k++)
+            y[(size_t)k * blocks + t] = channelizer->y[k];
+    }
+    // Samples short of a block wait for the next message, so the filterbank history stays continuous.
+    memcpy(channelizer->rest + channelizer->rest_len, x + used, (n_len - used) * sizeof(float complex));
+    channelizer->rest_len += n_len - used;
+
+    response->_version       = 1;
+    response->id             = request.id;
+    response->commands_count = 0;
+    response->commands       = NULL;
+    response->data_len       = blocks * channels * sizeof(float complex);
+    response->data           = (char *)y;
+
+    return;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file fs_ws_dsp_cmd_convert.c
+ * @brief Convert raw IQ input to float complex samples.
+ */
+
+void fs_ws_dsp_cmd_convert(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response) {
+    uint32_t format = fs_ws_dsp_command_param_u32(command, 4, FS_WS_DSP_FORMAT_INT8);
+    uint32_t flags = fs_ws_dsp_command_param_u32(command, 8, 0);
+    float scale = fs_ws_dsp_command_param_f32(command, 12, 1.0f);
+    unsigned int frame = fs_ws_dsp_format_frame(format);
+    float complex *x;
+    unsigned int n_len;
+
+    if (response->data != NULL) {
+        // Condition the output of the previous stage.
+        x = (float complex *)response->data;
+        n_len = response->data_len / sizeof(float complex);
+        if (scale != 1.0f)
+            fs_ws_dsp_convert_scale(x, n_len, scale);
+    } else {
+        // Scale is folded into the conversion of the request data.
+        if (frame == 0)
+            return;
+        x = fs_ws_dsp_arena_borrow(response->arena, NULL, request.data_len / frame * sizeof(float complex));
+        if (!x)
+            return;
+        n_len = fs_ws_dsp_convert(format, request.data, request.data_len, x, scale);
+    }
+    if (flags & FS_WS_DSP_CONVERT_DC)
+        fs_ws_dsp_convert_dc(x, n_len);
+
+    response->_version       = 1;
+    response->id             = request.id;
+    response->commands_count = 0;
+    response->commands       = NULL;
+    response->data_len       = n_len * sizeof(float complex);
+    response->data           = (char *)x;
+
+    return;
+}
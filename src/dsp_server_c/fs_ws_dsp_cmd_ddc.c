@@ -0,0 +1,80 @@
+/**
+ * @file fs_ws_dsp_cmd_ddc.c
+ * @brief Digital down-converter: mix a channel to baseband, low-pass filter and decimate.
+ */
+
+static void fs_ws_dsp_cmd_ddc_release(struct fs_ws_dsp_command *command) {
+    struct fs_ws_dsp_ddc *ddc = (struct fs_ws_dsp_ddc *)command->state;
+    if (ddc->nco)
+        nco_crcf_destroy(ddc->nco);
+    if (ddc->decim)
+        fs_ws_dsp_resamp_release(ddc->decim);
+    free(ddc);
+    command->state = NULL;
+}
+
+static struct fs_ws_dsp_ddc *fs_ws_dsp_ddc_create(struct fs_ws_dsp_command *command) {
+    float frequency = fs_ws_dsp_command_param_f32(command, 8, 0.0f);
+    unsigned int interp, decim;
+    struct fs_ws_dsp_ddc *ddc;
+
+    if (fs_ws_dsp_resamp_factors(command, &interp, &decim) || !(frequency >= -0.5f && frequency <= 0.5f))
+        return NULL;
+    ddc = malloc(sizeof(struct fs_ws_dsp_ddc));
+    if (!ddc)
+        return NULL;
+    ddc->decim = fs_ws_dsp_resamp_design(FS_WS_DSP_CMD_DECIM, 1, decim,
+                                         fs_ws_dsp_command_param_u32(command, 16, 8), 0.0f,
+                                         fs_ws_dsp_command_param_f32(command, 20, 60.0f));
+    ddc->nco = nco_crcf_create(LIQUID_NCO);
+    if (!ddc->decim || !ddc->nco) {
+        if (ddc->decim)
+            fs_ws_dsp_resamp_release(ddc->decim);
+        if (ddc->nco)
+            nco_crcf_destroy(ddc->nco);
+        free(ddc);
+        return NULL;
+    }
+    nco_crcf_set_frequency(ddc->nco, 2.0f * (float)M_PI * frequency);
+    return ddc;
+}
+
+void fs_ws_dsp_cmd_ddc(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response) {
+    struct fs_ws_dsp_ddc *ddc = (struct fs_ws_dsp_ddc *)command->state;
+    unsigned int n_len, decim, tile, blocks, i;
+    float complex *x;
+
+    x = fs_ws_dsp_samples_input(command, request, response, &n_len);
+    if (!x)
+        return;
+    if (!ddc) {
+        ddc = fs_ws_dsp_ddc_create(command);
+        if (!ddc)
+            return;
+        command->state   = ddc;
+        command->release = fs_ws_dsp_cmd_ddc_release;
+    }
+    decim  = ddc->decim->decim;
+    blocks = n_len / decim;
+    // Whole blocks per tile, at least one.
+    tile = FS_WS_DSP_DDC_TILE / decim > 0 ? FS_WS_DSP_DDC_TILE / decim : 1;
+
+    // In place: output block i lands on index i, at or before the input it was made from.
+    for (i = 0; i < blocks; i += tile) {
+        if (tile > blocks - i)
+            tile = blocks - i;
+        nco_crcf_mix_block_down(ddc->nco, x + (size_t)i * decim, x + (size_t)i * decim, tile * decim);
+        // Without decimation the design is a pass-through, and mixing is all there is to do.
+        if (ddc->decim->decimator)
+            firdecim_crcf_execute_block(ddc->decim->decimator, x + (size_t)i * decim, tile, x + i);
+    }
+
+    response->_version       = 1;
+    response->id             = request.id;
+    response->commands_count = 0;
+    response->commands       = NULL;
+    response->data_len       = blocks * sizeof(float complex);
+    response->data           = (char *)x;
+
+    return;
+}
@@ -4,14 +4,19 @@
  */
 
 void fs_ws_dsp_cmd_echo(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response) {
+    char *data = NULL;
+
+    if (request.data_len > 0) {
+        data = fs_ws_dsp_arena_borrow(response->arena, NULL, request.data_len);
+        if (!data)
+            return;
+        memcpy(data, request.data, request.data_len);
+    }
     response->_version       = 1;
     response->id             = request.id;
     response->data_len       = request.data_len;
     response->commands_count = 0;
     // WE NEED A FUNCTION TO ADD COMMANDS TO A MESSAGE.
-    if (response->data_len > 0) {
-        response->data = malloc(response->data_len);
-        memcpy(response->data, request.data, request.data_len);
-    }
+    response->data           = data;
     return;
 }
@@ -0,0 +1,158 @@
+/**
+ * @file fs_ws_dsp_cmd_fastfilt.c
+ * @brief FIR filter by FFT overlap-save convolution.
+ */
+
+static unsigned int fs_ws_dsp_fastfilt_min_taps = FS_WS_DSP_FASTFILT_CROSSOVER;
+
+static void fs_ws_dsp_ols_uncache(void *value) {
+    fs_ws_dsp_ols_destroy((struct fs_ws_dsp_ols *)value);
+}
+
+static struct fs_ws_dsp_cache fs_ws_dsp_ols_cache = FS_WS_DSP_CACHE_INITIALIZER(
+    FS_WS_DSP_FASTFILT_CACHE, 0, fs_ws_dsp_ols_uncache);
+
+unsigned int fs_ws_dsp_ols_nfft(unsigned int h_len) {
+    // Four times the filter length keeps roughly 3/4 of every transform as useful output.
+    unsigned int nfft = 64;
+    while (nfft < 4 * h_len)
+        nfft <<= 1;
+    return nfft;
+}
+
+struct fs_ws_dsp_ols *fs_ws_dsp_ols_create(float *h, unsigned int h_len, const char *key, size_t key_len) {
+    struct fs_ws_dsp_ols *ols = malloc(sizeof(struct fs_ws_dsp_ols) + key_len);
+    unsigned int nfft = fs_ws_dsp_ols_nfft(h_len);
+    unsigned int i;
+    if (!ols)
+        return NULL;
+    memset(ols, 0, sizeof(struct fs_ws_dsp_ols));
+    ols->h_len   = h_len;
+    ols->nfft    = nfft;
+    ols->block   = nfft - h_len + 1;
+    ols->key_len = key_len;
+    memcpy(ols->key, key, key_len);
+    ols->H = (float complex *) malloc(nfft * sizeof(float complex));
+    ols->t = (float complex *) malloc(nfft * sizeof(float complex));
+    ols->f = (float complex *) malloc(nfft * sizeof(float complex));
+    ols->o = (float complex *) malloc(nfft * sizeof(float complex));
+    if (!ols->H || !ols->t || !ols->f || !ols->o) {
+        fs_ws_dsp_ols_destroy(ols);
+        return NULL;
+    }
+    ols->forward  = fft_create_plan(nfft, ols->t, ols->f, LIQUID_FFT_FORWARD,  0);
+    ols->backward = fft_create_plan(nfft, ols->f, ols->o, LIQUID_FFT_BACKWARD, 0);
+
+    // Filter spectrum, with the inverse transform's 1/nfft folded in.
+    memset(ols->t, 0, nfft * sizeof(float complex));
+    for (i = 0; i < h_len; i++)
+        ols->t[i] = h[i] / (float)nfft;
+    fft_execute(ols->forward);
+    memcpy(ols->H, ols->f, nfft * sizeof(float complex));
+
+    fs_ws_dsp_ols_reset(ols);
+    return ols;
+}
+
+void fs_ws_dsp_ols_reset(struct fs_ws_dsp_ols *ols) {
+    memset(ols->t, 0, ols->nfft * sizeof(float complex));
+}
+
+void fs_ws_dsp_ols_execute(struct fs_ws_dsp_ols *ols, float complex *x, unsigned int n_len, float complex *y) {
+    unsigned int history = ols->h_len - 1;
+    unsigned int pos = 0;
+    unsigned int take, i;
+    while (pos < n_len) {
+        take = n_len - pos < ols->block ? n_len - pos : ols->block;
+        memcpy(ols->t + history, x + pos, take * sizeof(float complex));
+        if (take < ols->block)
+            memset(ols->t + history + take, 0, (ols->block - take) * sizeof(float complex));
+        fft_execute(ols->forward);
+        for (i = 0; i < ols->nfft; i++)
+            ols->f[i] *= ols->H[i];
+        fft_execute(ols->backward);
+        // The first h_len - 1 outputs are wrapped around, the rest is linear convolution.
+        memcpy(y + pos, ols->o + history, take * sizeof(float complex));
+        // Keep the last h_len - 1 input samples as history for the next block.
+        memmove(ols->t, ols->t + take, history * sizeof(float complex));
+        pos += take;
+    }
+}
+
+void fs_ws_dsp_ols_destroy(struct fs_ws_dsp_ols *ols) {
+    if (ols->forward)
+        fft_destroy_plan(ols->forward);
+    if (ols->backward)
+        fft_destroy_plan(ols->backward);
+    free(ols->H);
+    free(ols->t);
+    free(ols->f);
+    free(ols->o);
+    free(ols);
+}
+
+void fs_ws_dsp_fastfilt_crossover(unsigned int h_len) {
+    fs_ws_dsp_fastfilt_min_taps = h_len;
+}
+
+static void fs_ws_dsp_cmd_fastfilt_release(struct fs_ws_dsp_command *command) {
+    struct fs_ws_dsp_fastfilt *state = (struct fs_ws_dsp_fastfilt *)command->state;
+    if (state->ols)
+        fs_ws_dsp_cache_put(&fs_ws_dsp_ols_cache, state->ols->key, state->ols->key_len, state->ols,
+                            4 * state->ols->nfft * sizeof(float complex));
+    fs_ws_dsp_firfilt_release(state->filter);
+    free(state);
+    command->state = NULL;
+}
+
+void fs_ws_dsp_cmd_fastfilt(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response) {
+    struct fs_ws_dsp_fastfilt *state = (struct fs_ws_dsp_fastfilt *)command->state;
+    struct fs_ws_dsp_firfilt *filter;
+    float complex *x;
+    unsigned int n_len;
+
+    // Samples from the previous stage, or the request converted into the arena.
+    x = fs_ws_dsp_samples_input(command, request, response, &n_len);
+    if (!x)
+        return;
+
+    // The FIR design cache supplies taps and the key for the filter spectrum. The form is chosen
+    // on first use and kept with the command, along with its history.
+    if (!state) {
+        filter = fs_ws_dsp_firfilt_acquire(command);
+        if (!filter)
+            return;
+        state = (struct fs_ws_dsp_fastfilt *) malloc(sizeof(struct fs_ws_dsp_fastfilt));
+        if (!state) {
+            fs_ws_dsp_firfilt_release(filter);
+            return;
+        }
+        state->filter = filter;
+        state->ols    = NULL;
+        if (filter->h_len >= fs_ws_dsp_fastfilt_min_taps &&
+            n_len >= fs_ws_dsp_ols_nfft(filter->h_len) - filter->h_len + 1) {
+            state->ols = fs_ws_dsp_cache_take(&fs_ws_dsp_ols_cache, filter->key, filter->key_len);
+            if (state->ols)
+                fs_ws_dsp_ols_reset(state->ols);
+            else
+                state->ols = fs_ws_dsp_ols_create(filter->h, filter->h_len, filter->key, filter->key_len);
+        }
+        command->state   = state;
+        command->release = fs_ws_dsp_cmd_fastfilt_release;
+    }
+
+    // Both forms filter in place.
+    if (state->ols)
+        fs_ws_dsp_ols_execute(state->ols, x, n_len, x);
+    else
+        firfilt_crcf_execute_block(state->filter->q, x, n_len, x);
+
+    response->_version       = 1;
+    response->id             = request.id;
+    response->commands_count = 0;
+    response->commands       = NULL;
+    response->data_len       = n_len * sizeof(float complex);
+    response->data           = (char *)x;
+
+    return;
+}
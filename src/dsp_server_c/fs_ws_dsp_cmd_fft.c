@@ -3,43 +3,199 @@
  * @brief Fast fourier transform.
  */
 
+/**
+ * @brief Averaged power kept with the command across the messages of a stream.
+ */
+struct fs_ws_dsp_fft_average {
+    unsigned int n;  ///< Number of bins.
+    float p[];       ///< Averaged power.
+};
+
+static void fs_ws_dsp_cmd_fft_release(struct fs_ws_dsp_command *command) {
+    free(command->state);
+    command->state = NULL;
+}
+
+int fs_ws_dsp_spectrum_params(struct fs_ws_dsp_command *command, uint32_t offset, struct fs_ws_dsp_spectrum *spectrum) {
+    spectrum->window  = fs_ws_dsp_command_param_u32(command, offset,      FS_WS_DSP_WINDOW_NONE);
+    spectrum->beta    = fs_ws_dsp_command_param_f32(command, offset + 4,  8.6f);
+    spectrum->flags   = fs_ws_dsp_command_param_u32(command, offset + 8,  0);
+    spectrum->mode    = fs_ws_dsp_command_param_u32(command, offset + 12, FS_WS_DSP_SPECTRUM_COMPLEX);
+    spectrum->type    = fs_ws_dsp_command_param_u32(command, offset + 16, FS_WS_DSP_SPECTRUM_FLOAT32);
+    spectrum->db_min  = fs_ws_dsp_command_param_f32(command, offset + 20, -120.0f);
+    spectrum->db_max  = fs_ws_dsp_command_param_f32(command, offset + 24, 0.0f);
+    spectrum->average = fs_ws_dsp_command_param_f32(command, offset + 28, 0.0f);
+    // Output is sized from mode and type, so values beyond the known ones are refused, not guessed at.
+    if (spectrum->window > FS_WS_DSP_WINDOW_KAISER || spectrum->mode > FS_WS_DSP_SPECTRUM_DB ||
+        spectrum->type > FS_WS_DSP_SPECTRUM_UINT8)
+        return -1;
+    // Integer output only makes sense on a dB scale.
+    if (spectrum->mode != FS_WS_DSP_SPECTRUM_COMPLEX && spectrum->type != FS_WS_DSP_SPECTRUM_FLOAT32)
+        spectrum->mode = FS_WS_DSP_SPECTRUM_DB;
+    if (!(spectrum->db_max > spectrum->db_min))
+        spectrum->db_max = spectrum->db_min + 1.0f;
+    return 0;
+}
+
+static void fs_ws_dsp_spectrum_reverse(float complex *x, unsigned int n) {
+    float complex t;
+    unsigned int i;
+    for (i = 0; i < n / 2; i++) {
+        t = x[i];
+        x[i] = x[n - 1 - i];
+        x[n - 1 - i] = t;
+    }
+}
+
+void fs_ws_dsp_spectrum_shift(float complex *x, unsigned int n) {
+    unsigned int k = n - n / 2;
+    // Rotate left by k with three reversals. Bin k holds the most negative frequency.
+    fs_ws_dsp_spectrum_reverse(x, k);
+    fs_ws_dsp_spectrum_reverse(x + k, n - k);
+    fs_ws_dsp_spectrum_reverse(x, n);
+}
+
+void fs_ws_dsp_spectrum_power(float complex *x, unsigned int n, float scale) {
+    float *p = (float *)x;
+    float re, im;
+    unsigned int i;
+    // Power i lands on the float at index i, which belongs to a bin that has already been read.
+    for (i = 0; i < n; i++) {
+        re = crealf(x[i]);
+        im = cimagf(x[i]);
+        p[i] = (re * re + im * im) * scale;
+    }
+}
+
+size_t fs_ws_dsp_spectrum_format(struct fs_ws_dsp_spectrum *spectrum, float *p, unsigned int n) {
+    float span = spectrum->db_max - spectrum->db_min;
+    float db, v;
+    unsigned int i;
+
+    if (spectrum->mode == FS_WS_DSP_SPECTRUM_POWER)
+        return n * sizeof(float);
+    // Outputs are no wider than a float, so each is written over a value that has been read.
+    for (i = 0; i < n; i++) {
+        db = 10.0f * log10f(p[i] > 1e-30f ? p[i] : 1e-30f);
+        if (spectrum->type == FS_WS_DSP_SPECTRUM_FLOAT32) {
+            p[i] = db;
+            continue;
+        }
+        v = (db - spectrum->db_min) / span;
+        v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+        if (spectrum->type == FS_WS_DSP_SPECTRUM_INT16)
+            ((int16_t *)p)[i] = (int16_t)lrintf(v * 32767.0f);
+        else if (spectrum->type == FS_WS_DSP_SPECTRUM_UINT8)
+            ((uint8_t *)p)[i] = (uint8_t)lrintf(v * 255.0f);
+    }
+    if (spectrum->type == FS_WS_DSP_SPECTRUM_INT16)
+        return n * sizeof(int16_t);
+    if (spectrum->type == FS_WS_DSP_SPECTRUM_UINT8)
+        return n * sizeof(uint8_t);
+    return n * sizeof(float);
+}
+
+void fs_ws_dsp_spectrum_average(struct fs_ws_dsp_command *command, float factor, float *p, unsigned int n) {
+    struct fs_ws_dsp_fft_average *average = (struct fs_ws_dsp_fft_average *)command->state;
+    unsigned int i;
+
+    if (average && average->n != n) {
+        command->release(command);
+        average = NULL;
+    }
+    if (!average) {
+        average = malloc(sizeof(struct fs_ws_dsp_fft_average) + n * sizeof(float));
+        if (!average)
+            return;
+        average->n = n;
+        memcpy(average->p, p, n * sizeof(float));
+        command->state   = average;
+        command->release = fs_ws_dsp_cmd_fft_release;
+        return;
+    }
+    for (i = 0; i < n; i++)
+        p[i] = average->p[i] = factor * average->p[i] + (1.0f - factor) * p[i];
+}
+
+/* Take the bins out of the plan array, rotated when shifted, as complex values or as their power. */
+static void fs_ws_dsp_cmd_fft_output(const float complex *y, unsigned int n, int shift, int power, float scale,
+                                     float complex *out) {
+    unsigned int k = shift ? n - n / 2 : 0;
+    float *p = (float *)out;
+    unsigned int i, j;
+
+    if (!power) {
+        memcpy(out, y + k, (n - k) * sizeof(float complex));
+        memcpy(out + n - k, y, k * sizeof(float complex));
+        return;
+    }
+    for (i = 0, j = k; i < n; i++, j = j + 1 == n ? 0 : j + 1)
+        p[i] = (crealf(y[j]) * crealf(y[j]) + cimagf(y[j]) * cimagf(y[j])) * scale;
+}
+
 void fs_ws_dsp_cmd_fft(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response) {
-    uint32_t sample_rate = *((uint32_t *)command->params);
-    uint32_t sample_size = *((uint32_t *)(command->params + 4));
+    uint32_t sample_rate = fs_ws_dsp_command_param_u32(command, 0, 0);
+    struct fs_ws_dsp_spectrum spectrum;
+    struct fs_ws_dsp_window *window = NULL;
+    struct fs_ws_dsp_fft_plan *plan;
     float complex *x;
-    unsigned int n_len;
+    unsigned int n_len, i;
+    float gain;
+    size_t data_len;
     int flags = 0;        // FFT flags (typically ignored)
 
-    // Calculate number of samples.
-    if (response->data == NULL) {
-        // NO LIKE. SAMPLE RATE SHOULD RESPECT TYPE. IE X of COMPLEX SAMPLES (I AND Q AS A UNIT)
-        n_len = request.data_len / sample_size / 2;
-    } else {
-        n_len = response->data_len / sizeof(float complex);
-    }
+    // Samples from the previous stage, or the request converted into the arena.
+    x = fs_ws_dsp_samples_input(command, request, response, &n_len);
+    if (!x)
+        return;
+    if (fs_ws_dsp_spectrum_params(command, 8, &spectrum))
+        return;
 
-    // create filter object, input and output samples.
-    if (response->data == NULL) {
-        x = fs_ws_dsp_samples_8to32(request.data, n_len);
-    } else {
-        x = response->data;
+    // Windows are cached per type and length like the plans.
+    gain = n_len;
+    if (n_len > 0 && spectrum.window != FS_WS_DSP_WINDOW_NONE) {
+        window = fs_ws_dsp_window_acquire(spectrum.window, n_len, spectrum.beta);
+        if (!window)
+            return;
+        gain = window->sum;
     }
-    float complex *y = (float complex *) malloc(n_len * sizeof(float complex));
 
-    // create FFT plan
-    fftplan q = fft_create_plan(n_len, x, y, LIQUID_FFT_FORWARD, flags);
-    fft_execute(q);
+    // Liquid binds a plan to its own arrays, so the window is applied on the way into the plan and the
+    // bins are shifted and squared on the way out, with no passes spent on copying alone.
+    if (n_len > 0) {
+        plan = fs_ws_dsp_fft_plan_acquire(n_len, LIQUID_FFT_FORWARD, flags);
+        if (!plan) {
+            if (window)
+                fs_ws_dsp_window_release(window);
+            return;
+        }
+        if (window) {
+            for (i = 0; i < n_len; i++)
+                plan->x[i] = x[i] * window->w[i];
+            fs_ws_dsp_window_release(window);
+        } else {
+            memcpy(plan->x, x, n_len * sizeof(float complex));
+        }
+        fft_execute(plan->plan);
+        // A full scale tone reads as its squared amplitude whatever the window.
+        fs_ws_dsp_cmd_fft_output(plan->y, n_len, spectrum.flags & FS_WS_DSP_SPECTRUM_SHIFT,
+                                 spectrum.mode != FS_WS_DSP_SPECTRUM_COMPLEX, 1.0f / (gain * gain), x);
+        fs_ws_dsp_fft_plan_release(plan);
+    }
 
-    // destroy FFT plan and free memory arrays
-    fft_destroy_plan(q);
-    free(x); // (response->data)
+    data_len = n_len * sizeof(float complex);
+    if (spectrum.mode != FS_WS_DSP_SPECTRUM_COMPLEX && n_len > 0) {
+        if (spectrum.average > 0.0f)
+            fs_ws_dsp_spectrum_average(command, spectrum.average, (float *)x, n_len);
+        data_len = fs_ws_dsp_spectrum_format(&spectrum, (float *)x, n_len);
+    }
 
     response->_version       = 1;
     response->id             = request.id;
     response->commands_count = 0;
     response->commands       = NULL;
-    response->data_len       = n_len * sizeof(float complex);
-    response->data           = (char *)y;
+    response->data_len       = data_len;
+    response->data           = (char *)x;
 
     return;
 }
@@ -3,53 +3,113 @@
  * @brief FIR Filter.
  */
 
-void fs_ws_dsp_cmd_firfilt(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response) {
-    uint32_t sample_rate = *((uint32_t *)command->params);
-    uint32_t sample_size = *((uint32_t *)(command->params + 4));
-    float complex *x;
-    unsigned int n_len;
+static void fs_ws_dsp_firfilt_destroy(void *value) {
+    struct fs_ws_dsp_firfilt *filter = (struct fs_ws_dsp_firfilt *)value;
+    if (filter->q)
+        firfilt_crcf_destroy(filter->q);
+    free(filter->h);
+    free(filter);
+}
+
+static struct fs_ws_dsp_cache fs_ws_dsp_firfilt_cache = FS_WS_DSP_CACHE_INITIALIZER(
+    FS_WS_DSP_FIRFILT_CACHE, 0, fs_ws_dsp_firfilt_destroy);
 
-    // Calculate number of samples.
-    if (response->data == NULL) {
-        // NO LIKE. SAMPLE RATE SHOULD RESPECT TYPE. IE X of COMPLEX SAMPLES (I AND Q AS A UNIT)
-        n_len = request.data_len / sample_size / 2;
-    } else {
-        n_len = response->data_len / sizeof(float complex);
+struct fs_ws_dsp_firfilt *fs_ws_dsp_firfilt_acquire(struct fs_ws_dsp_command *command) {
+    struct fs_ws_dsp_firfilt *filter;
+    unsigned int h_len = fs_ws_dsp_command_param_u32(command, 8, 57);
+    float fc = fs_ws_dsp_command_param_f32(command, 12, 0.10f);
+    float As = fs_ws_dsp_command_param_f32(command, 16, 60.0f);
+    size_t taps_len = h_len * sizeof(float);
+    int raw = command->params_len >= 20 + taps_len && command->params_len > 20;
+    size_t key_len = 3 * sizeof(uint32_t) + (raw ? taps_len : 0);
+    char *key;
+
+    if (h_len == 0 || h_len > FS_WS_DSP_FIRFILT_TAPS_MAX)
+        return NULL;
+    // liquid ends the process on a cutoff outside (0, 0.5], so designs are checked here first.
+    if (!raw && (!isfinite(fc) || fc <= 0.0f || fc > 0.5f || !isfinite(As) || As <= 0.0f))
+        return NULL;
+    // Key is the filter description. Raw taps make cutoff and attenuation irrelevant.
+    key = malloc(key_len);
+    if (!key)
+        return NULL;
+    if (raw)
+        fc = As = 0.0f;
+    memcpy(key,     &h_len, 4);
+    memcpy(key + 4, &fc,    4);
+    memcpy(key + 8, &As,    4);
+    if (raw)
+        memcpy(key + 12, command->params + 20, taps_len);
+
+    filter = fs_ws_dsp_cache_take(&fs_ws_dsp_firfilt_cache, key, key_len);
+    if (filter) {
+        free(key);
+        firfilt_crcf_reset(filter->q);
+        return filter;
     }
 
-    // Construct filter coefficients:
-    unsigned int h_len=57;      // filter length
-    float fc=0.10f;             // cutoff frequency
-    float As=60.0f;             // stop-band attenuation
-    float h[h_len];
-    liquid_firdes_kaiser(h_len, fc, As, 0, h);
-
-    // create filter object, input and output samples.
-    firfilt_crcf q = firfilt_crcf_create(h, h_len);
-    if (response->data == NULL) {
-        x = fs_ws_dsp_samples_8to32(request.data, n_len);
-    } else {
-        x = response->data;
+    filter = malloc(sizeof(struct fs_ws_dsp_firfilt) + key_len);
+    if (filter) {
+        memset(filter, 0, sizeof(struct fs_ws_dsp_firfilt));
+        filter->h_len   = h_len;
+        filter->key_len = key_len;
+        memcpy(filter->key, key, key_len);
+        filter->h = (float *) malloc(taps_len);
     }
-    float complex *y = (float complex *) malloc(n_len * sizeof(float complex));
+    free(key);
+    if (!filter || !filter->h) {
+        if (filter)
+            fs_ws_dsp_firfilt_destroy(filter);
+        return NULL;
+    }
+    if (raw)
+        memcpy(filter->h, command->params + 20, taps_len);
+    else
+        liquid_firdes_kaiser(h_len, fc, As, 0, filter->h);
+    filter->q = firfilt_crcf_create(filter->h, h_len);
+    return filter;
+}
+
+void fs_ws_dsp_firfilt_release(struct fs_ws_dsp_firfilt *filter) {
+    fs_ws_dsp_cache_put(&fs_ws_dsp_firfilt_cache, filter->key, filter->key_len, filter,
+                        filter->h_len * (sizeof(float) + sizeof(float complex)));
+}
+
+static void fs_ws_dsp_cmd_firfilt_release(struct fs_ws_dsp_command *command) {
+    fs_ws_dsp_firfilt_release((struct fs_ws_dsp_firfilt *)command->state);
+    command->state = NULL;
+}
+
+void fs_ws_dsp_cmd_firfilt(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response) {
+    uint32_t sample_rate = fs_ws_dsp_command_param_u32(command, 0, 0);
+    float complex *x;
+    unsigned int n_len;
+
+    // Samples from the previous stage, or the request converted into the arena.
+    x = fs_ws_dsp_samples_input(command, request, response, &n_len);
+    if (!x)
+        return;
 
-    // Run signal through filter one sample at a time.
-    int i;
-    for (i = 0; i < n_len; i++) {
-        firfilt_crcf_push(q, x[i]);
-        firfilt_crcf_execute(q, &y[i]);
+    // Filter designs are cached by their parameters. The filter stays with the command, so a
+    // stream keeps its filter history from one message to the next.
+    struct fs_ws_dsp_firfilt *filter = (struct fs_ws_dsp_firfilt *)command->state;
+    if (!filter) {
+        filter = fs_ws_dsp_firfilt_acquire(command);
+        if (!filter)
+            return;
+        command->state   = filter;
+        command->release = fs_ws_dsp_cmd_firfilt_release;
     }
 
-    // destroy filter object
-    firfilt_crcf_destroy(q);
-    free(x);
+    // Run signal through filter as one block, in place. Each sample is read before it is overwritten.
+    firfilt_crcf_execute_block(filter->q, x, n_len, x);
 
     response->_version       = 1;
     response->id             = request.id;
     response->commands_count = 0;
     response->commands       = NULL;
     response->data_len       = n_len * sizeof(float complex);
-    response->data           = (char *)y;
+    response->data           = (char *)x;
 
     return;
 }
@@ -0,0 +1,180 @@
+/**
+ * @file fs_ws_dsp_cmd_resamp.c
+ * @brief Polyphase decimation, interpolation and rational resampling.
+ */
+
+static void fs_ws_dsp_resamp_destroy(void *value) {
+    struct fs_ws_dsp_resamp *resamp = (struct fs_ws_dsp_resamp *)value;
+    if (resamp->decimator)
+        firdecim_crcf_destroy(resamp->decimator);
+    if (resamp->interpolator)
+        firinterp_crcf_destroy(resamp->interpolator);
+    if (resamp->resampler)
+        rresamp_crcf_destroy(resamp->resampler);
+    free(resamp);
+}
+
+static struct fs_ws_dsp_cache fs_ws_dsp_resamp_cache = FS_WS_DSP_CACHE_INITIALIZER(
+    FS_WS_DSP_RESAMP_CACHE, 0, fs_ws_dsp_resamp_destroy);
+
+static unsigned int fs_ws_dsp_resamp_gcd(unsigned int a, unsigned int b) {
+    unsigned int t;
+    while (b) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+int fs_ws_dsp_resamp_factors(struct fs_ws_dsp_command *command, unsigned int *interp, unsigned int *decim) {
+    unsigned int g;
+    *interp = 1;
+    *decim  = 1;
+    if (command->type == FS_WS_DSP_CMD_DECIM)
+        *decim = fs_ws_dsp_command_param_u32(command, 8, 2);
+    else if (command->type == FS_WS_DSP_CMD_INTERP)
+        *interp = fs_ws_dsp_command_param_u32(command, 8, 2);
+    else if (command->type == FS_WS_DSP_CMD_RESAMP) {
+        *interp = fs_ws_dsp_command_param_u32(command, 8, 1);
+        *decim  = fs_ws_dsp_command_param_u32(command, 12, 1);
+    } else if (command->type == FS_WS_DSP_CMD_DDC)
+        *decim = fs_ws_dsp_command_param_u32(command, 12, 2);
+    else
+        return -1;
+    if (*interp == 0 || *decim == 0 || *interp > FS_WS_DSP_RESAMP_FACTOR_MAX || *decim > FS_WS_DSP_RESAMP_FACTOR_MAX)
+        return -1;
+    // Liquid reduces the rational resampler the same way.
+    g = fs_ws_dsp_resamp_gcd(*interp, *decim);
+    *interp /= g;
+    *decim  /= g;
+    return 0;
+}
+
+struct fs_ws_dsp_resamp *fs_ws_dsp_resamp_acquire(struct fs_ws_dsp_command *command) {
+    unsigned int interp, decim;
+
+    if (fs_ws_dsp_resamp_factors(command, &interp, &decim))
+        return NULL;
+    if (command->type == FS_WS_DSP_CMD_RESAMP)
+        return fs_ws_dsp_resamp_design(command->type, interp, decim,
+                                       fs_ws_dsp_command_param_u32(command, 16, 12),
+                                       fs_ws_dsp_command_param_f32(command, 20, 0.5f),
+                                       fs_ws_dsp_command_param_f32(command, 24, 60.0f));
+    return fs_ws_dsp_resamp_design(command->type, interp, decim,
+                                   fs_ws_dsp_command_param_u32(command, 12, 8), 0.0f,
+                                   fs_ws_dsp_command_param_f32(command, 16, 60.0f));
+}
+
+struct fs_ws_dsp_resamp *fs_ws_dsp_resamp_design(uint32_t type, unsigned int interp, unsigned int decim,
+                                                 unsigned int m, float bw, float As) {
+    struct fs_ws_dsp_resamp *resamp;
+    char key[24];
+
+    if (type != FS_WS_DSP_CMD_DECIM && type != FS_WS_DSP_CMD_INTERP && type != FS_WS_DSP_CMD_RESAMP)
+        return NULL;
+    if (m == 0 || m > FS_WS_DSP_RESAMP_FACTOR_MAX)
+        return NULL;
+    if (type != FS_WS_DSP_CMD_RESAMP)
+        bw = 0.0f;
+    // liquid ends the process on a bandwidth outside (0, 0.5] or a bad attenuation, so they are checked first.
+    if (!isfinite(As) || As <= 0.0f || (type == FS_WS_DSP_CMD_RESAMP && !(bw > 0.0f && bw <= 0.5f)))
+        return NULL;
+    memcpy(key,      &type,          4);
+    memcpy(key + 4,  &interp,        4);
+    memcpy(key + 8,  &decim,         4);
+    memcpy(key + 12, &m,             4);
+    memcpy(key + 16, &bw,            4);
+    memcpy(key + 20, &As,            4);
+
+    resamp = fs_ws_dsp_cache_take(&fs_ws_dsp_resamp_cache, key, sizeof key);
+    if (resamp) {
+        if (resamp->decimator)
+            firdecim_crcf_reset(resamp->decimator);
+        if (resamp->interpolator)
+            firinterp_crcf_reset(resamp->interpolator);
+        if (resamp->resampler)
+            rresamp_crcf_reset(resamp->resampler);
+        return resamp;
+    }
+
+    resamp = malloc(sizeof(struct fs_ws_dsp_resamp) + sizeof key);
+    if (!resamp)
+        return NULL;
+    memset(resamp, 0, sizeof(struct fs_ws_dsp_resamp));
+    resamp->type    = type;
+    resamp->interp  = interp;
+    resamp->decim   = decim;
+    resamp->key_len = sizeof key;
+    memcpy(resamp->key, key, sizeof key);
+    // A rate of 1/1, a factor of 1 or P equal to Q, passes samples through. liquid would end the
+    // process on a filter for it.
+    if (interp == 1 && decim == 1)
+        return resamp;
+    if (type == FS_WS_DSP_CMD_DECIM)
+        resamp->decimator = firdecim_crcf_create_kaiser(decim, m, As);
+    else if (type == FS_WS_DSP_CMD_INTERP)
+        resamp->interpolator = firinterp_crcf_create_kaiser(interp, m, As);
+    else
+        resamp->resampler = rresamp_crcf_create_kaiser(interp, decim, m, bw, As);
+    if (!resamp->decimator && !resamp->interpolator && !resamp->resampler) {
+        fs_ws_dsp_resamp_destroy(resamp);
+        return NULL;
+    }
+    return resamp;
+}
+
+void fs_ws_dsp_resamp_release(struct fs_ws_dsp_resamp *resamp) {
+    // Accounted by the size of one block of history, which is all the cache bounds are for.
+    fs_ws_dsp_cache_put(&fs_ws_dsp_resamp_cache, resamp->key, resamp->key_len, resamp,
+                        sizeof(struct fs_ws_dsp_resamp) + (resamp->interp + resamp->decim) * sizeof(float complex));
+}
+
+static void fs_ws_dsp_cmd_resamp_release(struct fs_ws_dsp_command *command) {
+    fs_ws_dsp_resamp_release((struct fs_ws_dsp_resamp *)command->state);
+    command->state = NULL;
+}
+
+void fs_ws_dsp_cmd_resamp(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response) {
+    struct fs_ws_dsp_resamp *resamp = (struct fs_ws_dsp_resamp *)command->state;
+    float complex *x, *y;
+    unsigned int n_len, blocks;
+
+    x = fs_ws_dsp_samples_input(command, request, response, &n_len);
+    if (!x)
+        return;
+
+    // The resampler stays with the command, so a stream keeps its filter history.
+    if (!resamp) {
+        resamp = fs_ws_dsp_resamp_acquire(command);
+        if (!resamp)
+            return;
+        command->state   = resamp;
+        command->release = fs_ws_dsp_cmd_resamp_release;
+    }
+    blocks = n_len / resamp->decim;
+
+    // Decimation writes output i after reading input i * M, so it runs in place. Anything else goes
+    // to the other arena buffer.
+    y = x;
+    if (resamp->interp > 1 && blocks > 0) {
+        y = fs_ws_dsp_arena_borrow(response->arena, x, (size_t)blocks * resamp->interp * sizeof(float complex));
+        if (!y)
+            return;
+    }
+    if (resamp->decimator)
+        firdecim_crcf_execute_block(resamp->decimator, x, blocks, y);
+    else if (resamp->interpolator)
+        firinterp_crcf_execute_block(resamp->interpolator, x, blocks, y);
+    else if (resamp->resampler && blocks > 0)
+        rresamp_crcf_execute_block(resamp->resampler, x, blocks, y);
+
+    response->_version       = 1;
+    response->id             = request.id;
+    response->commands_count = 0;
+    response->commands       = NULL;
+    response->data_len       = blocks * resamp->interp * sizeof(float complex);
+    response->data           = (char *)y;
+
+    return;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file fs_ws_dsp_cmd_stft.c
+ * @brief Short time fourier transform: spectrogram or Welch averaged power spectrum.
+ */
+
+/**
+ * @brief Shared by the threads transforming the frames of one block.
+ */
+struct fs_ws_dsp_stft {
+    const float complex *x;              ///< Input samples.
+    unsigned int nfft;                   ///< Frame length.
+    unsigned int hop;                    ///< Samples between frame starts.
+    unsigned int grain;                  ///< Frames per range handed to one thread.
+    struct fs_ws_dsp_window *window;     ///< Window, as long as a frame. NULL for none.
+    struct fs_ws_dsp_spectrum *spectrum; ///< Output mode and type.
+    float scale;                         ///< Power normalization.
+    uint32_t output;                     ///< Spectrogram or Welch.
+    char *out;                           ///< Spectrogram rows, or one sum of power per range for Welch.
+    size_t row_bytes;                    ///< Byte length of a spectrogram row.
+    _Atomic int failed;                  ///< A range could not get a plan.
+};
+
+static void fs_ws_dsp_stft_frames(void *arg, unsigned int begin, unsigned int end) {
+    struct fs_ws_dsp_stft *stft = (struct fs_ws_dsp_stft *)arg;
+    struct fs_ws_dsp_fft_plan *plan = fs_ws_dsp_fft_plan_acquire(stft->nfft, LIQUID_FFT_FORWARD, 0);
+    unsigned int nfft = stft->nfft;
+    const float complex *frame;
+    float *sum = NULL, *p;
+    unsigned int r, i;
+
+    if (!plan) {
+        atomic_store(&stft->failed, 1);
+        return;
+    }
+    if (stft->output == FS_WS_DSP_STFT_WELCH) {
+        sum = (float *)stft->out + (size_t)(begin / stft->grain) * nfft;
+        memset(sum, 0, nfft * sizeof(float));
+    }
+    for (r = begin; r < end; r++) {
+        frame = stft->x + (size_t)r * stft->hop;
+        if (stft->window) {
+            for (i = 0; i < nfft; i++)
+                plan->x[i] = frame[i] * stft->window->w[i];
+        } else {
+            memcpy(plan->x, frame, nfft * sizeof(float complex));
+        }
+        fft_execute(plan->plan);
+        if (stft->spectrum->flags & FS_WS_DSP_SPECTRUM_SHIFT)
+            fs_ws_dsp_spectrum_shift(plan->y, nfft);
+        if (sum) {
+            p = (float *)plan->y;
+            fs_ws_dsp_spectrum_power(plan->y, nfft, stft->scale);
+            for (i = 0; i < nfft; i++)
+                sum[i] += p[i];
+            continue;
+        }
+        // Rows are formatted in the plan output array, then copied to their place in the response.
+        if (stft->spectrum->mode != FS_WS_DSP_SPECTRUM_COMPLEX) {
+            fs_ws_dsp_spectrum_power(plan->y, nfft, stft->scale);
+            fs_ws_dsp_spectrum_format(stft->spectrum, (float *)plan->y, nfft);
+        }
+        memcpy(stft->out + (size_t)r * stft->row_bytes, plan->y, stft->row_bytes);
+    }
+    fs_ws_dsp_fft_plan_release(plan);
+}
+
+void fs_ws_dsp_cmd_stft(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response) {
+    unsigned int nfft = fs_ws_dsp_command_param_u32(command, 8, 1024);
+    unsigned int hop = fs_ws_dsp_command_param_u32(command, 12, nfft / 2);
+    struct fs_ws_dsp_spectrum spectrum;
+    struct fs_ws_dsp_stft stft;
+    unsigned int n_len, frames, ranges, r, i;
+    float *p, *sum, gain;
+    uint64_t out_len;
+    size_t data_len;
+    float complex *x;
+
+    x = fs_ws_dsp_samples_input(command, request, response, &n_len);
+    if (!x)
+        return;
+    if (nfft == 0 || nfft > FS_WS_DSP_STFT_FRAME_MAX || hop == 0)
+        return;
+    if (fs_ws_dsp_spectrum_params(command, 20, &spectrum))
+        return;
+    if (command->params_len < 24)
+        spectrum.window = FS_WS_DSP_WINDOW_HANN;
+
+    memset(&stft, 0, sizeof(struct fs_ws_dsp_stft));
+    stft.x        = x;
+    stft.nfft     = nfft;
+    stft.hop      = hop;
+    stft.spectrum = &spectrum;
+    stft.output   = fs_ws_dsp_command_param_u32(command, 16, FS_WS_DSP_STFT_SPECTROGRAM);
+    if (stft.output == FS_WS_DSP_STFT_WELCH && spectrum.mode == FS_WS_DSP_SPECTRUM_COMPLEX)
+        spectrum.mode = FS_WS_DSP_SPECTRUM_POWER;
+    frames = n_len < nfft ? 0 : (n_len - nfft) / hop + 1;
+    // Ranges are sized so each one is worth handing to another core.
+    stft.grain = FS_WS_DSP_STFT_GRAIN / nfft > 0 ? FS_WS_DSP_STFT_GRAIN / nfft : 1;
+    ranges = (frames + stft.grain - 1) / stft.grain;
+    stft.row_bytes = spectrum.mode == FS_WS_DSP_SPECTRUM_COMPLEX ? nfft * sizeof(float complex) :
+                     spectrum.type == FS_WS_DSP_SPECTRUM_INT16 ? nfft * sizeof(int16_t) :
+                     spectrum.type == FS_WS_DSP_SPECTRUM_UINT8 ? nfft * sizeof(uint8_t) : nfft * sizeof(float);
+    out_len = stft.output == FS_WS_DSP_STFT_WELCH ? (uint64_t)ranges * nfft * sizeof(float) : (uint64_t)frames * stft.row_bytes;
+    // Refused rather than cut short, the response length is only 32 bits.
+    if (out_len > FS_WS_DSP_STFT_OUTPUT_MAX)
+        return;
+    data_len = (size_t)out_len;
+
+    // Frames overlap, so the output goes to the other arena buffer while the samples stay readable.
+    if (frames > 0) {
+        stft.out = fs_ws_dsp_arena_borrow(response->arena, x, data_len);
+        if (!stft.out)
+            return;
+        gain = nfft;
+        if (spectrum.window != FS_WS_DSP_WINDOW_NONE) {
+            stft.window = fs_ws_dsp_window_acquire(spectrum.window, nfft, spectrum.beta);
+            if (!stft.window)
+                return;
+            gain = stft.window->sum;
+        }
+        stft.scale = 1.0f / (gain * gain);
+        fs_ws_dsp_fork_run(frames, stft.grain, fs_ws_dsp_stft_frames, &stft);
+        if (stft.window)
+            fs_ws_dsp_window_release(stft.window);
+        if (atomic_load(&stft.failed))
+            return;
+    }
+
+    if (stft.output == FS_WS_DSP_STFT_WELCH && frames > 0) {
+        // Add up the sums of every range into the first, then average.
+        sum = (float *)stft.out;
+        for (r = 1; r < ranges; r++) {
+            p = sum + (size_t)r * nfft;
+            for (i = 0; i < nfft; i++)
+                sum[i] += p[i];
+        }
+        for (i = 0; i < nfft; i++)
+            sum[i] /= frames;
+        if (spectrum.average > 0.0f)
+            fs_ws_dsp_spectrum_average(command, spectrum.average, sum, nfft);
+        data_len = fs_ws_dsp_spectrum_format(&spectrum, sum, nfft);
+    }
+
+    response->_version       = 1;
+    response->id             = request.id;
+    response->commands_count = 0;
+    response->commands       = NULL;
+    response->data_len       = frames > 0 ? data_len : 0;
+    response->data           = frames > 0 ? stft.out : (char *)x;
+
+    return;
+}
@@ -3,21 +3,35 @@
  * @brief Commands define what type of signal processing should be done on data.
  */
 
-struct fs_ws_dsp_command* fs_ws_dsp_command_parse(char *stream) {
-    struct fs_ws_dsp_command *command = malloc(sizeof(struct fs_ws_dsp_command));
+int fs_ws_dsp_command_parse(struct fs_ws_dsp_command *command, char *stream, size_t stream_len) {
     memset(command, 0, sizeof(struct fs_ws_dsp_command));
-    command->type = *((uint32_t *)stream);
-    command->params_len = *((uint32_t *)(stream + 4));
-    if (command->params_len > 0) {
-        command->params = malloc(command->params_len);
-        memcpy(command->params, stream + 8, command->params_len);
-    }
-    return command;
+    if (stream_len < 8)
+        return -1;
+    memcpy(&command->type,       stream,     4);
+    memcpy(&command->params_len, stream + 4, 4);
+    if (command->params_len > stream_len - 8 || command->params_len > INT32_MAX - 8)
+        return -1;
+    if (command->params_len > 0)
+        command->params = stream + 8;
+    return 8 + command->params_len;
+}
+uint32_t fs_ws_dsp_command_param_u32(struct fs_ws_dsp_command *command, uint32_t offset, uint32_t fallback) {
+    uint32_t value;
+    if (command->params == NULL || command->params_len < offset + sizeof value)
+        return fallback;
+    memcpy(&value, command->params + offset, sizeof value);
+    return value;
+}
+float fs_ws_dsp_command_param_f32(struct fs_ws_dsp_command *command, uint32_t offset, float fallback) {
+    float value;
+    if (command->params == NULL || command->params_len < offset + sizeof value)
+        return fallback;
+    memcpy(&value, command->params + offset, sizeof value);
+    return value;
 }
 struct fs_ws_dsp_command* fs_ws_dsp_command_free(struct fs_ws_dsp_command *command) {
-	if (command->params != NULL)
-		free(command->params);
-    free(command);
+	if (command->state != NULL && command->release != NULL)
+		command->release(command);
     return 0;
 }
 char* fs_ws_dsp_command_serialize(struct fs_ws_dsp_command *command) {
@@ -0,0 +1,345 @@
+/**
+ * @file fs_ws_dsp_convert.c
+ * @brief Conversion of raw interleaved IQ input to float complex samples.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FS_WS_DSP_CONVERT_X86 1
+#endif
+
+/**
+ * @brief Kernels of one instruction set.
+ */
+struct fs_ws_dsp_convert_kernels {
+    const char *isa;
+    fs_ws_dsp_convert_kernel int8;
+    fs_ws_dsp_convert_kernel uint8;
+    fs_ws_dsp_convert_kernel int16;
+    fs_ws_dsp_convert_kernel packed12;
+    fs_ws_dsp_convert_kernel float32;
+};
+
+/* Scalar kernels. Also finish the tail the vector kernels leave. */
+
+static void fs_ws_dsp_convert_int8_scalar(const void *src, float *dst, size_t count, float scale) {
+    const int8_t *s = (const int8_t *)src;
+    size_t i;
+    for (i = 0; i < count; i++)
+        dst[i] = s[i] * scale;
+}
+
+static void fs_ws_dsp_convert_uint8_scalar(const void *src, float *dst, size_t count, float scale) {
+    const uint8_t *s = (const uint8_t *)src;
+    size_t i;
+    for (i = 0; i < count; i++)
+        dst[i] = ((int)s[i] - 128) * scale;
+}
+
+static void fs_ws_dsp_convert_int16_scalar(const void *src, float *dst, size_t count, float scale) {
+    const char *s = (const char *)src;
+    int16_t v;
+    size_t i;
+    for (i = 0; i < count; i++) {
+        memcpy(&v, s + 2 * i, 2);
+        dst[i] = v * scale;
+    }
+}
+
+static void fs_ws_dsp_convert_packed12_scalar(const void *src, float *dst, size_t count, float scale) {
+    const uint8_t *s = (const uint8_t *)src;
+    size_t i;
+    for (i = 0; i + 1 < count; i += 2, s += 3) {
+        // Shift the 12 bit value to the top of 16 bits and back down to sign extend it.
+        dst[i]     = (int16_t)((uint16_t)(s[0] | (s[1] & 0x0F) << 8) << 4) / 16 * scale;
+        dst[i + 1] = (int16_t)((uint16_t)(s[1] >> 4 | s[2] << 4) << 4) / 16 * scale;
+    }
+}
+
+static void fs_ws_dsp_convert_float32_scalar(const void *src, float *dst, size_t count, float scale) {
+    const char *s = (const char *)src;
+    size_t i;
+    if (scale == 1.0f) {
+        memcpy(dst, src, count * sizeof(float));
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        memcpy(&dst[i], s + 4 * i, 4);
+        dst[i] *= scale;
+    }
+}
+
+static const struct fs_ws_dsp_convert_kernels fs_ws_dsp_convert_scalar = {
+    "scalar",
+    fs_ws_dsp_convert_int8_scalar,
+    fs_ws_dsp_convert_uint8_scalar,
+    fs_ws_dsp_convert_int16_scalar,
+    fs_ws_dsp_convert_packed12_scalar,
+    fs_ws_dsp_convert_float32_scalar
+};
+
+#ifdef FS_WS_DSP_CONVERT_X86
+
+/* SSE2 kernels. Offset binary is signed once the top bit is flipped. */
+
+__attribute__((target("sse2")))
+static void fs_ws_dsp_convert_s8_sse2(const void *src, float *dst, size_t count, float scale, char flip) {
+    const char *s = (const char *)src;
+    __m128 k = _mm_set1_ps(scale);
+    __m128i m = _mm_set1_epi8(flip);
+    __m128i v, lo, hi;
+    size_t i;
+    for (i = 0; i + 16 <= count; i += 16) {
+        v  = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(s + i)), m);
+        lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+        hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+        _mm_storeu_ps(dst + i,      _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)), k));
+        _mm_storeu_ps(dst + i + 4,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)), k));
+        _mm_storeu_ps(dst + i + 8,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)), k));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)), k));
+    }
+    if (flip)
+        fs_ws_dsp_convert_uint8_scalar(s + i, dst + i, count - i, scale);
+    else
+        fs_ws_dsp_convert_int8_scalar(s + i, dst + i, count - i, scale);
+}
+
+static void fs_ws_dsp_convert_int8_sse2(const void *src, float *dst, size_t count, float scale) {
+    fs_ws_dsp_convert_s8_sse2(src, dst, count, scale, 0);
+}
+
+static void fs_ws_dsp_convert_uint8_sse2(const void *src, float *dst, size_t count, float scale) {
+    fs_ws_dsp_convert_s8_sse2(src, dst, count, scale, (char)0x80);
+}
+
+__attribute__((target("sse2")))
+static void fs_ws_dsp_convert_int16_sse2(const void *src, float *dst, size_t count, float scale) {
+    const char *s = (const char *)src;
+    __m128 k = _mm_set1_ps(scale);
+    __m128i v;
+    size_t i;
+    for (i = 0; i + 8 <= count; i += 8) {
+        v = _mm_loadu_si128((const __m128i *)(s + 2 * i));
+        _mm_storeu_ps(dst + i,     _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), k));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), k));
+    }
+    fs_ws_dsp_convert_int16_scalar(s + 2 * i, dst + i, count - i, scale);
+}
+
+__attribute__((target("sse2")))
+static void fs_ws_dsp_convert_float32_sse2(const void *src, float *dst, size_t count, float scale) {
+    const char *s = (const char *)src;
+    __m128 k = _mm_set1_ps(scale);
+    size_t i;
+    if (scale == 1.0f) {
+        memcpy(dst, src, count * sizeof(float));
+        return;
+    }
+    for (i = 0; i + 4 <= count; i += 4)
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps((const float *)(s + 4 * i)), k));
+    fs_ws_dsp_convert_float32_scalar(s + 4 * i, dst + i, count - i, scale);
+}
+
+/* SSE2 has no byte shuffle, so packed 12 bit stays scalar there. */
+static const struct fs_ws_dsp_convert_kernels fs_ws_dsp_convert_sse2 = {
+    "sse2",
+    fs_ws_dsp_convert_int8_sse2,
+    fs_ws_dsp_convert_uint8_sse2,
+    fs_ws_dsp_convert_int16_sse2,
+    fs_ws_dsp_convert_packed12_scalar,
+    fs_ws_dsp_convert_float32_sse2
+};
+
+/* AVX2 kernels. */
+
+__attribute__((target("avx2")))
+static void fs_ws_dsp_convert_s8_avx2(const void *src, float *dst, size_t count, float scale, char flip) {
+    const char *s = (const char *)src;
+    __m256 k = _mm256_set1_ps(scale);
+    __m256i m = _mm256_set1_epi8(flip);
+    __m256i v;
+    __m128i a, b;
+    size_t i;
+    for (i = 0; i + 32 <= count; i += 32) {
+        v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(s + i)), m);
+        a = _mm256_castsi256_si128(v);
+        b = _mm256_extracti128_si256(v, 1);
+        _mm256_storeu_ps(dst + i,      _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(a)), k));
+        _mm256_storeu_ps(dst + i + 8,  _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(a, 8))), k));
+        _mm256_storeu_ps(dst + i + 16, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b)), k));
+        _mm256_storeu_ps(dst + i + 24, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(b, 8))), k));
+    }
+    if (flip)
+        fs_ws_dsp_convert_uint8_scalar(s + i, dst + i, count - i, scale);
+    else
+        fs_ws_dsp_convert_int8_scalar(s + i, dst + i, count - i, scale);
+}
+
+static void fs_ws_dsp_convert_int8_avx2(const void *src, float *dst, size_t count, float scale) {
+    fs_ws_dsp_convert_s8_avx2(src, dst, count, scale, 0);
+}
+
+static void fs_ws_dsp_convert_uint8_avx2(const void *src, float *dst, size_t count, float scale) {
+    fs_ws_dsp_convert_s8_avx2(src, dst, count, scale, (char)0x80);
+}
+
+__attribute__((target("avx2")))
+static void fs_ws_dsp_convert_int16_avx2(const void *src, float *dst, size_t count, float scale) {
+    const char *s = (const char *)src;
+    __m256 k = _mm256_set1_ps(scale);
+    __m256i v;
+    size_t i;
+    for (i = 0; i + 16 <= count; i += 16) {
+        v = _mm256_loadu_si256((const __m256i *)(s + 2 * i));
+        _mm256_storeu_ps(dst + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v))), k));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1))), k));
+    }
+    fs_ws_dsp_convert_int16_scalar(s + 2 * i, dst + i, count - i, scale);
+}
+
+__attribute__((target("avx2")))
+static void fs_ws_dsp_convert_packed12_avx2(const void *src, float *dst, size_t count, float scale) {
+    const char *s = (const char *)src;
+    size_t bytes = count / 2 * 3;
+    // Per 128 bit lane, 12 input bytes become 8 words: [b0 b1] [b1 b2] for each of 4 sample pairs.
+    const __m256i spread = _mm256_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+                                            0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+    __m256 k = _mm256_set1_ps(scale);
+    __m256i w, lo, hi;
+    size_t i = 0, j = 0;
+    // Each step reads 16 bytes at j and at j + 12, so stop 28 bytes before the end.
+    for (; j + 28 <= bytes; i += 16, j += 24) {
+        w = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(s + j))),
+                                    _mm_loadu_si128((const __m128i *)(s + j + 12)), 1);
+        w  = _mm256_shuffle_epi8(w, spread);
+        // I sits in the low 12 bits of even words, Q in the high 12 bits of odd words.
+        lo = _mm256_srai_epi16(_mm256_slli_epi16(w, 4), 4);
+        hi = _mm256_srai_epi16(w, 4);
+        w  = _mm256_blend_epi16(lo, hi, 0xAA);
+        _mm256_storeu_ps(dst + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(w))), k));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(w, 1))), k));
+    }
+    fs_ws_dsp_convert_packed12_scalar(s + j, dst + i, count - i, scale);
+}
+
+__attribute__((target("avx2")))
+static void fs_ws_dsp_convert_float32_avx2(const void *src, float *dst, size_t count, float scale) {
+    const char *s = (const char *)src;
+    __m256 k = _mm256_set1_ps(scale);
+    size_t i;
+    if (scale == 1.0f) {
+        memcpy(dst, src, count * sizeof(float));
+        return;
+    }
+    for (i = 0; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps((const float *)(s + 4 * i)), k));
+    fs_ws_dsp_convert_float32_scalar(s + 4 * i, dst + i, count - i, scale);
+}
+
+static const struct fs_ws_dsp_convert_kernels fs_ws_dsp_convert_avx2 = {
+    "avx2",
+    fs_ws_dsp_convert_int8_avx2,
+    fs_ws_dsp_convert_uint8_avx2,
+    fs_ws_dsp_convert_int16_avx2,
+    fs_ws_dsp_convert_packed12_avx2,
+    fs_ws_dsp_convert_float32_avx2
+};
+
+#endif
+
+static const struct fs_ws_dsp_convert_kernels *fs_ws_dsp_convert_kernels = &fs_ws_dsp_convert_scalar;
+static pthread_once_t fs_ws_dsp_convert_once = PTHREAD_ONCE_INIT;
+
+static void fs_ws_dsp_convert_detect() {
+#ifdef FS_WS_DSP_CONVERT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        fs_ws_dsp_convert_kernels = &fs_ws_dsp_convert_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        fs_ws_dsp_convert_kernels = &fs_ws_dsp_convert_sse2;
+#endif
+}
+
+unsigned int fs_ws_dsp_format_frame(uint32_t format) {
+    if (format == FS_WS_DSP_FORMAT_INT8 || format == FS_WS_DSP_FORMAT_UINT8)
+        return 2;
+    if (format == FS_WS_DSP_FORMAT_INT16)
+        return 4;
+    if (format == FS_WS_DSP_FORMAT_PACKED12)
+        return 3;
+    if (format == FS_WS_DSP_FORMAT_FLOAT32)
+        return 8;
+    return 0;
+}
+
+unsigned int fs_ws_dsp_convert(uint32_t format, const void *src, size_t src_len, float complex *x, float scale) {
+    const struct fs_ws_dsp_convert_kernels *kernels;
+    fs_ws_dsp_convert_kernel kernel = NULL;
+    unsigned int frame = fs_ws_dsp_format_frame(format);
+    unsigned int n_len;
+
+    if (frame == 0)
+        return 0;
+    pthread_once(&fs_ws_dsp_convert_once, fs_ws_dsp_convert_detect);
+    kernels = fs_ws_dsp_convert_kernels;
+    if (format == FS_WS_DSP_FORMAT_INT8)
+        kernel = kernels->int8;
+    if (format == FS_WS_DSP_FORMAT_UINT8)
+        kernel = kernels->uint8;
+    if (format == FS_WS_DSP_FORMAT_INT16)
+        kernel = kernels->int16;
+    if (format == FS_WS_DSP_FORMAT_PACKED12)
+        kernel = kernels->packed12;
+    if (format == FS_WS_DSP_FORMAT_FLOAT32)
+        kernel = kernels->float32;
+    n_len = src_len / frame;
+    if (n_len > 0)
+        kernel(src, (float *)x, 2 * (size_t)n_len, scale);
+    return n_len;
+}
+
+void fs_ws_dsp_convert_dc(float complex *x, unsigned int n_len) {
+    double re = 0.0, im = 0.0;
+    float complex mean;
+    unsigned int i;
+    if (n_len == 0)
+        return;
+    for (i = 0; i < n_len; i++) {
+        re += crealf(x[i]);
+        im += cimagf(x[i]);
+    }
+    mean = (float)(re / n_len) + (float)(im / n_len) * I;
+    for (i = 0; i < n_len; i++)
+        x[i] -= mean;
+}
+
+void fs_ws_dsp_convert_scale(float complex *x, unsigned int n_len, float scale) {
+    float *v = (float *)x;
+    size_t i;
+    for (i = 0; i < 2 * (size_t)n_len; i++)
+        v[i] *= scale;
+}
+
+int fs_ws_dsp_convert_select(const char *isa) {
+    pthread_once(&fs_ws_dsp_convert_once, fs_ws_dsp_convert_detect);
+    if (!strcmp(isa, "scalar")) {
+        fs_ws_dsp_convert_kernels = &fs_ws_dsp_convert_scalar;
+        return 0;
+    }
+#ifdef FS_WS_DSP_CONVERT_X86
+    if (!strcmp(isa, "sse2") && __builtin_cpu_supports("sse2")) {
+        fs_ws_dsp_convert_kernels = &fs_ws_dsp_convert_sse2;
+        return 0;
+    }
+    if (!strcmp(isa, "avx2") && __builtin_cpu_supports("avx2")) {
+        fs_ws_dsp_convert_kernels = &fs_ws_dsp_convert_avx2;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+const char *fs_ws_dsp_convert_isa() {
+    pthread_once(&fs_ws_dsp_convert_once, fs_ws_dsp_convert_detect);
+    return fs_ws_dsp_convert_kernels->isa;
+}
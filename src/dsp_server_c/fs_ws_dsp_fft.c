@@ -0,0 +1,81 @@
+/**
+ * @file fs_ws_dsp_fft.c
+ * @brief Process wide cache of FFT plans.
+ */
+
+struct fs_ws_dsp_fft_key {
+    uint32_t n;
+    int32_t direction;
+    int32_t flags;
+};
+
+static void fs_ws_dsp_fft_plan_destroy(void *value) {
+    struct fs_ws_dsp_fft_plan *plan = (struct fs_ws_dsp_fft_plan *)value;
+    if (plan->plan)
+        fft_destroy_plan(plan->plan);
+    free(plan->x);
+    free(plan->y);
+    free(plan);
+}
+
+static struct fs_ws_dsp_cache fs_ws_dsp_fft_cache = FS_WS_DSP_CACHE_INITIALIZER(
+    FS_WS_DSP_FFT_CACHE_PLANS, FS_WS_DSP_FFT_CACHE_BYTES, fs_ws_dsp_fft_plan_destroy);
+
+static struct fs_ws_dsp_fft_key fs_ws_dsp_fft_key(unsigned int n, int direction, int flags) {
+    struct fs_ws_dsp_fft_key key;
+    memset(&key, 0, sizeof(struct fs_ws_dsp_fft_key));
+    key.n         = n;
+    key.direction = direction;
+    key.flags     = flags;
+    return key;
+}
+
+struct fs_ws_dsp_fft_plan *fs_ws_dsp_fft_plan_acquire(unsigned int n, int direction, int flags) {
+    struct fs_ws_dsp_fft_key key = fs_ws_dsp_fft_key(n, direction, flags);
+    struct fs_ws_dsp_fft_plan *plan = fs_ws_dsp_cache_take(&fs_ws_dsp_fft_cache, &key, sizeof key);
+    if (plan)
+        return plan;
+
+    plan = malloc(sizeof(struct fs_ws_dsp_fft_plan));
+    if (!plan)
+        return NULL;
+    memset(plan, 0, sizeof(struct fs_ws_dsp_fft_plan));
+    plan->n         = n;
+    plan->direction = direction;
+    plan->flags     = flags;
+    plan->x = (float complex *) malloc(n * sizeof(float complex));
+    plan->y = (float complex *) malloc(n * sizeof(float complex));
+    if (!plan->x || !plan->y) {
+        fs_ws_dsp_fft_plan_destroy(plan);
+        return NULL;
+    }
+    plan->plan = fft_create_plan(n, plan->x, plan->y, direction, flags);
+    return plan;
+}
+
+void fs_ws_dsp_fft_plan_release(struct fs_ws_dsp_fft_plan *plan) {
+    struct fs_ws_dsp_fft_key key = fs_ws_dsp_fft_key(plan->n, plan->direction, plan->flags);
+    fs_ws_dsp_cache_put(&fs_ws_dsp_fft_cache, &key, sizeof key, plan, 2 * plan->n * sizeof(float complex));
+}
+
+void fs_ws_dsp_fft_warm(const unsigned int *sizes, unsigned int count) {
+    unsigned int i;
+    struct fs_ws_dsp_fft_plan *plan;
+    for (i = 0; i < count; i++) {
+        plan = fs_ws_dsp_fft_plan_acquire(sizes[i], LIQUID_FFT_FORWARD, 0);
+        if (plan)
+            fs_ws_dsp_fft_plan_release(plan);
+    }
+}
+
+void fs_ws_dsp_fft_cache_bound(unsigned int plans, size_t max_bytes) {
+    fs_ws_dsp_cache_bound(&fs_ws_dsp_fft_cache, plans, max_bytes);
+}
+
+void fs_ws_dsp_fft_cache_stats(struct fs_ws_dsp_cache_stats *stats) {
+    fs_ws_dsp_cache_stats(&fs_ws_dsp_fft_cache, stats);
+}
+
+void fs_ws_dsp_fft_cache_clear() {
+    fs_ws_dsp_cache_clear(&fs_ws_dsp_fft_cache);
+}
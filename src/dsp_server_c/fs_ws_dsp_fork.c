@@ -0,0 +1,132 @@
+/**
+ * @file fs_ws_dsp_fork.c
+ * @brief Fork-join helper threads that split one large processing stage across cores.
+ */
+
+/**
+ * @brief Fork in progress. Lives on the stack of the forking thread.
+ */
+struct fs_ws_dsp_fork_task {
+    struct fs_ws_dsp_fork_task *next; ///< Next task helpers may join.
+    fs_ws_dsp_fork_fn fn;             ///< Body.
+    void *arg;                        ///< Passed to fn.
+    unsigned int count;               ///< Number of indices.
+    unsigned int grain;               ///< Indices per range.
+    _Atomic unsigned int claimed;     ///< Next index to hand out.
+    unsigned int joined;              ///< Helpers working on the task. Guarded by the fork lock.
+    uint8_t listed;                   ///< Task can still be joined. Guarded by the fork lock.
+};
+
+static pthread_mutex_t fs_ws_dsp_fork_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fs_ws_dsp_fork_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t fs_ws_dsp_fork_left = PTHREAD_COND_INITIALIZER;
+static struct fs_ws_dsp_fork_task *fs_ws_dsp_fork_head;
+static pthread_t fs_ws_dsp_fork_threads[FS_WS_DSP_FORK_THREADS_MAX];
+static unsigned int fs_ws_dsp_fork_threads_count;
+static uint8_t fs_ws_dsp_fork_stopping;
+
+/* Run ranges until none are left. */
+static void fs_ws_dsp_fork_work(struct fs_ws_dsp_fork_task *task) {
+    unsigned int begin;
+    for (;;) {
+        begin = atomic_fetch_add_explicit(&task->claimed, task->grain, memory_order_relaxed);
+        if (begin >= task->count)
+            break;
+        task->fn(task->arg, begin, task->count - begin > task->grain ? begin + task->grain : task->count);
+    }
+}
+
+/* Stop new helpers joining a task. Called with the fork lock held. */
+static void fs_ws_dsp_fork_unlist(struct fs_ws_dsp_fork_task *task) {
+    struct fs_ws_dsp_fork_task **link = &fs_ws_dsp_fork_head;
+    if (!task->listed)
+        return;
+    while (*link != task)
+        link = &(*link)->next;
+    *link = task->next;
+    task->listed = 0;
+}
+
+static void *fs_ws_dsp_fork_helper(void *arg) {
+    struct fs_ws_dsp_fork_task *task;
+    (void)arg;
+    pthread_mutex_lock(&fs_ws_dsp_fork_lock);
+    for (;;) {
+        while (!fs_ws_dsp_fork_head && !fs_ws_dsp_fork_stopping)
+            pthread_cond_wait(&fs_ws_dsp_fork_wake, &fs_ws_dsp_fork_lock);
+        task = fs_ws_dsp_fork_head;
+        if (!task)
+            break;
+        task->joined++;
+        pthread_mutex_unlock(&fs_ws_dsp_fork_lock);
+
+        fs_ws_dsp_fork_work(task);
+
+        pthread_mutex_lock(&fs_ws_dsp_fork_lock);
+        // Every range is handed out, so nobody else needs to join.
+        fs_ws_dsp_fork_unlist(task);
+        if (--task->joined == 0)
+            pthread_cond_broadcast(&fs_ws_dsp_fork_left);
+    }
+    pthread_mutex_unlock(&fs_ws_dsp_fork_lock);
+    return NULL;
+}
+
+int fs_ws_dsp_fork_start(unsigned int threads) {
+    if (threads > FS_WS_DSP_FORK_THREADS_MAX)
+        threads = FS_WS_DSP_FORK_THREADS_MAX;
+    fs_ws_dsp_fork_stopping = 0;
+    while (fs_ws_dsp_fork_threads_count < threads) {
+        if (pthread_create(&fs_ws_dsp_fork_threads[fs_ws_dsp_fork_threads_count], NULL, fs_ws_dsp_fork_helper, NULL)) {
+            fs_ws_dsp_fork_stop();
+            return -1;
+        }
+        fs_ws_dsp_fork_threads_count++;
+    }
+    return 0;
+}
+
+void fs_ws_dsp_fork_run(unsigned int count, unsigned int grain, fs_ws_dsp_fork_fn fn, void *arg) {
+    struct fs_ws_dsp_fork_task task;
+
+    if (grain == 0)
+        grain = 1;
+    if (count <= grain || fs_ws_dsp_fork_threads_count == 0) {
+        if (count > 0)
+            fn(arg, 0, count);
+        return;
+    }
+    memset(&task, 0, sizeof(struct fs_ws_dsp_fork_task));
+    task.fn     = fn;
+    task.arg    = arg;
+    task.count  = count;
+    task.grain  = grain;
+    task.listed = 1;
+    atomic_init(&task.claimed, 0);
+
+    pthread_mutex_lock(&fs_ws_dsp_fork_lock);
+    task.next = fs_ws_dsp_fork_head;
+    fs_ws_dsp_fork_head = &task;
+    pthread_cond_broadcast(&fs_ws_dsp_fork_wake);
+    pthread_mutex_unlock(&fs_ws_dsp_fork_lock);
+
+    fs_ws_dsp_fork_work(&task);
+
+    // The task lives on this stack, so wait for every helper that joined to finish its range.
+    pthread_mutex_lock(&fs_ws_dsp_fork_lock);
+    fs_ws_dsp_fork_unlist(&task);
+    while (task.joined > 0)
+        pthread_cond_wait(&fs_ws_dsp_fork_left, &fs_ws_dsp_fork_lock);
+    pthread_mutex_unlock(&fs_ws_dsp_fork_lock);
+}
+
+void fs_ws_dsp_fork_stop() {
+    unsigned int i;
+    pthread_mutex_lock(&fs_ws_dsp_fork_lock);
+    fs_ws_dsp_fork_stopping = 1;
+    pthread_cond_broadcast(&fs_ws_dsp_fork_wake);
+    pthread_mutex_unlock(&fs_ws_dsp_fork_lock);
+    for (i = 0; i < fs_ws_dsp_fork_threads_count; i++)
+        pthread_join(fs_ws_dsp_fork_threads[i], NULL);
+    fs_ws_dsp_fork_threads_count = 0;
+}
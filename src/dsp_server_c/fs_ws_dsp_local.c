@@ -0,0 +1,328 @@
+/**
+ * @file fs_ws_dsp_local.c
+ * @brief Shared memory transport for clients on the server host.
+ */
+
+// Kernel values, in case the C library only declares them for _GNU_SOURCE.
+#ifndef F_GET_SEALS
+#define F_GET_SEALS   (1024 + 10)
+#define F_SEAL_SHRINK 0x0002
+#endif
+
+/**
+ * @brief Connected local client.
+ */
+struct fs_ws_dsp_local_client {
+    struct fs_ws_dsp_local_client *next; ///< Next connected client. Guarded by the local lock.
+    int fd;                              ///< Connection.
+    char *shm;                           ///< Attached shared memory, NULL until attached.
+    size_t shm_len;                      ///< Byte length of shm.
+    struct fs_ws_dsp_stream *streams;    ///< Streams opened by the client.
+    struct fs_ws_dsp_arena arena;        ///< Scratch buffers of the client thread.
+};
+
+static pthread_mutex_t fs_ws_dsp_local_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fs_ws_dsp_local_left = PTHREAD_COND_INITIALIZER;
+static struct fs_ws_dsp_local_client *fs_ws_dsp_local_clients;
+static unsigned int fs_ws_dsp_local_clients_count;
+static pthread_t fs_ws_dsp_local_thread;
+static int fs_ws_dsp_local_fd = -1;
+static uint8_t fs_ws_dsp_local_stopping;
+
+/* Receive one frame, and the descriptor passed along with it, if any. */
+static int fs_ws_dsp_local_recv(int fd, struct fs_ws_dsp_local_frame *frame, int *passed) {
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { frame, sizeof(struct fs_ws_dsp_local_frame) };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof control;
+    *passed = -1;
+    do
+        n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    while (n < 0 && errno == EINTR);
+    for (cmsg = CMSG_FIRSTHDR(&msg); n >= 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+            memcpy(passed, CMSG_DATA(cmsg), sizeof(int));
+    if (n != sizeof(struct fs_ws_dsp_local_frame)) {
+        if (*passed >= 0)
+            close(*passed);
+        return -1;
+    }
+    return 0;
+}
+
+static int fs_ws_dsp_local_send(int fd, struct fs_ws_dsp_local_frame *frame) {
+    return send(fd, frame, sizeof(struct fs_ws_dsp_local_frame), MSG_NOSIGNAL) == sizeof(struct fs_ws_dsp_local_frame) ? 0 : -1;
+}
+
+/* Map the memory the client shares. It must be sealed against shrinking, or the client could cut it
+ * short under the server and fault it. Growing is harmless, the mapping keeps its size. Writes cannot
+ * be sealed, as responses go into the same memory, so the client may change a message while it is
+ * processed: every field is read into private memory once before it is checked or used, and shared
+ * data is never cached. */
+static int fs_ws_dsp_local_attach(struct fs_ws_dsp_local_client *client, int fd) {
+    struct stat st;
+    int seals;
+    void *shm;
+
+    seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(fd, &st) || st.st_size <= 0)
+        return -1;
+    shm = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED)
+        return -1;
+    if (client->shm)
+        munmap(client->shm, client->shm_len);
+    client->shm     = shm;
+    client->shm_len = (size_t)st.st_size;
+    return 0;
+}
+
+static int fs_ws_dsp_local_within(struct fs_ws_dsp_local_client *client, uint64_t offset, uint64_t len) {
+    return client->shm && offset <= client->shm_len && len <= client->shm_len - offset;
+}
+
+static struct fs_ws_dsp_stream **fs_ws_dsp_local_stream(struct fs_ws_dsp_local_client *client, uint32_t handle) {
+    struct fs_ws_dsp_stream **slot;
+    for (slot = &client->streams; *slot; slot = &(*slot)->next)
+        if ((*slot)->handle == handle)
+            break;
+    return slot;
+}
+
+/* Process one request and write its response where the client asked. */
+static void fs_ws_dsp_local_request(struct fs_ws_dsp_local_client *client, struct fs_ws_dsp_local_frame *frame,
+                                    struct fs_ws_dsp_local_frame *reply) {
+    struct fs_ws_dsp_message request, response;
+    struct fs_ws_dsp_stream *stream, **slot;
+    char *message, *owned = NULL;
+    uint32_t id, handle;
+    uint8_t version;
+    int malformed;
+    size_t size;
+
+    if (!fs_ws_dsp_local_within(client, frame->offset, frame->len) ||
+        !fs_ws_dsp_local_within(client, frame->out_offset, frame->out_size))
+        return;
+    message = client->shm + frame->offset;
+    if (fs_ws_dsp_message_peek(message, frame->len, &version, &id, &handle))
+        return;
+    reply->id = id;
+    // Subscribers receive results they did not ask for, which a reply per request cannot carry. Requests
+    // run one at a time as they arrive, so there is nothing to cancel, and scheduling them changes nothing.
+    if (version == FS_WS_DSP_MSG_PUBLISH || version == FS_WS_DSP_MSG_SUBSCRIBE || version == FS_WS_DSP_MSG_UNSUBSCRIBE ||
+        version == FS_WS_DSP_MSG_CANCEL)
+        return;
+    // A stream takes its open message over and frees it, so it cannot stay in memory the client owns.
+    if (version == FS_WS_DSP_MSG_STREAM_OPEN) {
+        owned = malloc(frame->len);
+        if (!owned)
+            return;
+        memcpy(owned, message, frame->len);
+        message = owned;
+    }
+    // The version peeked may have been changed since, so only the parsed one counts.
+    malformed = fs_ws_dsp_message_parse(&request, message, frame->len) || request._version != version;
+    if (malformed || (version == FS_WS_DSP_MSG_CAPTURE && fs_ws_dsp_capture_map(&request))) {
+        fs_ws_dsp_metrics_count(malformed ? FS_WS_DSP_METRIC_DROP_MALFORMED : FS_WS_DSP_METRIC_DROP_UNAVAILABLE, 1);
+        if (owned)
+            fs_ws_dsp_message_free(request);
+        else
+            fs_ws_dsp_message_free_view(request);
+        return;
+    }
+
+    request.shared = !owned;
+    slot = fs_ws_dsp_local_stream(client, version == FS_WS_DSP_MSG_STREAM_OPEN ? request.id : request.stream);
+    if (version == FS_WS_DSP_MSG_STREAM_OPEN) {
+        stream = *slot ? NULL : calloc(1, sizeof(struct fs_ws_dsp_stream));
+        if (!stream) {
+            fs_ws_dsp_message_free(request);
+            return;
+        }
+        stream->handle = request.id;
+        *slot = stream;
+        response = fs_ws_dsp_stream_open(stream, request, &client->arena);
+    } else if (version == FS_WS_DSP_MSG_STREAM_DATA || version == FS_WS_DSP_MSG_STREAM_CLOSE) {
+        if (!*slot) {
+            fs_ws_dsp_message_free_view(request);
+            return;
+        }
+        memset(&response, 0, sizeof(struct fs_ws_dsp_message));
+        response._version = FS_WS_DSP_MSG_REQUEST;
+        response.id       = id;
+        if (version == FS_WS_DSP_MSG_STREAM_DATA) {
+            response = fs_ws_dsp_stream_process(*slot, request, &client->arena);
+        } else {
+            stream = *slot;
+            *slot  = stream->next;
+            fs_ws_dsp_stream_close(stream);
+            free(stream);
+        }
+        fs_ws_dsp_message_free_view(request);
+    } else {
+        if (version == FS_WS_DSP_MSG_BATCH)
+            response = fs_ws_dsp_process_batch(request, &client->arena);
+        else
+            response = fs_ws_dsp_process_cached(request, &client->arena);
+        fs_ws_dsp_message_free_view(request);
+    }
+
+    // A command failed: the error reply stands.
+    if (response.failed) {
+        fs_ws_dsp_message_free(response);
+        return;
+    }
+    // The request is consumed, so the response may go over it.
+    size = fs_ws_dsp_message_serialize_size(response);
+    if (size > frame->out_size) {
+        reply->out_size = size;
+    } else {
+        fs_ws_dsp_message_serialize_into(response, client->shm + frame->out_offset);
+        reply->op     = FS_WS_DSP_LOCAL_RESPONSE;
+        reply->offset = frame->out_offset;
+        reply->len    = size;
+    }
+    fs_ws_dsp_message_free(response);
+    fs_ws_dsp_arena_trim(&client->arena);
+}
+
+static void *fs_ws_dsp_local_serve(void *arg) {
+    struct fs_ws_dsp_local_client *client = arg, **slot;
+    struct fs_ws_dsp_local_frame frame, reply;
+    struct fs_ws_dsp_stream *stream;
+    int passed;
+
+    while (!fs_ws_dsp_local_recv(client->fd, &frame, &passed)) {
+        memset(&reply, 0, sizeof reply);
+        reply.op = FS_WS_DSP_LOCAL_ERROR;
+        reply.id = frame.id;
+        if (frame.op == FS_WS_DSP_LOCAL_ATTACH && passed >= 0 && !fs_ws_dsp_local_attach(client, passed)) {
+            reply.op  = FS_WS_DSP_LOCAL_ATTACH;
+            reply.len = client->shm_len;
+        } else if (frame.op == FS_WS_DSP_LOCAL_REQUEST) {
+            fs_ws_dsp_local_request(client, &frame, &reply);
+        }
+        // The mapping keeps the memory, the descriptor is not needed.
+        if (passed >= 0)
+            close(passed);
+        if (fs_ws_dsp_local_send(client->fd, &reply))
+            break;
+    }
+
+    while ((stream = client->streams)) {
+        client->streams = stream->next;
+        fs_ws_dsp_stream_close(stream);
+        free(stream);
+    }
+    if (client->shm)
+        munmap(client->shm, client->shm_len);
+    fs_ws_dsp_arena_free(&client->arena);
+    pthread_mutex_lock(&fs_ws_dsp_local_lock);
+    for (slot = &fs_ws_dsp_local_clients; *slot != client; slot = &(*slot)->next);
+    *slot = client->next;
+    fs_ws_dsp_local_clients_count--;
+    pthread_cond_broadcast(&fs_ws_dsp_local_left);
+    pthread_mutex_unlock(&fs_ws_dsp_local_lock);
+    close(client->fd);
+    free(client);
+    return NULL;
+}
+
+static void *fs_ws_dsp_local_accept(void *arg) {
+    struct fs_ws_dsp_local_client *client;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int fd;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    // Fails once fs_ws_dsp_local_stop shuts the socket down.
+    while ((fd = accept(fs_ws_dsp_local_fd, NULL, NULL)) >= 0 || errno == EINTR || errno == ECONNABORTED) {
+        if (fd < 0)
+            continue;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        client = calloc(1, sizeof(struct fs_ws_dsp_local_client));
+        pthread_mutex_lock(&fs_ws_dsp_local_lock);
+        if (!client || fs_ws_dsp_local_stopping || fs_ws_dsp_local_clients_count >= FS_WS_DSP_LOCAL_CLIENTS_MAX) {
+            pthread_mutex_unlock(&fs_ws_dsp_local_lock);
+            free(client);
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        fs_ws_dsp_arena_init(&client->arena, 0);
+        client->next = fs_ws_dsp_local_clients;
+        fs_ws_dsp_local_clients = client;
+        fs_ws_dsp_local_clients_count++;
+        if (pthread_create(&thread, &attr, fs_ws_dsp_local_serve, client)) {
+            fs_ws_dsp_local_clients = client->next;
+            fs_ws_dsp_local_clients_count--;
+            close(fd);
+            free(client);
+        }
+        pthread_mutex_unlock(&fs_ws_dsp_local_lock);
+    }
+    pthread_attr_destroy(&attr);
+    return NULL;
+}
+
+int fs_ws_dsp_local_start(const char *path) {
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    if (fs_ws_dsp_local_fd >= 0 || strlen(path) >= sizeof addr.sun_path)
+        return -1;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    // A socket left behind by an earlier run, but nothing else, is replaced.
+    if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+        unlink(path);
+    fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0)
+        return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    // Connecting takes write permission on the socket, so only the server's user may connect.
+    if (bind(fd, (struct sockaddr *)&addr, sizeof addr) || chmod(path, S_IRUSR | S_IWUSR) || listen(fd, 16)) {
+        close(fd);
+        return -1;
+    }
+    fs_ws_dsp_local_fd = fd;
+    fs_ws_dsp_local_stopping = 0;
+    if (pthread_create(&fs_ws_dsp_local_thread, NULL, fs_ws_dsp_local_accept, NULL)) {
+        close(fd);
+        fs_ws_dsp_local_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void fs_ws_dsp_local_stop() {
+    struct fs_ws_dsp_local_client *client;
+
+    if (fs_ws_dsp_local_fd < 0)
+        return;
+    pthread_mutex_lock(&fs_ws_dsp_local_lock);
+    fs_ws_dsp_local_stopping = 1;
+    pthread_mutex_unlock(&fs_ws_dsp_local_lock);
+    shutdown(fs_ws_dsp_local_fd, SHUT_RDWR);
+    pthread_join(fs_ws_dsp_local_thread, NULL);
+    close(fs_ws_dsp_local_fd);
+    fs_ws_dsp_local_fd = -1;
+
+    // Client threads leave once their connection is shut down.
+    pthread_mutex_lock(&fs_ws_dsp_local_lock);
+    for (client = fs_ws_dsp_local_clients; client; client = client->next)
+        shutdown(client->fd, SHUT_RDWR);
+    while (fs_ws_dsp_local_clients_count > 0)
+        pthread_cond_wait(&fs_ws_dsp_local_left, &fs_ws_dsp_local_lock);
+    pthread_mutex_unlock(&fs_ws_dsp_local_lock);
+}
@@ -3,36 +3,187 @@
  * @brief Websocket server subprotocol for digital signal processing messages
  */
 
-struct fs_ws_dsp_message fs_ws_dsp_message_parse(char *data, size_t data_len) {
-    struct fs_ws_dsp_message message;
-    memset(&message, 0, sizeof(struct fs_ws_dsp_message));
-    char *src = data;
+/* Read a little endian uint32 at any alignment, advancing src. */
+static int fs_ws_dsp_message_read_u32(char **src, char *end, uint32_t *value) {
+    if (end - *src < 4)
+        return -1;
+    memcpy(value, *src, 4);
+    *src += 4;
+    return 0;
+}
+/* Read a little endian uint64 at any alignment, advancing src. */
+static int fs_ws_dsp_message_read_u64(char **src, char *end, uint64_t *value) {
+    if (end - *src < 8)
+        return -1;
+    memcpy(value, *src, 8);
+    *src += 8;
+    return 0;
+}
+int fs_ws_dsp_message_parse(struct fs_ws_dsp_message *message, char *buffer, size_t buffer_len) {
+    char *src = buffer;
+    char *end = buffer + buffer_len;
+    struct fs_ws_dsp_command *commands;
+    int used;
 
-// fs_ws_dsp_debug(data, 64);
+    memset(message, 0, sizeof(struct fs_ws_dsp_message));
+    message->buffer = buffer;
+
+// fs_ws_dsp_debug(buffer, 64);
+
+    if (buffer_len < 1)
+        return -1;
+    message->_version = *((uint8_t *)src);          src += 1;
+    // A scheduled message is its envelope followed by the message it wraps.
+    if (message->_version == FS_WS_DSP_MSG_SCHEDULED) {
+        if (fs_ws_dsp_message_read_u32(&src, end, &message->priority) ||
+            fs_ws_dsp_message_read_u32(&src, end, &message->deadline) || src == end)
+            return -1;
+        message->_version = *((uint8_t *)src);      src += 1;
+        if (message->_version != FS_WS_DSP_MSG_REQUEST && message->_version != FS_WS_DSP_MSG_CAPTURE &&
+            message->_version != FS_WS_DSP_MSG_BATCH)
+            return -1;
+    }
+    if (fs_ws_dsp_message_read_u32(&src, end, &message->id))
+        return -1;
+    if (message->_version == FS_WS_DSP_MSG_STREAM_DATA || message->_version == FS_WS_DSP_MSG_STREAM_CLOSE ||
+        message->_version == FS_WS_DSP_MSG_UNSUBSCRIBE || message->_version == FS_WS_DSP_MSG_CANCEL) {
+        if (fs_ws_dsp_message_read_u32(&src, end, &message->stream))
+            return -1;
+        if (message->_version != FS_WS_DSP_MSG_STREAM_DATA)
+            return 0;
+    } else if (message->_version != FS_WS_DSP_MSG_BATCH && message->_version != FS_WS_DSP_MSG_SUBSCRIBE &&
+               fs_ws_dsp_message_read_u32(&src, end, &message->commands_count)) {
+        return -1;
+    }
+    if (message->commands_count > 0) {
+        // Every command takes at least 8 bytes, which bounds the allocation by the buffer size.
+        if (message->commands_count > (size_t)(end - src) / 8) {
+            message->commands_count = 0;
+            return -1;
+        }
+        // Pointer array and commands share one allocation.
+        message->commands = malloc(message->commands_count * (sizeof(struct fs_ws_dsp_command *) + sizeof(struct fs_ws_dsp_command)));
+        if (!message->commands) {
+            message->commands_count = 0;
+            return -1;
+        }
+        commands = (struct fs_ws_dsp_command *)(message->commands + message->commands_count);
+        memset(commands, 0, message->commands_count * sizeof(struct fs_ws_dsp_command));
+        for (uint32_t i = 0; i < message->commands_count; i++)
+            message->commands[i] = &commands[i];
+        for (uint32_t i = 0; i < message->commands_count; i++) {
+            used = fs_ws_dsp_command_parse(&commands[i], src, end - src);
+            if (used < 0)
+                return -1;
+            src += used;
+        }
+    }
+    if (fs_ws_dsp_message_read_u32(&src, end, &message->data_len))
+        return -1;
+    // A capture request names its data: data_len is the name length here, the data length follows.
+    if (message->_version == FS_WS_DSP_MSG_CAPTURE) {
+        if (message->data_len > (size_t)(end - src)) {
+            message->data_len = 0;
+            return -1;
+        }
+        message->capture     = src;
+        message->capture_len = message->data_len;
+        message->data_len    = 0;
+        src += message->capture_len;
+        if (fs_ws_dsp_message_read_u64(&src, end, &message->capture_offset) ||
+            fs_ws_dsp_message_read_u32(&src, end, &message->data_len))
+            return -1;
+        return 0;
+    }
+    // Publish and subscribe messages name a topic the same way, data follows for publish only.
+    if (message->_version == FS_WS_DSP_MSG_PUBLISH || message->_version == FS_WS_DSP_MSG_SUBSCRIBE) {
+        if (message->data_len > (size_t)(end - src)) {
+            message->data_len = 0;
+            return -1;
+        }
+        message->topic     = src;
+        message->topic_len = message->data_len;
+        message->data_len  = 0;
+        src += message->topic_len;
+        if (message->_version == FS_WS_DSP_MSG_SUBSCRIBE)
+            return 0;
+        if (fs_ws_dsp_message_read_u32(&src, end, &message->data_len))
+            return -1;
+    }
+    if (message->data_len > (size_t)(end - src)) {
+        message->data_len = 0;
+        return -1;
+    }
+    // Data is a view into the buffer.
+    message->data = message->data_len > 0 ? src : NULL;
+    return 0;
+}
+int fs_ws_dsp_message_head_size(char *buffer, size_t buffer_len, uint32_t *data_len) {
+    struct fs_ws_dsp_command command;
+    char *src = buffer;
+    char *end = buffer + buffer_len;
+    uint32_t commands_count;
+    int used;
 
-    message._version       = *((uint8_t *)src);     src += 1;
-    message.id             = *((uint32_t *)src);    src += 4;
-    message.commands_count = *((uint32_t *)src);    src += 4;
-    if (message.commands_count > 0) {
-        message.commands = malloc(sizeof(struct fs_ws_dsp_command *) *message.commands_count);
-        struct fs_ws_dsp_command **dst = message.commands;
-        for (int i = 0; i < message.commands_count; i++) {
-            struct fs_ws_dsp_command *command = fs_ws_dsp_command_parse(src);
-            *dst++ = command;
-            src += fs_ws_dsp_command_serialize_size(command);
+    if (buffer_len < 1)
+        return 0;
+    if (*((uint8_t *)src) != FS_WS_DSP_MSG_REQUEST && *((uint8_t *)src) != FS_WS_DSP_MSG_STREAM_OPEN)
+        return -1;
+    if (buffer_len < 9)
+        return 0;
+    src += 5;
+    fs_ws_dsp_message_read_u32(&src, end, &commands_count);
+    for (uint32_t i = 0; i < commands_count; i++) {
+        used = fs_ws_dsp_command_parse(&command, src, end - src);
+        if (used < 0) {
+            // Incomplete unless the command claims more than a message may hold.
+            if (end - src >= 8 && command.params_len > INT32_MAX - 8)
+                return -1;
+            return 0;
         }
+        src += used;
     }
-    message.data_len = *((uint32_t *)src);          src += 4;
-    if (message.data_len > 0) {
-        message.data = malloc(message.data_len);
-        memcpy(message.data, src, message.data_len);
+    if (fs_ws_dsp_message_read_u32(&src, end, data_len))
+        return 0;
+    return src - buffer > INT32_MAX ? -1 : (int)(src - buffer);
+}
+int fs_ws_dsp_message_peek(char *data, size_t data_len, uint8_t *version, uint32_t *id, uint32_t *stream) {
+    if (data_len >= 1 && (uint8_t)data[0] == FS_WS_DSP_MSG_SCHEDULED) {
+        if (data_len < FS_WS_DSP_MSG_SCHEDULE_SIZE)
+            return -1;
+        data     += FS_WS_DSP_MSG_SCHEDULE_SIZE;
+        data_len -= FS_WS_DSP_MSG_SCHEDULE_SIZE;
     }
-    return message;
+    if (data_len < 9)
+        return -1;
+    *version = (uint8_t)data[0];
+    memcpy(id, data + 1, 4);
+    *stream = 0;
+    if (*version == FS_WS_DSP_MSG_STREAM_DATA || *version == FS_WS_DSP_MSG_STREAM_CLOSE ||
+        *version == FS_WS_DSP_MSG_UNSUBSCRIBE || *version == FS_WS_DSP_MSG_CANCEL)
+        memcpy(stream, data + 5, 4);
+    return 0;
+}
+int fs_ws_dsp_message_peek_schedule(char *data, size_t data_len, uint32_t *priority, uint32_t *deadline) {
+    if (data_len < 1)
+        return -1;
+    if ((uint8_t)data[0] != FS_WS_DSP_MSG_SCHEDULED)
+        return 0;
+    if (data_len < FS_WS_DSP_MSG_SCHEDULE_SIZE)
+        return -1;
+    memcpy(priority, data + 1, 4);
+    memcpy(deadline, data + 5, 4);
+    return 1;
 }
 void fs_ws_dsp_message_free(struct fs_ws_dsp_message message) {
-	if (message.data != NULL)
+    // Parsed messages point into their buffer or a capture mapping. Built messages own their data unless it is borrowed.
+	if (message.map != NULL)
+		munmap(message.map, message.map_len);
+	if (message.buffer != NULL)
+		free(message.buffer);
+	else if (message.data != NULL && !fs_ws_dsp_arena_owns(message.arena, message.data))
 		free(message.data);
-    if (message.commands_count > 0) {
+    if (message.commands != NULL) {
         struct fs_ws_dsp_command **command = message.commands;
         for (int i = 0; i < message.commands_count; i++)
             fs_ws_dsp_command_free(*(command++));
@@ -41,20 +192,31 @@ void fs_ws_dsp_message_free(struct fs_ws_dsp_message message) {
     memset(&message, 0, sizeof(struct fs_ws_dsp_message));
     return;
 }
+void fs_ws_dsp_message_free_view(struct fs_ws_dsp_message message) {
+    message.buffer = NULL;
+    message.data   = NULL;
+    fs_ws_dsp_message_free(message);
+}
 char *fs_ws_dsp_message_serialize(struct fs_ws_dsp_message message) {
     char *stream;
-    char *dest;
     stream = malloc(fs_ws_dsp_message_serialize_size(message));
-    dest = stream;
+    if (stream)
+        fs_ws_dsp_message_serialize_into(message, stream);
+    return stream;
+}
+char *fs_ws_dsp_message_serialize_into(struct fs_ws_dsp_message message, char *stream) {
+    fs_ws_dsp_message_serialize_head(message, stream);
+    if (message.data_len > 0)
+        memcpy(stream + FS_WS_DSP_MSG_HEAD_SIZE, message.data, message.data_len);
+    return stream;
+}
+char *fs_ws_dsp_message_serialize_head(struct fs_ws_dsp_message message, char *stream) {
+    char *dest = stream;
     memcpy(dest,                            &message._version, sizeof message._version);
     memcpy(dest += sizeof message._version, &message.id,       sizeof message.id);
     memcpy(dest += sizeof message.id,       &message.data_len, sizeof message.data_len);
-    memcpy(dest += sizeof message.data_len, message.data,      message.data_len);
     return stream;
 }
 size_t fs_ws_dsp_message_serialize_size(struct fs_ws_dsp_message message) {
-    return sizeof message._version +
-           sizeof message.id + 
-           sizeof message.data_len +
-           message.data_len;
+    return FS_WS_DSP_MSG_HEAD_SIZE + message.data_len;
 }
@@ -0,0 +1,283 @@
+/**
+ * @file fs_ws_dsp_metrics.c
+ * @brief Counters and latency histograms, rendered in the Prometheus text format.
+ */
+
+static pthread_mutex_t fs_ws_dsp_metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t fs_ws_dsp_metrics_once = PTHREAD_ONCE_INIT;
+static pthread_key_t fs_ws_dsp_metrics_key;
+static struct fs_ws_dsp_metrics_shard *fs_ws_dsp_metrics_shards = NULL;
+static struct fs_ws_dsp_metrics_shard fs_ws_dsp_metrics_retired; ///< Sums of threads that exited. Guarded by the metrics lock.
+static _Thread_local struct fs_ws_dsp_metrics_shard *fs_ws_dsp_metrics_mine = NULL;
+
+static const char *fs_ws_dsp_metrics_drops[] = {
+    "malformed", "unavailable", "oom", "rx_too_large", "tx_queue_full", "bad_handle", "subscriber_behind", "cancelled",
+    "failed"
+};
+static const char *fs_ws_dsp_metrics_commands[FS_WS_DSP_METRICS_COMMANDS] = {
+    "fused", "echo", "fft", "firfilt", "fastfilt", "convert", "stft", "decim", "interp", "resamp", "ddc", "channelize"
+};
+static const char *fs_ws_dsp_metrics_phases[FS_WS_DSP_METRICS_PHASES] = {
+    "parse", "queue", "execute", "serialize", "write"
+};
+static const char *fs_ws_dsp_metrics_versions[FS_WS_DSP_METRICS_VERSIONS] = {
+    NULL, "request", "stream_open", "stream_data", "stream_close", "capture", "batch", "publish", "subscribe",
+    "unsubscribe", "scheduled", "cancel"
+};
+
+/* Only the owner writes a shard, so a load and a store add without a locked instruction. */
+static void fs_ws_dsp_metrics_add(_Atomic uint64_t *value, uint64_t n) {
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/* Add every value of src to dst. Both must be locked, or owned by the caller. */
+static void fs_ws_dsp_metrics_fold(struct fs_ws_dsp_metrics_shard *dst, struct fs_ws_dsp_metrics_shard *src) {
+    struct fs_ws_dsp_histogram *to = dst->commands, *from = src->commands;
+    size_t i, b, count = FS_WS_DSP_METRICS_COMMANDS + FS_WS_DSP_METRICS_PHASES * FS_WS_DSP_METRICS_VERSIONS;
+
+    for (i = 0; i < FS_WS_DSP_METRICS_COUNTERS; i++)
+        fs_ws_dsp_metrics_add(&dst->counters[i], atomic_load_explicit(&src->counters[i], memory_order_relaxed));
+    // Command and phase histograms lie back to back.
+    for (i = 0; i < count; i++) {
+        for (b = 0; b < FS_WS_DSP_METRICS_BUCKETS; b++)
+            fs_ws_dsp_metrics_add(&to[i].buckets[b], atomic_load_explicit(&from[i].buckets[b], memory_order_relaxed));
+        fs_ws_dsp_metrics_add(&to[i].sum, atomic_load_explicit(&from[i].sum, memory_order_relaxed));
+    }
+}
+
+/* Thread exit. Keep what the thread recorded and give back its shard. */
+static void fs_ws_dsp_metrics_exit(void *arg) {
+    struct fs_ws_dsp_metrics_shard *shard = arg, **slot;
+
+    pthread_mutex_lock(&fs_ws_dsp_metrics_lock);
+    for (slot = &fs_ws_dsp_metrics_shards; *slot != shard; slot = &(*slot)->next)
+        ;
+    *slot = shard->next;
+    fs_ws_dsp_metrics_fold(&fs_ws_dsp_metrics_retired, shard);
+    pthread_mutex_unlock(&fs_ws_dsp_metrics_lock);
+    free(shard);
+}
+
+static void fs_ws_dsp_metrics_init() {
+    pthread_key_create(&fs_ws_dsp_metrics_key, fs_ws_dsp_metrics_exit);
+}
+
+/* Shard of the calling thread, NULL if memory ran out. */
+static struct fs_ws_dsp_metrics_shard *fs_ws_dsp_metrics_shard() {
+    struct fs_ws_dsp_metrics_shard *shard = fs_ws_dsp_metrics_mine;
+
+    if (shard)
+        return shard;
+    pthread_once(&fs_ws_dsp_metrics_once, fs_ws_dsp_metrics_init);
+    shard = calloc(1, sizeof(struct fs_ws_dsp_metrics_shard));
+    if (!shard)
+        return NULL;
+    pthread_mutex_lock(&fs_ws_dsp_metrics_lock);
+    shard->next = fs_ws_dsp_metrics_shards;
+    fs_ws_dsp_metrics_shards = shard;
+    pthread_mutex_unlock(&fs_ws_dsp_metrics_lock);
+    pthread_setspecific(fs_ws_dsp_metrics_key, shard);
+    fs_ws_dsp_metrics_mine = shard;
+    return shard;
+}
+
+/* Bucket of a latency. Below 4 us one per microsecond, then 4 per power of two. */
+static unsigned int fs_ws_dsp_metrics_bucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    unsigned int k;
+
+    if (us < 4)
+        return (unsigned int)us;
+    k = 63 - __builtin_clzll(us);
+    if (k > 25)
+        return FS_WS_DSP_METRICS_BUCKETS - 1;
+    return 4 + (k - 2) * 4 + (unsigned int)((us >> (k - 2)) & 3);
+}
+
+/* Upper bound of a bucket, in microseconds. */
+static uint64_t fs_ws_dsp_metrics_bound(unsigned int bucket) {
+    if (bucket < 4)
+        return bucket + 1;
+    return (uint64_t)(5 + (bucket - 4) % 4) << ((bucket - 4) / 4);
+}
+
+static void fs_ws_dsp_metrics_record(struct fs_ws_dsp_histogram *histogram, uint64_t ns) {
+    fs_ws_dsp_metrics_add(&histogram->buckets[fs_ws_dsp_metrics_bucket(ns)], 1);
+    fs_ws_dsp_metrics_add(&histogram->sum, ns);
+}
+
+uint64_t fs_ws_dsp_metrics_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void fs_ws_dsp_metrics_count(uint8_t counter, uint64_t n) {
+    struct fs_ws_dsp_metrics_shard *shard = fs_ws_dsp_metrics_shard();
+    if (shard && counter < FS_WS_DSP_METRICS_COUNTERS)
+        fs_ws_dsp_metrics_add(&shard->counters[counter], n);
+}
+
+void fs_ws_dsp_metrics_time_command(uint32_t type, uint64_t ns) {
+    struct fs_ws_dsp_metrics_shard *shard = fs_ws_dsp_metrics_shard();
+    if (shard && type < FS_WS_DSP_METRICS_COMMANDS)
+        fs_ws_dsp_metrics_record(&shard->commands[type], ns);
+}
+
+void fs_ws_dsp_metrics_time_phase(uint8_t phase, uint8_t version, uint64_t ns) {
+    struct fs_ws_dsp_metrics_shard *shard = fs_ws_dsp_metrics_shard();
+    if (shard && phase < FS_WS_DSP_METRICS_PHASES && version < FS_WS_DSP_METRICS_VERSIONS)
+        fs_ws_dsp_metrics_record(&shard->phases[phase][version], ns);
+}
+
+void fs_ws_dsp_metrics_text_init(struct fs_ws_dsp_metrics_text *text, size_t headroom) {
+    memset(text, 0, sizeof(struct fs_ws_dsp_metrics_text));
+    text->headroom = headroom;
+}
+
+void fs_ws_dsp_metrics_printf(struct fs_ws_dsp_metrics_text *text, const char *format, ...) {
+    size_t size;
+    va_list args;
+    char *data;
+    int n;
+
+    if (text->failed)
+        return;
+    for (;;) {
+        va_start(args, format);
+        n = text->data ? vsnprintf(text->data + text->headroom + text->len, text->size - text->len, format, args) : 0;
+        va_end(args);
+        if (n < 0) {
+            text->failed = 1;
+            return;
+        }
+        if (text->data && (size_t)n < text->size - text->len) {
+            text->len += n;
+            return;
+        }
+        size = text->size ? text->size * 2 : 16384;
+        while (size < text->len + n + 1)
+            size *= 2;
+        data = realloc(text->data, text->headroom + size);
+        if (!data) {
+            text->failed = 1;
+            return;
+        }
+        text->data = data;
+        text->size = size;
+    }
+}
+
+/* One histogram series, le in seconds. Series without samples are left out. */
+static void fs_ws_dsp_metrics_histogram(struct fs_ws_dsp_metrics_text *text, const char *name, const char *labels,
+                                        struct fs_ws_dsp_histogram *histogram) {
+    uint64_t count = 0;
+    unsigned int b;
+
+    for (b = 0; b < FS_WS_DSP_METRICS_BUCKETS; b++)
+        count += atomic_load_explicit(&histogram->buckets[b], memory_order_relaxed);
+    if (!count)
+        return;
+    count = 0;
+    for (b = 0; b < FS_WS_DSP_METRICS_BUCKETS - 1; b++) {
+        count += atomic_load_explicit(&histogram->buckets[b], memory_order_relaxed);
+        fs_ws_dsp_metrics_printf(text, "%s_bucket{%s,le=\"%.9g\"} %llu\n", name, labels,
+                                 fs_ws_dsp_metrics_bound(b) * 1e-6, (unsigned long long)count);
+    }
+    count += atomic_load_explicit(&histogram->buckets[b], memory_order_relaxed);
+    fs_ws_dsp_metrics_printf(text, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels, (unsigned long long)count);
+    fs_ws_dsp_metrics_printf(text, "%s_sum{%s} %.9g\n", name, labels,
+                             atomic_load_explicit(&histogram->sum, memory_order_relaxed) * 1e-9);
+    fs_ws_dsp_metrics_printf(text, "%s_count{%s} %llu\n", name, labels, (unsigned long long)count);
+}
+
+static void fs_ws_dsp_metrics_value(struct fs_ws_dsp_metrics_text *text, const char *name, const char *type,
+                                    const char *help, uint64_t value) {
+    fs_ws_dsp_metrics_printf(text, "# HELP %s %s\n# TYPE %s %s\n%s %llu\n", name, help, name, type, name,
+                             (unsigned long long)value);
+}
+
+void fs_ws_dsp_metrics_render(struct fs_ws_dsp_metrics_text *text) {
+    struct fs_ws_dsp_metrics_shard *sum, *shard;
+    struct fs_ws_dsp_cache_stats fft;
+    struct fs_ws_dsp_result_stats result;
+    uint64_t counters[FS_WS_DSP_METRICS_COUNTERS];
+    char labels[64];
+    unsigned int i, v;
+
+    // Sum into a private shard so the lock is not held while formatting.
+    sum = calloc(1, sizeof(struct fs_ws_dsp_metrics_shard));
+    if (!sum) {
+        text->failed = 1;
+        return;
+    }
+    pthread_mutex_lock(&fs_ws_dsp_metrics_lock);
+    fs_ws_dsp_metrics_fold(sum, &fs_ws_dsp_metrics_retired);
+    for (shard = fs_ws_dsp_metrics_shards; shard; shard = shard->next)
+        fs_ws_dsp_metrics_fold(sum, shard);
+    pthread_mutex_unlock(&fs_ws_dsp_metrics_lock);
+    for (i = 0; i < FS_WS_DSP_METRICS_COUNTERS; i++)
+        counters[i] = atomic_load_explicit(&sum->counters[i], memory_order_relaxed);
+
+    fs_ws_dsp_metrics_value(text, "fs_ws_dsp_rx_bytes_total", "counter", "Websocket message bytes received.",
+                            counters[FS_WS_DSP_METRIC_RX_BYTES]);
+    fs_ws_dsp_metrics_value(text, "fs_ws_dsp_rx_messages_total", "counter", "Websocket messages received.",
+                            counters[FS_WS_DSP_METRIC_RX_MESSAGES]);
+    fs_ws_dsp_metrics_value(text, "fs_ws_dsp_tx_bytes_total", "counter", "Websocket message bytes written.",
+                            counters[FS_WS_DSP_METRIC_TX_BYTES]);
+    fs_ws_dsp_metrics_value(text, "fs_ws_dsp_tx_messages_total", "counter", "Websocket messages written.",
+                            counters[FS_WS_DSP_METRIC_TX_MESSAGES]);
+    fs_ws_dsp_metrics_value(text, "fs_ws_dsp_sessions_total", "counter", "Websocket sessions established.",
+                            counters[FS_WS_DSP_METRIC_SESSIONS_OPENED]);
+    // Shards are read while they are written, so a scrape may see a close without its open.
+    fs_ws_dsp_metrics_value(text, "fs_ws_dsp_sessions", "gauge", "Websocket sessions open.",
+                            counters[FS_WS_DSP_METRIC_SESSIONS_OPENED] > counters[FS_WS_DSP_METRIC_SESSIONS_CLOSED] ?
+                            counters[FS_WS_DSP_METRIC_SESSIONS_OPENED] - counters[FS_WS_DSP_METRIC_SESSIONS_CLOSED] : 0);
+    fs_ws_dsp_metrics_value(text, "fs_ws_dsp_flow_control_total", "counter",
+                            "Times a session stopped being read until its responses drained.",
+                            counters[FS_WS_DSP_METRIC_FLOW_CONTROL]);
+    fs_ws_dsp_metrics_value(text, "fs_ws_dsp_tx_queue_responses", "gauge", "Responses queued for writing in all sessions.",
+                            counters[FS_WS_DSP_METRIC_TX_QUEUED] > counters[FS_WS_DSP_METRIC_TX_DEQUEUED] ?
+                            counters[FS_WS_DSP_METRIC_TX_QUEUED] - counters[FS_WS_DSP_METRIC_TX_DEQUEUED] : 0);
+    fs_ws_dsp_metrics_printf(text, "# HELP fs_ws_dsp_drops_total Messages and responses dropped, by reason.\n"
+                                   "# TYPE fs_ws_dsp_drops_total counter\n");
+    for (i = 0; i < sizeof(fs_ws_dsp_metrics_drops) / sizeof(fs_ws_dsp_metrics_drops[0]); i++)
+        fs_ws_dsp_metrics_printf(text, "fs_ws_dsp_drops_total{reason=\"%s\"} %llu\n", fs_ws_dsp_metrics_drops[i],
+                                 (unsigned long long)counters[FS_WS_DSP_METRIC_DROP_MALFORMED + i]);
+
+    fs_ws_dsp_metrics_printf(text, "# HELP fs_ws_dsp_command_seconds Time commands took to run, by command type.\n"
+                                   "# TYPE fs_ws_dsp_command_seconds histogram\n");
+    for (i = 0; i < FS_WS_DSP_METRICS_COMMANDS; i++) {
+        snprintf(labels, sizeof labels, "command=\"%s\"", fs_ws_dsp_metrics_commands[i]);
+        fs_ws_dsp_metrics_histogram(text, "fs_ws_dsp_command_seconds", labels, &sum->commands[i]);
+    }
+    fs_ws_dsp_metrics_printf(text, "# HELP fs_ws_dsp_message_seconds Time messages spent in each phase, by message version.\n"
+                                   "# TYPE fs_ws_dsp_message_seconds histogram\n");
+    for (i = 0; i < FS_WS_DSP_METRICS_PHASES; i++)
+        for (v = 1; v < FS_WS_DSP_METRICS_VERSIONS; v++) {
+            snprintf(labels, sizeof labels, "phase=\"%s\",message=\"%s\"", fs_ws_dsp_metrics_phases[i],
+                     fs_ws_dsp_metrics_versions[v]);
+            fs_ws_dsp_metrics_histogram(text, "fs_ws_dsp_message_seconds", labels, &sum->phases[i][v]);
+        }
+
+    fs_ws_dsp_fft_cache_stats(&fft);
+    fs_ws_dsp_result_cache_stats(&result);
+    fs_ws_dsp_metrics_printf(text, "# HELP fs_ws_dsp_cache_hits_total Cache lookups that found a value.\n"
+                                   "# TYPE fs_ws_dsp_cache_hits_total counter\n"
+                                   "fs_ws_dsp_cache_hits_total{cache=\"fft_plan\"} %llu\n"
+                                   "fs_ws_dsp_cache_hits_total{cache=\"result\"} %llu\n",
+                             (unsigned long long)fft.hits, (unsigned long long)result.cache.hits);
+    fs_ws_dsp_metrics_printf(text, "# HELP fs_ws_dsp_cache_misses_total Cache lookups that found nothing.\n"
+                                   "# TYPE fs_ws_dsp_cache_misses_total counter\n"
+                                   "fs_ws_dsp_cache_misses_total{cache=\"fft_plan\"} %llu\n"
+                                   "fs_ws_dsp_cache_misses_total{cache=\"result\"} %llu\n",
+                             (unsigned long long)fft.misses, (unsigned long long)result.cache.misses);
+    fs_ws_dsp_metrics_printf(text, "# HELP fs_ws_dsp_cache_bytes Bytes held by a cache.\n"
+                                   "# TYPE fs_ws_dsp_cache_bytes gauge\n"
+                                   "fs_ws_dsp_cache_bytes{cache=\"fft_plan\"} %llu\n"
+                                   "fs_ws_dsp_cache_bytes{cache=\"result\"} %llu\n",
+                             (unsigned long long)fft.bytes, (unsigned long long)result.cache.bytes);
+    fs_ws_dsp_metrics_value(text, "fs_ws_dsp_result_cache_saved_bytes_total", "counter",
+                            "Response bytes served from the result cache.", result.bytes_saved);
+    free(sum);
+}
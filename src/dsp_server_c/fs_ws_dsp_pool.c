@@ -0,0 +1,172 @@
+/**
+ * @file fs_ws_dsp_pool.c
+ * @brief Worker thread pool that runs signal processing jobs off the websocket service thread.
+ */
+
+/* Take the next job to run. Pool must be locked and a job queued. */
+static struct fs_ws_dsp_job *fs_ws_dsp_pool_take(struct fs_ws_dsp_pool *pool) {
+    struct fs_ws_dsp_job *job;
+    int level, top = -1, below = -1;
+
+    for (level = FS_WS_DSP_PRIORITIES - 1; level >= 0 && below < 0; level--) {
+        if (!pool->pending_head[level])
+            continue;
+        if (top < 0)
+            top = level;
+        else
+            below = level;
+    }
+    if (below < 0)
+        pool->overtaken = 0;
+    else if (++pool->overtaken > FS_WS_DSP_POOL_OVERTAKE) {
+        pool->overtaken = 0;
+        top = below;
+    }
+    job = pool->pending_head[top];
+    pool->pending_head[top] = job->next;
+    if (!pool->pending_head[top])
+        pool->pending_tail[top] = NULL;
+    pool->pending_count--;
+    return job;
+}
+
+static void *fs_ws_dsp_pool_worker(void *arg) {
+    struct fs_ws_dsp_worker *worker = (struct fs_ws_dsp_worker *)arg;
+    struct fs_ws_dsp_pool *pool = worker->pool;
+    struct fs_ws_dsp_job *job;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->pending_count && !pool->stopping)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (!pool->pending_count) {
+            // Stopping and nothing left to run.
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        job = fs_ws_dsp_pool_take(pool);
+        pthread_mutex_unlock(&pool->lock);
+
+        job->next = NULL;
+        pool->run(job, worker);
+        pool->done(job, pool->done_arg);
+        fs_ws_dsp_arena_trim(&worker->arena);
+    }
+    return NULL;
+}
+
+int fs_ws_dsp_pool_start(struct fs_ws_dsp_pool *pool, unsigned int workers_count, unsigned int queues, size_t headroom,
+                         fs_ws_dsp_job_run run, fs_ws_dsp_job_done done, void *done_arg) {
+    unsigned int i;
+    memset(pool, 0, sizeof(struct fs_ws_dsp_pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pool->run      = run;
+    pool->done     = done;
+    pool->done_arg = done_arg;
+    // Submitting threads that run jobs inline each need their own arena.
+    pool->inline_workers = calloc(queues > 0 ? queues : 1, sizeof(struct fs_ws_dsp_worker));
+    if (!pool->inline_workers)
+        return -1;
+    pool->inline_count = queues > 0 ? queues : 1;
+    for (i = 0; i < pool->inline_count; i++) {
+        pool->inline_workers[i].pool  = pool;
+        pool->inline_workers[i].index = i;
+        fs_ws_dsp_arena_init(&pool->inline_workers[i].arena, headroom);
+    }
+    if (workers_count == 0)
+        return 0;
+
+    pool->workers = calloc(workers_count, sizeof(struct fs_ws_dsp_worker));
+    if (!pool->workers)
+        return -1;
+    for (i = 0; i < workers_count; i++) {
+        pool->workers[i].pool  = pool;
+        pool->workers[i].index = i;
+        fs_ws_dsp_arena_init(&pool->workers[i].arena, headroom);
+        if (pthread_create(&pool->workers[i].thread, NULL, fs_ws_dsp_pool_worker, &pool->workers[i]))
+            break;
+        pool->workers_count++;
+    }
+    if (pool->workers_count != workers_count) {
+        fs_ws_dsp_pool_stop(pool);
+        return -1;
+    }
+    return 0;
+}
+
+void fs_ws_dsp_pool_submit(struct fs_ws_dsp_pool *pool, struct fs_ws_dsp_job *job) {
+    job->next = NULL;
+    if (pool->workers_count == 0) {
+        pool->run(job, &pool->inline_workers[job->queue]);
+        pool->done(job, pool->done_arg);
+        fs_ws_dsp_arena_trim(&pool->inline_workers[job->queue].arena);
+        return;
+    }
+    if (job->priority >= FS_WS_DSP_PRIORITIES)
+        job->priority = FS_WS_DSP_PRIORITIES - 1;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->pending_tail[job->priority])
+        pool->pending_tail[job->priority]->next = job;
+    else
+        pool->pending_head[job->priority] = job;
+    pool->pending_tail[job->priority] = job;
+    pool->pending_count++;
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void fs_ws_dsp_pool_stop(struct fs_ws_dsp_pool *pool) {
+    unsigned int i;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->workers_count; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        fs_ws_dsp_arena_free(&pool->workers[i].arena);
+    }
+    for (i = 0; i < pool->inline_count; i++)
+        fs_ws_dsp_arena_free(&pool->inline_workers[i].arena);
+    free(pool->inline_workers);
+    pool->inline_workers = NULL;
+    pool->inline_count   = 0;
+    free(pool->workers);
+    pool->workers       = NULL;
+    pool->workers_count = 0;
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+void fs_ws_dsp_completion_push(struct fs_ws_dsp_completion *completion, struct fs_ws_dsp_job *job) {
+    struct fs_ws_dsp_job *head = atomic_load_explicit(&completion->head, memory_order_relaxed);
+    do {
+        job->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&completion->head, &head, job,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+struct fs_ws_dsp_job *fs_ws_dsp_completion_drain(struct fs_ws_dsp_completion *completion) {
+    struct fs_ws_dsp_job *lifo = atomic_exchange_explicit(&completion->head, NULL, memory_order_acquire);
+    struct fs_ws_dsp_job *fifo = NULL;
+    // Pushes stack up newest first. Reverse so jobs are handed out in completion order.
+    while (lifo) {
+        struct fs_ws_dsp_job *next = lifo->next;
+        lifo->next = fifo;
+        fifo = lifo;
+        lifo = next;
+    }
+    return fifo;
+}
+
+uint64_t fs_ws_dsp_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+int fs_ws_dsp_job_wanted(const struct fs_ws_dsp_job *job) {
+    if (atomic_load_explicit(&job->cancelled, memory_order_relaxed))
+        return 0;
+    return !job->deadline || fs_ws_dsp_now_ms() < job->deadline;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file fs_ws_dsp_result.c
+ * @brief Process wide cache of request results.
+ */
+
+static struct fs_ws_dsp_cache fs_ws_dsp_result_cache = FS_WS_DSP_CACHE_INITIALIZER(
+    0, 0, free);
+static size_t fs_ws_dsp_result_max_bytes = 0;
+static uint64_t fs_ws_dsp_result_seed = 0;
+static _Atomic uint64_t fs_ws_dsp_result_saved = 0;
+
+/* Key of a request: hash and length of its data, then its commands as sent. Returns a malloc'd key. */
+static char *fs_ws_dsp_result_key(struct fs_ws_dsp_message request, size_t *key_len) {
+    uint64_t hash = fs_ws_dsp_hash_bulk(request.data, request.data_len, fs_ws_dsp_result_seed);
+    size_t len = sizeof hash + 2 * sizeof(uint32_t);
+    struct fs_ws_dsp_command *command;
+    char *key, *dst;
+    uint32_t i;
+
+    for (i = 0; i < request.commands_count; i++)
+        len += 2 * sizeof(uint32_t) + request.commands[i]->params_len;
+    key = malloc(len);
+    if (!key)
+        return NULL;
+    dst = key;
+    memcpy(dst, &hash, sizeof hash);                                          dst += sizeof hash;
+    memcpy(dst, &request.data_len, sizeof(uint32_t));                         dst += sizeof(uint32_t);
+    memcpy(dst, &request.commands_count, sizeof(uint32_t));                   dst += sizeof(uint32_t);
+    for (i = 0; i < request.commands_count; i++) {
+        command = request.commands[i];
+        memcpy(dst, &command->type, sizeof(uint32_t));                        dst += sizeof(uint32_t);
+        memcpy(dst, &command->params_len, sizeof(uint32_t));                  dst += sizeof(uint32_t);
+        if (command->params_len > 0)
+            memcpy(dst, command->params, command->params_len);
+        dst += command->params_len;
+    }
+    *key_len = len;
+    return key;
+}
+
+struct fs_ws_dsp_message fs_ws_dsp_process_cached(struct fs_ws_dsp_message request, struct fs_ws_dsp_arena *arena) {
+    struct fs_ws_dsp_message response;
+    struct fs_ws_dsp_result *result;
+    size_t key_len, size;
+    char *key;
+
+    // Shared data may change between hashing and processing, and the result would be cached under the wrong key.
+    if (!fs_ws_dsp_result_max_bytes || request.shared || !(key = fs_ws_dsp_result_key(request, &key_len)))
+        return fs_ws_dsp_process(request, arena);
+
+    result = fs_ws_dsp_cache_take(&fs_ws_dsp_result_cache, key, key_len);
+    if (result) {
+        // Copied into the arena, the cached result is sent like a computed one.
+        memset(&response, 0, sizeof(struct fs_ws_dsp_message));
+        response._version = result->version;
+        response.id       = request.id;
+        response.arena    = arena;
+        response.data     = fs_ws_dsp_arena_borrow(arena, NULL, result->data_len);
+        if (response.data) {
+            memcpy(response.data, result->data, result->data_len);
+            response.data_len = result->data_len;
+            atomic_fetch_add_explicit(&fs_ws_dsp_result_saved, result->data_len, memory_order_relaxed);
+        }
+        fs_ws_dsp_cache_put(&fs_ws_dsp_result_cache, key, key_len, result,
+                            sizeof(struct fs_ws_dsp_result) + result->data_len + key_len);
+        free(key);
+        return response;
+    }
+
+    response = fs_ws_dsp_process(request, arena);
+    // Responses without data may stem from running out of memory, so are not remembered.
+    size = sizeof(struct fs_ws_dsp_result) + response.data_len + key_len;
+    if (response.data && response.data_len > 0 && size <= fs_ws_dsp_result_max_bytes / 8) {
+        result = malloc(sizeof(struct fs_ws_dsp_result) + response.data_len);
+        if (result) {
+            result->version  = response._version;
+            result->data_len = response.data_len;
+            memcpy(result->data, response.data, response.data_len);
+            fs_ws_dsp_cache_put(&fs_ws_dsp_result_cache, key, key_len, result, size);
+        }
+    }
+    free(key);
+    return response;
+}
+
+void fs_ws_dsp_result_cache_bound(size_t max_bytes) {
+    // Without a secret seed a client could craft data that collides with another client's request.
+    if (getrandom(&fs_ws_dsp_result_seed, sizeof fs_ws_dsp_result_seed, 0) != sizeof fs_ws_dsp_result_seed)
+        fs_ws_dsp_result_seed = (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)&fs_ws_dsp_result_seed;
+    fs_ws_dsp_cache_clear(&fs_ws_dsp_result_cache);
+    fs_ws_dsp_cache_bound(&fs_ws_dsp_result_cache, max_bytes ? FS_WS_DSP_RESULT_CACHE_ENTRIES : 0, max_bytes);
+    fs_ws_dsp_result_max_bytes = max_bytes;
+}
+
+void fs_ws_dsp_result_cache_stats(struct fs_ws_dsp_result_stats *stats) {
+    fs_ws_dsp_cache_stats(&fs_ws_dsp_result_cache, &stats->cache);
+    stats->bytes_saved = atomic_load_explicit(&fs_ws_dsp_result_saved, memory_order_relaxed);
+}
+
+void fs_ws_dsp_result_cache_clear() {
+    fs_ws_dsp_cache_clear(&fs_ws_dsp_result_cache);
+}
@@ -0,0 +1,56 @@
+/**
+ * @file fs_ws_dsp_stream.c
+ * @brief Persistent command chains that carry processing state from one message to the next.
+ */
+
+struct fs_ws_dsp_message fs_ws_dsp_stream_open(struct fs_ws_dsp_stream *stream, struct fs_ws_dsp_message request,
+                                               struct fs_ws_dsp_arena *arena) {
+    struct fs_ws_dsp_message response;
+    size_t params_len = 0;
+    char *params = NULL, *p;
+    uint32_t i;
+
+    // Only the commands are kept. Their params move to an allocation of their own, so the request
+    // buffer, data and all, goes once the first block is done. Without memory for them it stays.
+    for (i = 0; i < request.commands_count; i++)
+        params_len += request.commands[i]->params_len;
+    if (params_len > 0)
+        params = malloc(params_len);
+    if (params) {
+        p = params;
+        for (i = 0; i < request.commands_count; i++) {
+            memcpy(p, request.commands[i]->params, request.commands[i]->params_len);
+            request.commands[i]->params = p;
+            p += request.commands[i]->params_len;
+        }
+    }
+    response = fs_ws_dsp_stream_process(stream, request, arena);
+    memset(&stream->chain, 0, sizeof(struct fs_ws_dsp_message));
+    stream->chain._version       = request._version;
+    stream->chain.id             = request.id;
+    stream->chain.commands_count = request.commands_count;
+    stream->chain.commands       = request.commands;
+    if (params || params_len == 0) {
+        stream->chain.buffer = params;
+        free(request.buffer);
+    } else {
+        stream->chain.buffer = request.buffer;
+    }
+    return response;
+}
+
+struct fs_ws_dsp_message fs_ws_dsp_stream_process(struct fs_ws_dsp_stream *stream, struct fs_ws_dsp_message request,
+                                                  struct fs_ws_dsp_arena *arena) {
+    struct fs_ws_dsp_message block = request;
+    // Opening message carries its own commands, later blocks borrow them from the chain.
+    if (request._version != FS_WS_DSP_MSG_STREAM_OPEN && request._version != FS_WS_DSP_MSG_PUBLISH) {
+        block.commands_count = stream->chain.commands_count;
+        block.commands       = stream->chain.commands;
+    }
+    return fs_ws_dsp_process(block, arena);
+}
+
+void fs_ws_dsp_stream_close(struct fs_ws_dsp_stream *stream) {
+    fs_ws_dsp_message_free(stream->chain);
+    memset(&stream->chain, 0, sizeof(struct fs_ws_dsp_message));
+}
@@ -0,0 +1,132 @@
+/**
+ * @file fs_ws_dsp_topic.c
+ * @brief Named topics that share the results of one published stream with many subscribers.
+ */
+
+static pthread_mutex_t fs_ws_dsp_topic_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fs_ws_dsp_topic *fs_ws_dsp_topics = NULL;
+static uint32_t fs_ws_dsp_topic_ids = 0;
+
+/* Find or create a topic and take a reference on it. Registry must be locked. */
+static struct fs_ws_dsp_topic *fs_ws_dsp_topic_get(const char *name, uint32_t name_len) {
+    struct fs_ws_dsp_topic *topic;
+
+    for (topic = fs_ws_dsp_topics; topic; topic = topic->next)
+        if (topic->name_len == name_len && !memcmp(topic->name, name, name_len))
+            break;
+    if (!topic) {
+        topic = calloc(1, sizeof(struct fs_ws_dsp_topic));
+        if (!topic)
+            return NULL;
+        memcpy(topic->name, name, name_len);
+        topic->name_len = name_len;
+        if (++fs_ws_dsp_topic_ids == 0)
+            fs_ws_dsp_topic_ids = 1;
+        topic->id = fs_ws_dsp_topic_ids;
+        topic->next = fs_ws_dsp_topics;
+        fs_ws_dsp_topics = topic;
+    }
+    topic->refs++;
+    return topic;
+}
+
+/* Drop a reference, freeing the topic with the last one. Registry must be locked. */
+static void fs_ws_dsp_topic_put(struct fs_ws_dsp_topic *topic) {
+    struct fs_ws_dsp_topic **slot = &fs_ws_dsp_topics;
+
+    if (--topic->refs)
+        return;
+    while (*slot != topic)
+        slot = &(*slot)->next;
+    *slot = topic->next;
+    free(topic);
+}
+
+struct fs_ws_dsp_topic *fs_ws_dsp_topic_publish(const char *name, uint32_t name_len) {
+    struct fs_ws_dsp_topic *topic;
+
+    if (name_len == 0 || name_len > FS_WS_DSP_TOPIC_NAME_MAX)
+        return NULL;
+    pthread_mutex_lock(&fs_ws_dsp_topic_lock);
+    topic = fs_ws_dsp_topic_get(name, name_len);
+    if (topic && topic->published) {
+        fs_ws_dsp_topic_put(topic);
+        topic = NULL;
+    } else if (topic) {
+        topic->published = 1;
+    }
+    pthread_mutex_unlock(&fs_ws_dsp_topic_lock);
+    return topic;
+}
+
+void fs_ws_dsp_topic_unpublish(struct fs_ws_dsp_topic *topic) {
+    if (!topic)
+        return;
+    pthread_mutex_lock(&fs_ws_dsp_topic_lock);
+    topic->published = 0;
+    fs_ws_dsp_topic_put(topic);
+    pthread_mutex_unlock(&fs_ws_dsp_topic_lock);
+}
+
+struct fs_ws_dsp_subscriber *fs_ws_dsp_topic_subscribe(const char *name, uint32_t name_len, void *owner,
+                                                       unsigned int queue) {
+    struct fs_ws_dsp_subscriber *subscriber;
+
+    if (name_len == 0 || name_len > FS_WS_DSP_TOPIC_NAME_MAX)
+        return NULL;
+    subscriber = calloc(1, sizeof(struct fs_ws_dsp_subscriber));
+    if (!subscriber)
+        return NULL;
+    subscriber->owner = owner;
+    subscriber->queue = queue;
+    atomic_init(&subscriber->refs, 1);
+
+    pthread_mutex_lock(&fs_ws_dsp_topic_lock);
+    subscriber->topic = fs_ws_dsp_topic_get(name, name_len);
+    if (subscriber->topic) {
+        subscriber->topic_id = subscriber->topic->id;
+        subscriber->next = subscriber->topic->subscribers;
+        subscriber->topic->subscribers = subscriber;
+    }
+    pthread_mutex_unlock(&fs_ws_dsp_topic_lock);
+
+    if (!subscriber->topic) {
+        free(subscriber);
+        return NULL;
+    }
+    return subscriber;
+}
+
+void fs_ws_dsp_topic_unsubscribe(struct fs_ws_dsp_subscriber *subscriber) {
+    struct fs_ws_dsp_subscriber **slot;
+
+    pthread_mutex_lock(&fs_ws_dsp_topic_lock);
+    slot = &subscriber->topic->subscribers;
+    while (*slot != subscriber)
+        slot = &(*slot)->next;
+    *slot = subscriber->next;
+    fs_ws_dsp_topic_put(subscriber->topic);
+    subscriber->topic = NULL;
+    pthread_mutex_unlock(&fs_ws_dsp_topic_lock);
+    fs_ws_dsp_subscriber_release(subscriber);
+}
+
+unsigned int fs_ws_dsp_topic_fanout(struct fs_ws_dsp_topic *topic, fs_ws_dsp_topic_frame frame, void *arg) {
+    struct fs_ws_dsp_subscriber *subscriber;
+    unsigned int count = 0;
+
+    pthread_mutex_lock(&fs_ws_dsp_topic_lock);
+    for (subscriber = topic->subscribers; subscriber; subscriber = subscriber->next, count++)
+        frame(subscriber, arg);
+    pthread_mutex_unlock(&fs_ws_dsp_topic_lock);
+    return count;
+}
+
+void fs_ws_dsp_subscriber_hold(struct fs_ws_dsp_subscriber *subscriber) {
+    atomic_fetch_add_explicit(&subscriber->refs, 1, memory_order_relaxed);
+}
+
+void fs_ws_dsp_subscriber_release(struct fs_ws_dsp_subscriber *subscriber) {
+    if (atomic_fetch_sub_explicit(&subscriber->refs, 1, memory_order_acq_rel) == 1)
+        free(subscriber);
+}
@@ -0,0 +1,84 @@
+/**
+ * @file fs_ws_dsp_window.c
+ * @brief Process wide cache of spectral analysis windows.
+ */
+
+struct fs_ws_dsp_window_key {
+    uint32_t type;
+    uint32_t n;
+    float beta;
+};
+
+static void fs_ws_dsp_window_destroy(void *value) {
+    free(value);
+}
+
+static struct fs_ws_dsp_cache fs_ws_dsp_window_cache = FS_WS_DSP_CACHE_INITIALIZER(
+    FS_WS_DSP_WINDOW_CACHE, FS_WS_DSP_WINDOW_CACHE_BYTES, fs_ws_dsp_window_destroy);
+
+static struct fs_ws_dsp_window_key fs_ws_dsp_window_key(uint32_t type, unsigned int n, float beta) {
+    struct fs_ws_dsp_window_key key;
+    memset(&key, 0, sizeof(struct fs_ws_dsp_window_key));
+    key.type = type;
+    key.n    = n;
+    key.beta = type == FS_WS_DSP_WINDOW_KAISER ? beta : 0.0f;
+    return key;
+}
+
+/* Modified Bessel function of the first kind, order zero, by its power series. */
+static double fs_ws_dsp_window_i0(double x) {
+    double sum = 1.0, term = 1.0, q = x * x / 4.0;
+    unsigned int k;
+    for (k = 1; k < 64 && term > sum * 1e-12; k++) {
+        term *= q / ((double)k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+struct fs_ws_dsp_window *fs_ws_dsp_window_acquire(uint32_t type, unsigned int n, float beta) {
+    struct fs_ws_dsp_window_key key = fs_ws_dsp_window_key(type, n, beta);
+    struct fs_ws_dsp_window *window;
+    double t, r, sum = 0.0, power = 0.0;
+    unsigned int i;
+
+    if (n == 0 || (type != FS_WS_DSP_WINDOW_HANN && type != FS_WS_DSP_WINDOW_BLACKMANHARRIS && type != FS_WS_DSP_WINDOW_KAISER))
+        return NULL;
+    window = fs_ws_dsp_cache_take(&fs_ws_dsp_window_cache, &key, sizeof key);
+    if (window)
+        return window;
+
+    window = malloc(sizeof(struct fs_ws_dsp_window) + n * sizeof(float));
+    if (!window)
+        return NULL;
+    window->type = type;
+    window->n    = n;
+    window->beta = key.beta;
+    for (i = 0; i < n; i++) {
+        t = 2.0 * M_PI * i / n;
+        if (type == FS_WS_DSP_WINDOW_HANN) {
+            window->w[i] = 0.5 - 0.5 * cos(t);
+        } else if (type == FS_WS_DSP_WINDOW_BLACKMANHARRIS) {
+            window->w[i] = 0.35875 - 0.48829 * cos(t) + 0.14128 * cos(2 * t) - 0.01168 * cos(3 * t);
+        } else {
+            // Centre the periodic window on n / 2.
+            r = 2.0 * i / n - 1.0;
+            window->w[i] = fs_ws_dsp_window_i0(window->beta * sqrt(1.0 - r * r)) / fs_ws_dsp_window_i0(window->beta);
+        }
+        sum   += window->w[i];
+        power += (double)window->w[i] * window->w[i];
+    }
+    window->sum   = sum;
+    window->power = power;
+    return window;
+}
+
+void fs_ws_dsp_window_release(struct fs_ws_dsp_window *window) {
+    struct fs_ws_dsp_window_key key = fs_ws_dsp_window_key(window->type, window->n, window->beta);
+    size_t size = sizeof(struct fs_ws_dsp_window) + (size_t)window->n * sizeof(float);
+    if (size > FS_WS_DSP_WINDOW_CACHE_BYTES / 8) {
+        fs_ws_dsp_window_destroy(window);
+        return;
+    }
+    fs_ws_dsp_cache_put(&fs_ws_dsp_window_cache, &key, sizeof key, window, size);
+}
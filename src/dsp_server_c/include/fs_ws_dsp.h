@@ -4,21 +4,79 @@
  */
 
 #include "fs_ws_dsp_command.h"
+#include "fs_ws_dsp_buffer.h"
+#include "fs_ws_dsp_arena.h"
+#include "fs_ws_dsp_convert.h"
 #include "fs_ws_dsp_message.h"
+#include "fs_ws_dsp_capture.h"
+#include "fs_ws_dsp_cache.h"
+#include "fs_ws_dsp_fft.h"
+#include "fs_ws_dsp_window.h"
 #include "fs_ws_dsp_cmd_echo.h"
 #include "fs_ws_dsp_cmd_fft.h"
 #include "fs_ws_dsp_cmd_firfilt.h"
+#include "fs_ws_dsp_cmd_fastfilt.h"
+#include "fs_ws_dsp_cmd_convert.h"
+#include "fs_ws_dsp_cmd_stft.h"
+#include "fs_ws_dsp_cmd_resamp.h"
+#include "fs_ws_dsp_cmd_ddc.h"
+#include "fs_ws_dsp_cmd_channelize.h"
+#include "fs_ws_dsp_pool.h"
+#include "fs_ws_dsp_fork.h"
+#include "fs_ws_dsp_topic.h"
+#include "fs_ws_dsp_stream.h"
+#include "fs_ws_dsp_result.h"
+#include "fs_ws_dsp_local.h"
+#include "fs_ws_dsp_metrics.h"
+
+#define FS_WS_DSP_INCREMENTAL_BLOCK_MAX (1024 * 1024) ///< Largest piece, in samples, a chain may need whole.
+#define FS_WS_DSP_TILE_SAMPLES          8192          ///< Samples per tile when streaming stages run fused.
 
 /**
  * @brief Process signal processing message.
+ * @details Stages borrow their buffers from arena and work in place where they can, so the response
+ *          data lives in the arena and is only valid until the arena is next used. Consecutive
+ *          streaming stages (conversion, FIR filter, resamplers, down-converter) run fused, tile by
+ *          tile; stages that need the whole block, such as FFT, run over it one at a time. Once the
+ *          job of the message is no longer wanted, the stages left are skipped and the response is
+ *          of version FS_WS_DSP_MSG_CANCEL without data.
  * @param[in] message Signal processing message.
+ * @param[in] arena Scratch buffers of the calling thread.
+ */
+struct fs_ws_dsp_message fs_ws_dsp_process(struct fs_ws_dsp_message message, struct fs_ws_dsp_arena *arena);
+/**
+ * @brief Process the sub-messages of a FS_WS_DSP_MSG_BATCH message one after the other.
+ * @details Sub-messages that are malformed, cannot be read or are not REQUEST or CAPTURE messages get
+ *          a response without data, so the batch response still holds one response per sub-message.
+ *          Parsing stops at a sub-message running past the end of the batch. Once the job of the batch
+ *          is no longer wanted, the batch is answered by a response of version FS_WS_DSP_MSG_CANCEL.
+ * @param[in] message Parsed batch message.
+ * @param[in] arena Scratch buffers of the calling thread. The batch response is left in it.
+ */
+struct fs_ws_dsp_message fs_ws_dsp_process_batch(struct fs_ws_dsp_message message, struct fs_ws_dsp_arena *arena);
+/**
+ * @brief Check whether a command chain can process its data in pieces as it arrives.
+ * @details True for chains whose output for the whole data equals the concatenated output for any
+ *          split of the data on frame boundaries, given the commands keep their state in between.
+ * @param[in]  message  Request with its commands.
+ * @param[in]  data_len Byte length of the whole request data.
+ * @param[out] frame    Pieces must be a multiple of this many bytes, except the last.
+ * @param[out] out_len  Byte length of the response data for the whole request, at most UINT32_MAX.
+ * @returns 1 if the chain can run incrementally, 0 if it needs all data at once or its response
+ *          would be too long to announce.
  */
-struct fs_ws_dsp_message fs_ws_dsp_process(struct fs_ws_dsp_message message);
+int fs_ws_dsp_process_incremental(struct fs_ws_dsp_message message, uint32_t data_len, uint32_t *frame, uint64_t *out_len);
 /**
- * @brief Convert interleaved complex char (8 bit I, 8 bit Q) samples to interleaved float complex (32 bit I, 32 bit Q) samples
- * @param[in] samples Interleaved complex char samples
- * @param[in] n_samples Number of samples (IQ pairs)
+ * @brief Input samples of a processing stage.
+ * @details The output of the previous stage, or the request data converted into the response arena
+ *          for the first stage. Stages write their output over it where they can.
+ * @param[in]  command  Command of the stage. Param 4 is the raw sample format, see fs_ws_dsp_convert.h.
+ * @param[in]  request  Request being processed.
+ * @param[in]  response Response built so far.
+ * @param[out] n_len    Number of samples.
+ * @returns Samples, or NULL if there is nothing to process or memory ran out.
  */
-float _Complex *fs_ws_dsp_samples_8to32(char _Complex *samples, int n_samples);
+float _Complex *fs_ws_dsp_samples_input(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request,
+                                        struct fs_ws_dsp_message *response, unsigned int *n_len);
 
 void fs_ws_dsp_debug(char *data, size_t data_len);
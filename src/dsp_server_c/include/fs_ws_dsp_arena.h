@@ -0,0 +1,81 @@
+/**
+ * @file fs_ws_dsp_arena.h
+ * @brief Reusable scratch buffers that processing stages borrow their output space from.
+ * @details Each worker owns one arena for its lifetime. The arena holds two buffers used ping-pong: a
+ *          stage borrows the buffer its input is not in, or writes in place over its input when the
+ *          stage allows it. Buffers come from the buffer pool and only grow, so after the first few
+ *          requests a worker runs its chains without touching the allocator. The buffer holding the
+ *          final result can be detached and sent as is; the arena then takes another from the pool.
+ */
+
+#define FS_WS_DSP_ARENA_KEEP FS_WS_DSP_BUFFER_LARGEST
+
+/**
+ * @brief One scratch buffer.
+ */
+struct fs_ws_dsp_arena_buf {
+    char *base;  ///< Pooled buffer, headroom bytes before data.
+    size_t size; ///< Usable bytes after the headroom.
+};
+
+/**
+ * @brief Pair of scratch buffers.
+ */
+struct fs_ws_dsp_arena {
+    size_t headroom;                     ///< Bytes reserved in front of every buffer.
+    struct fs_ws_dsp_arena_buf slot[2];  ///< Ping-pong buffers.
+};
+
+/**
+ * @brief Prepare an empty arena.
+ * @param[out] arena    - Arena.
+ * @param[in]  headroom - Bytes to reserve in front of every buffer, ie for a message header.
+ */
+void fs_ws_dsp_arena_init(struct fs_ws_dsp_arena *arena, size_t headroom);
+
+/**
+ * @brief Borrow a buffer that does not overlap input.
+ * @details The buffer stays valid until the buffer is borrowed again or the arena is trimmed.
+ * @param[in] arena - Arena.
+ * @param[in] input - Data the caller still needs to read, or NULL.
+ * @param[in] size  - Bytes required.
+ * @returns Buffer of at least size bytes, or NULL if out of memory.
+ */
+void *fs_ws_dsp_arena_borrow(struct fs_ws_dsp_arena *arena, const void *input, size_t size);
+
+/**
+ * @brief Check whether data lives in one of the arena buffers.
+ * @param[in] arena - Arena, may be NULL.
+ * @param[in] data  - Pointer to check.
+ */
+int fs_ws_dsp_arena_owns(struct fs_ws_dsp_arena *arena, const void *data);
+
+/**
+ * @brief Take the buffer that data starts at out of the arena.
+ * @param[in]  arena  - Arena.
+ * @param[in]  data   - Start of a buffer returned by fs_ws_dsp_arena_borrow.
+ * @param[out] buffer - Pooled buffer, headroom bytes before data. Return it with fs_ws_dsp_buffer_put.
+ * @returns 0 on success, -1 if data is not the start of an arena buffer.
+ */
+int fs_ws_dsp_arena_detach(struct fs_ws_dsp_arena *arena, const void *data, char **buffer);
+
+/**
+ * @brief Make a pooled buffer one of the arena buffers, in place of the one that does not hold input.
+ * @details For results built outside the arena, so they can be detached and sent like any other.
+ * @param[in] arena  - Arena.
+ * @param[in] input  - Data the caller still needs to read, or NULL.
+ * @param[in] buffer - Buffer from fs_ws_dsp_buffer_get, headroom bytes before its data.
+ */
+void fs_ws_dsp_arena_adopt(struct fs_ws_dsp_arena *arena, const void *input, char *buffer);
+
+/**
+ * @brief Release buffers that grew beyond FS_WS_DSP_ARENA_KEEP for a one-off large request.
+ * @param[in] arena - Arena.
+ */
+void fs_ws_dsp_arena_trim(struct fs_ws_dsp_arena *arena);
+
+/**
+ * @brief Return both buffers to the pool.
+ * @param[in] arena - Arena.
+ */
+void fs_ws_dsp_arena_free(struct fs_ws_dsp_arena *arena);
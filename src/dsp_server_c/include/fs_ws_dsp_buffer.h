@@ -0,0 +1,63 @@
+/**
+ * @file fs_ws_dsp_buffer.h
+ * @brief Process wide pool of buffers in power of two size classes, shared by worker arenas and send queues.
+ * @details A response is computed into an arena buffer and then handed, as is, to the session that
+ *          sends it. Once written to the socket the buffer comes back here and a worker picks it up
+ *          again, so in steady state neither side allocates.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define FS_WS_DSP_BUFFER_MIN     4096
+#define FS_WS_DSP_BUFFER_CLASSES 24
+#define FS_WS_DSP_BUFFER_LARGEST (16 * 1024 * 1024)
+#define FS_WS_DSP_BUFFER_POOLED  (64 * 1024 * 1024)
+
+/**
+ * @brief Bookkeeping in front of every buffer.
+ */
+struct fs_ws_dsp_buffer {
+    struct fs_ws_dsp_buffer *next; ///< Next free buffer of the same size.
+    size_t size;                   ///< Usable bytes.
+    _Atomic unsigned int refs;     ///< Holders of the buffer. It goes back to the pool with the last.
+    _Alignas(16) char data[];      ///< Buffer handed out.
+};
+
+/**
+ * @brief Get a buffer.
+ * @details Sizes up to FS_WS_DSP_BUFFER_LARGEST are rounded up to a power of two and may come from
+ *          the pool. Larger buffers are allocated at their exact size.
+ * @param[in] size - Bytes required.
+ * @returns 16 byte aligned buffer of at least size bytes, or NULL if out of memory.
+ */
+char *fs_ws_dsp_buffer_get(size_t size);
+
+/**
+ * @brief Usable size of a buffer.
+ * @param[in] buffer - Buffer from fs_ws_dsp_buffer_get.
+ */
+size_t fs_ws_dsp_buffer_size(const char *buffer);
+
+/**
+ * @brief Add holders to a buffer, ie sessions that send the same response. Safe from any thread.
+ * @details Each holder returns the buffer with fs_ws_dsp_buffer_put. A buffer with more than one
+ *          holder must not be written to.
+ * @param[in] buffer - Buffer from fs_ws_dsp_buffer_get.
+ * @param[in] count  - Holders to add.
+ */
+void fs_ws_dsp_buffer_hold(char *buffer, unsigned int count);
+
+/**
+ * @brief Return a buffer. Safe from any thread.
+ * @details Only the last holder gives the buffer back. Kept for reuse unless larger than FS_WS_DSP_BUFFER_LARGEST or the pool already holds
+ *          FS_WS_DSP_BUFFER_POOLED bytes.
+ * @param[in] buffer - Buffer from fs_ws_dsp_buffer_get, or NULL.
+ */
+void fs_ws_dsp_buffer_put(char *buffer);
+
+/**
+ * @brief Free every pooled buffer.
+ */
+void fs_ws_dsp_buffer_clear();
@@ -0,0 +1,120 @@
+/**
+ * @file fs_ws_dsp_cache.h
+ * @brief Thread-safe, bounded LRU cache of processing objects.
+ * @details Values are checked out exclusively with take and handed back with put, so objects that
+ *          carry internal buffers or state (plans, filters) are never shared between threads. Several
+ *          values may be cached under the same key; the cache grows to the level of concurrency seen.
+ */
+
+#include <pthread.h>
+
+#define FS_WS_DSP_CACHE_BUCKETS 256
+
+/**
+ * @brief Cached value and its key.
+ */
+struct fs_ws_dsp_cache_entry {
+    struct fs_ws_dsp_cache_entry *lru_prev;    ///< More recently used entry.
+    struct fs_ws_dsp_cache_entry *lru_next;    ///< Less recently used entry.
+    struct fs_ws_dsp_cache_entry *bucket_next; ///< Next entry in the same hash bucket.
+    uint64_t hash;                             ///< Hash of key.
+    size_t size;                               ///< Bytes accounted to value.
+    void *value;                               ///< Cached object.
+    size_t key_len;                            ///< Byte length of key.
+    char key[];                                ///< Copy of the key.
+};
+
+/**
+ * @brief Snapshot of cache counters.
+ */
+struct fs_ws_dsp_cache_stats {
+    uint64_t hits;      ///< Lookups that found a value.
+    uint64_t misses;    ///< Lookups that found nothing.
+    uint64_t evictions; ///< Values destroyed to stay within bounds.
+    unsigned int count; ///< Values currently cached.
+    size_t bytes;       ///< Bytes currently accounted.
+};
+
+/**
+ * @brief Cache instance.
+ */
+struct fs_ws_dsp_cache {
+    pthread_mutex_t lock;                                          ///< Guards everything below.
+    struct fs_ws_dsp_cache_entry *buckets[FS_WS_DSP_CACHE_BUCKETS]; ///< Hash buckets.
+    struct fs_ws_dsp_cache_entry *lru_head;                        ///< Most recently used.
+    struct fs_ws_dsp_cache_entry *lru_tail;                        ///< Least recently used.
+    unsigned int capacity;                                         ///< Maximum number of values. 0 disables caching.
+    size_t max_bytes;                                              ///< Maximum bytes accounted. 0 is unbounded.
+    void (*destroy)(void *value);                                  ///< Releases an evicted value.
+    struct fs_ws_dsp_cache_stats stats;                            ///< Counters.
+};
+
+/**
+ * @brief Static initializer for a cache.
+ * @param capacity  - Maximum number of values.
+ * @param max_bytes - Maximum bytes accounted, 0 for no byte bound.
+ * @param destroy   - Function releasing an evicted value.
+ */
+#define FS_WS_DSP_CACHE_INITIALIZER(capacity, max_bytes, destroy) \
+    { PTHREAD_MUTEX_INITIALIZER, { NULL }, NULL, NULL, (capacity), (max_bytes), (destroy), { 0 } }
+
+/**
+ * @brief Hash a byte array.
+ * @param[in] data     - Bytes to hash.
+ * @param[in] data_len - Byte length of data.
+ * @returns 64 bit hash.
+ */
+uint64_t fs_ws_dsp_hash(const void *data, size_t data_len);
+
+/**
+ * @brief Hash a large byte array, ie sample data.
+ * @details Reads 8 bytes at a time over four independent lanes (the xxHash64 construction), so it
+ *          runs at memory speed where fs_ws_dsp_hash is limited to a byte per multiply.
+ * @param[in] data     - Bytes to hash.
+ * @param[in] data_len - Byte length of data.
+ * @param[in] seed     - Seed. A secret seed keeps clients from crafting colliding inputs.
+ * @returns 64 bit hash.
+ */
+uint64_t fs_ws_dsp_hash_bulk(const void *data, size_t data_len, uint64_t seed);
+
+/**
+ * @brief Check out a cached value.
+ * @details The value is removed from the cache. Hand it back with fs_ws_dsp_cache_put when done.
+ * @param[in] cache   - Cache instance.
+ * @param[in] key     - Key bytes.
+ * @param[in] key_len - Byte length of key.
+ * @returns Cached value or NULL on a miss.
+ */
+void *fs_ws_dsp_cache_take(struct fs_ws_dsp_cache *cache, const void *key, size_t key_len);
+
+/**
+ * @brief Add a value to the cache as most recently used.
+ * @details Least recently used values are destroyed to stay within capacity and max_bytes.
+ * @param[in] cache   - Cache instance.
+ * @param[in] key     - Key bytes.
+ * @param[in] key_len - Byte length of key.
+ * @param[in] value   - Value. Ownership passes to the cache.
+ * @param[in] size    - Bytes to account for value.
+ */
+void fs_ws_dsp_cache_put(struct fs_ws_dsp_cache *cache, const void *key, size_t key_len, void *value, size_t size);
+
+/**
+ * @brief Change the bounds of a cache, evicting as needed.
+ * @param[in] cache     - Cache instance.
+ * @param[in] capacity  - Maximum number of values. 0 disables caching.
+ * @param[in] max_bytes - Maximum bytes accounted. 0 is unbounded.
+ */
+void fs_ws_dsp_cache_bound(struct fs_ws_dsp_cache *cache, unsigned int capacity, size_t max_bytes);
+
+/**
+ * @brief Read cache counters.
+ * @param[in]  cache - Cache instance.
+ * @param[out] stats - Counters.
+ */
+void fs_ws_dsp_cache_stats(struct fs_ws_dsp_cache *cache, struct fs_ws_dsp_cache_stats *stats);
+
+/**
+ * @brief Destroy every cached value.
+ * @param[in] cache - Cache instance.
+ */
+void fs_ws_dsp_cache_clear(struct fs_ws_dsp_cache *cache);
@@ -0,0 +1,36 @@
+/**
+ * @file fs_ws_dsp_capture.h
+ * @brief Captures recorded on the server host, referenced by requests instead of uploaded.
+ * @details A FS_WS_DSP_MSG_CAPTURE request names a file in the capture directory, a byte offset and a
+ *          length. A file without write permission is mapped read only and the mapping becomes the
+ *          request data, so the samples go from the page cache into the first stage without being
+ *          copied. Such files must not be truncated or rewritten while mapped: the worker reading
+ *          them would be killed by SIGBUS. Files that may be written are read into memory instead.
+ */
+
+#define FS_WS_DSP_CAPTURE_NAME_MAX 255                 ///< Longest capture file name.
+#define FS_WS_DSP_CAPTURE_MAX      (256 * 1024 * 1024) ///< Most bytes one request may map.
+
+/**
+ * @brief Set the directory captures are read from.
+ * @details Only regular files directly inside it can be referenced. Without one, capture requests
+ *          are refused.
+ * @param[in] path Directory.
+ * @returns 0 on success, -1 if the directory cannot be opened.
+ */
+int fs_ws_dsp_capture_dir(const char *path);
+
+/**
+ * @brief Map the capture a parsed FS_WS_DSP_MSG_CAPTURE request refers to as its data.
+ * @details Sets data and data_len to the referenced range. A length of 0 maps the rest of the file.
+ *          The mapping, or the copy of a writable file, is released by fs_ws_dsp_message_free.
+ * @param[in,out] message Parsed capture request.
+ * @returns 0 on success, -1 if the name is not allowed, the file cannot be read or the range is
+ *          outside it or larger than FS_WS_DSP_CAPTURE_MAX, or the file shrank while being copied.
+ */
+int fs_ws_dsp_capture_map(struct fs_ws_dsp_message *message);
+
+/**
+ * @brief Close the capture directory.
+ */
+void fs_ws_dsp_capture_close();
@@ -0,0 +1,40 @@
+/**
+ * @file fs_ws_dsp_cmd_channelize.h
+ * @brief Polyphase filterbank channelizer.
+ * @details Splits a wideband block into K equally spaced channels, each at 1/K of the input rate, in one
+ *          pass. Channel k is centred on k/K of the sample rate; channels above K/2 are the negative
+ *          frequencies. The response holds each channel in turn: all samples of channel 0, then channel
+ *          1, and so on, each data_len / K bytes long.
+ *          Command parameters, all little endian:
+ *          - 0:  uint32 sample rate
+ *          - 4:  uint32 sample format (see fs_ws_dsp_convert.h)
+ *          - 8:  uint32 number of channels K, default 4
+ *          - 12: uint32 filter semi-length in output samples, default 4
+ *          - 16: float  stop-band attenuation in dB, default 60
+ *          Trailing samples that do not fill a block of K are dropped from a request. A stream keeps
+ *          them and puts them in front of its next block.
+ */
+
+#define FS_WS_DSP_CHANNELIZE_MAX   1024
+#define FS_WS_DSP_CHANNELIZE_CACHE 16
+
+/**
+ * @brief Filterbank checked out of the design cache.
+ */
+struct fs_ws_dsp_channelizer {
+    firpfbch_crcf q;           ///< Liquid analysis filterbank.
+    unsigned int channels;     ///< K.
+    float _Complex *y;         ///< One output sample per channel.
+    float _Complex *rest;      ///< Samples of a block not yet complete, room for K. Follows y.
+    unsigned int rest_len;     ///< Number of samples in rest, less than K.
+    size_t key_len;            ///< Byte length of key.
+    char key[];                ///< Design the filterbank was built from.
+};
+
+/**
+ * @brief Polyphase filterbank channelizer.
+ * @param[in]     command  - Processing request command details.
+ * @param[in]     request  - Full request from client.
+ * @param[in out] response - Response to be sent back to client. May contain data from previous processing command.
+ */
+void fs_ws_dsp_cmd_channelize(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response);
@@ -0,0 +1,19 @@
+/**
+ * @file fs_ws_dsp_cmd_convert.h
+ * @brief Convert raw IQ input to float complex samples.
+ */
+
+/**
+ * Convert flags.
+ */
+const static uint32_t FS_WS_DSP_CONVERT_DC = 1; ///< Remove the mean of each block.
+
+/**
+ * @brief Convert raw IQ input to float complex samples, with optional DC removal and scaling.
+ * @details Params: 0 sample rate, 4 sample format, 8 flags, 12 scale (float, default 1). As the
+ *          first command it converts the request data, later it conditions the previous output.
+ * @param[in]     command  - Processing request command details.
+ * @param[in]     request  - Full request from client.
+ * @param[in out] response - Response to be sent back to client. May contain data from previous processing command.
+ */
+void fs_ws_dsp_cmd_convert(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response);
@@ -0,0 +1,32 @@
+/**
+ * @file fs_ws_dsp_cmd_ddc.h
+ * @brief Digital down-converter: mix a channel to baseband, low-pass filter and decimate.
+ * @details Mixing and decimation run tile by tile, so each tile is still in cache when it is filtered.
+ *          Command parameters, all little endian:
+ *          - 0:  uint32 sample rate
+ *          - 4:  uint32 sample format (see fs_ws_dsp_convert.h)
+ *          - 8:  float  channel centre frequency relative to sample rate, -0.5 to 0.5
+ *          - 12: uint32 decimation factor M, default 2. The filter passes the new Nyquist band. With
+ *                       M 1 the channel is only mixed, not filtered.
+ *          - 16: uint32 filter semi-length in output samples, default 8
+ *          - 20: float  stop-band attenuation in dB, default 60
+ *          Trailing samples that do not fill a block of M are dropped.
+ */
+
+#define FS_WS_DSP_DDC_TILE 4096 ///< Input samples mixed ahead of the decimator.
+
+/**
+ * @brief Down-converter state kept with the command.
+ */
+struct fs_ws_dsp_ddc {
+    nco_crcf nco;                    ///< Oscillator, its phase continues across the messages of a stream.
+    struct fs_ws_dsp_resamp *decim;  ///< Decimator from the resampler design cache.
+};
+
+/**
+ * @brief Digital down-converter.
+ * @param[in]     command  - Processing request command details.
+ * @param[in]     request  - Full request from client.
+ * @param[in out] response - Response to be sent back to client. May contain data from previous processing command.
+ */
+void fs_ws_dsp_cmd_ddc(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response);
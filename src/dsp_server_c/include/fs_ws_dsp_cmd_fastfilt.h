@@ -0,0 +1,88 @@
+/**
+ * @file fs_ws_dsp_cmd_fastfilt.h
+ * @brief FIR filter by FFT overlap-save convolution.
+ * @details Takes the same parameters as FS_WS_DSP_CMD_FIRFILT and produces the same output. Filters
+ *          shorter than the crossover length, or inputs shorter than one block, run through the direct
+ *          form filter instead. Run fs_ws_dsp_bench to find the crossover on a given machine.
+ */
+
+#define FS_WS_DSP_FASTFILT_CROSSOVER 64
+#define FS_WS_DSP_FASTFILT_CACHE     16
+
+struct fs_ws_dsp_ols;
+
+/**
+ * @brief Overlap-save convolution state for one tap set.
+ */
+struct fs_ws_dsp_ols {
+    unsigned int h_len;  ///< Number of taps.
+    unsigned int nfft;   ///< Transform length.
+    unsigned int block;  ///< New samples consumed per transform, nfft - h_len + 1.
+    float _Complex *H;   ///< Filter spectrum, scaled by 1/nfft.
+    float _Complex *t;   ///< Time domain input: h_len - 1 samples of history then one block.
+    float _Complex *f;   ///< Frequency domain work array.
+    float _Complex *o;   ///< Time domain output of the inverse transform.
+    fftplan forward;     ///< t -> f
+    fftplan backward;    ///< f -> o
+    size_t key_len;      ///< Byte length of key.
+    char key[];          ///< Filter description, as used by the FIR design cache.
+};
+
+/**
+ * @brief Fast filter command state.
+ */
+struct fs_ws_dsp_fastfilt {
+    struct fs_ws_dsp_firfilt *filter; ///< Direct form filter, also the source of taps.
+    struct fs_ws_dsp_ols *ols;        ///< Overlap-save state, NULL when the direct form was chosen.
+};
+
+/**
+ * @brief Choose the transform length used for a filter.
+ * @param[in] h_len - Number of taps.
+ */
+unsigned int fs_ws_dsp_ols_nfft(unsigned int h_len);
+
+/**
+ * @brief Build overlap-save state for a filter.
+ * @param[in] h       - Filter coefficients.
+ * @param[in] h_len   - Number of taps.
+ * @param[in] key     - Filter description used as the cache key.
+ * @param[in] key_len - Byte length of key.
+ * @returns State or NULL if out of memory.
+ */
+struct fs_ws_dsp_ols *fs_ws_dsp_ols_create(float *h, unsigned int h_len, const char *key, size_t key_len);
+
+/**
+ * @brief Clear filter history.
+ * @param[in] ols - Overlap-save state.
+ */
+void fs_ws_dsp_ols_reset(struct fs_ws_dsp_ols *ols);
+
+/**
+ * @brief Filter a block of samples. History carries over between calls.
+ * @param[in]  ols   - Overlap-save state.
+ * @param[in]  x     - Input samples. May be the same array as y.
+ * @param[in]  n_len - Number of samples.
+ * @param[out] y     - Filtered samples.
+ */
+void fs_ws_dsp_ols_execute(struct fs_ws_dsp_ols *ols, float _Complex *x, unsigned int n_len, float _Complex *y);
+
+/**
+ * @brief Free overlap-save state.
+ * @param[in] ols - Overlap-save state.
+ */
+void fs_ws_dsp_ols_destroy(struct fs_ws_dsp_ols *ols);
+
+/**
+ * @brief Set the filter length at which overlap-save replaces the direct form filter.
+ * @param[in] h_len - Number of taps.
+ */
+void fs_ws_dsp_fastfilt_crossover(unsigned int h_len);
+
+/**
+ * @brief FIR filter by fast convolution.
+ * @param[in]     command  - Processing request command details.
+ * @param[in]     request  - Full request from client.
+ * @param[in out] response - Response to be sent back to client. May contain data from previous processing command.
+ */
+void fs_ws_dsp_cmd_fastfilt(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response);
@@ -1,8 +1,100 @@
 /**
  * @file fs_ws_dsp_cmd_fft.h
  * @brief Fast fourier transform.
+ * @details Command parameters, all little endian. Only the first two are required; without the rest
+ *          the command returns the raw complex bins of the whole block.
+ *          - 0:  uint32 sample rate
+ *          - 4:  uint32 sample format (see fs_ws_dsp_convert.h)
+ *          - 8:  spectrum parameters, see struct fs_ws_dsp_spectrum
  */
 
+/**
+ * Spectrum flags.
+ */
+const static uint32_t FS_WS_DSP_SPECTRUM_SHIFT = 1;   ///< Order bins from -fs/2 to fs/2 (fftshift).
+
+/**
+ * Spectrum output modes.
+ */
+const static uint32_t FS_WS_DSP_SPECTRUM_COMPLEX = 0; ///< Complex float bins.
+const static uint32_t FS_WS_DSP_SPECTRUM_POWER = 1;   ///< Magnitude squared, normalized to the window gain.
+const static uint32_t FS_WS_DSP_SPECTRUM_DB = 2;      ///< Power in dB.
+
+/**
+ * Spectrum output types for power and dB. Integer types always carry dB, mapped linearly from the
+ * range db_min..db_max to 0..32767 or 0..255 and clamped.
+ */
+const static uint32_t FS_WS_DSP_SPECTRUM_FLOAT32 = 0;
+const static uint32_t FS_WS_DSP_SPECTRUM_INT16 = 1;
+const static uint32_t FS_WS_DSP_SPECTRUM_UINT8 = 2;
+
+/**
+ * @brief How to turn transformed bins into the response.
+ * @details Read from command parameters at a base offset, in this order, each 4 bytes:
+ *          - +0:  uint32 window (see fs_ws_dsp_window.h), default none
+ *          - +4:  float  Kaiser beta, default 8.6
+ *          - +8:  uint32 flags
+ *          - +12: uint32 output mode, default complex
+ *          - +16: uint32 output type, default float32
+ *          - +20: float  dB range minimum, default -120
+ *          - +24: float  dB range maximum, default 0
+ *          - +28: float  averaging factor 0..1, default 0. Power is smoothed exponentially across the
+ *                        messages of a stream: avg = factor * avg + (1 - factor) * power.
+ */
+struct fs_ws_dsp_spectrum {
+    uint32_t window; ///< Window type.
+    float beta;      ///< Kaiser shape parameter.
+    uint32_t flags;  ///< FS_WS_DSP_SPECTRUM_SHIFT.
+    uint32_t mode;   ///< Output mode.
+    uint32_t type;   ///< Output type.
+    float db_min;    ///< dB mapped to the lowest integer value.
+    float db_max;    ///< dB mapped to the highest integer value.
+    float average;   ///< Exponential averaging factor.
+};
+
+/**
+ * @brief Read spectrum parameters.
+ * @param[in]  command  - Processing request command details.
+ * @param[in]  offset   - Byte offset of the spectrum parameters in the command parameters.
+ * @param[out] spectrum - Parameters, defaults where the command is too short.
+ * @returns 0 on success, -1 for an unknown window, mode or type.
+ */
+int fs_ws_dsp_spectrum_params(struct fs_ws_dsp_command *command, uint32_t offset, struct fs_ws_dsp_spectrum *spectrum);
+
+/**
+ * @brief Swap the halves of a block of bins so the zero frequency bin sits in the middle.
+ * @param[in out] x - Bins.
+ * @param[in]     n - Number of bins.
+ */
+void fs_ws_dsp_spectrum_shift(float _Complex *x, unsigned int n);
+
+/**
+ * @brief Magnitude squared of each bin, written in place as n floats at the start of x.
+ * @param[in out] x     - Bins, then power.
+ * @param[in]     n     - Number of bins.
+ * @param[in]     scale - Factor applied to each power value.
+ */
+void fs_ws_dsp_spectrum_power(float _Complex *x, unsigned int n, float scale);
+
+/**
+ * @brief Smooth power exponentially with the average kept in the command state.
+ * @details The average restarts when the number of values changes. The command must not keep other state.
+ * @param[in out] command - Command that owns the average.
+ * @param[in]     factor  - Weight of the previous average, 0..1.
+ * @param[in out] p       - Power values, replaced by the new average.
+ * @param[in]     n       - Number of values.
+ */
+void fs_ws_dsp_spectrum_average(struct fs_ws_dsp_command *command, float factor, float *p, unsigned int n);
+
+/**
+ * @brief Convert power values in place to the output mode and type of a spectrum.
+ * @param[in]     spectrum - Spectrum parameters. Mode must not be complex.
+ * @param[in out] p        - Power values, then output.
+ * @param[in]     n        - Number of values.
+ * @returns Byte length of the output.
+ */
+size_t fs_ws_dsp_spectrum_format(struct fs_ws_dsp_spectrum *spectrum, float *p, unsigned int n);
+
 /**
  * @brief Fast fourier transform.
  * @param[in]     command  - Processing request command details.
@@ -1,8 +1,44 @@
 /**
  * @file fs_ws_dsp_cmd_firfilt.h
  * @brief FIR Filter.
+ * @details Command parameters, all little endian:
+ *          - 0:  uint32 sample rate
+ *          - 4:  uint32 sample format (see fs_ws_dsp_convert.h)
+ *          - 8:  uint32 filter length (taps), default 57
+ *          - 12: float  cutoff frequency relative to sample rate, in (0, 0.5], default 0.10
+ *          - 16: float  stop-band attenuation in dB, above 0, default 60
+ *          - 20: float  taps[filter length], optional. When present these coefficients are used as is
+ *                       and cutoff and attenuation are ignored.
  */
 
+#define FS_WS_DSP_FIRFILT_TAPS_MAX  (64 * 1024)
+#define FS_WS_DSP_FIRFILT_CACHE     32
+
+/**
+ * @brief Filter checked out of the design cache.
+ */
+struct fs_ws_dsp_firfilt {
+    firfilt_crcf q;      ///< Liquid filter object.
+    unsigned int h_len;  ///< Number of taps.
+    float *h;            ///< Filter coefficients.
+    size_t key_len;      ///< Byte length of key.
+    char key[];          ///< Filter description the object was built from.
+};
+
+/**
+ * @brief Check out a filter matching the command parameters, designing it on a cache miss.
+ * @details The filter is reset before it is returned.
+ * @param[in] command - Processing request command details.
+ * @returns Filter or NULL if the parameters are invalid or memory ran out.
+ */
+struct fs_ws_dsp_firfilt *fs_ws_dsp_firfilt_acquire(struct fs_ws_dsp_command *command);
+
+/**
+ * @brief Return a filter to the design cache.
+ * @param[in] filter - Filter from fs_ws_dsp_firfilt_acquire.
+ */
+void fs_ws_dsp_firfilt_release(struct fs_ws_dsp_firfilt *filter);
+
 /**
  * @brief Fir Filter.
  * @param[in]     command  - Processing request command details.
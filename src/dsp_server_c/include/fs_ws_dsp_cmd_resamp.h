@@ -0,0 +1,84 @@
+/**
+ * @file fs_ws_dsp_cmd_resamp.h
+ * @brief Polyphase decimation, interpolation and rational resampling.
+ * @details Command parameters, all little endian:
+ *          - 0:  uint32 sample rate
+ *          - 4:  uint32 sample format (see fs_ws_dsp_convert.h)
+ *          FS_WS_DSP_CMD_DECIM and FS_WS_DSP_CMD_INTERP:
+ *          - 8:  uint32 factor M (decimation) or L (interpolation), default 2
+ *          - 12: uint32 filter semi-length in output (decimation) or input (interpolation) samples, default 8
+ *          - 16: float  stop-band attenuation in dB, default 60
+ *          FS_WS_DSP_CMD_RESAMP, output rate is input rate * P / Q:
+ *          - 8:  uint32 interpolation factor P, default 1
+ *          - 12: uint32 decimation factor Q, default 1
+ *          - 16: uint32 filter semi-length, default 12
+ *          - 20: float  bandwidth relative to the lower of the two rates, default 0.5
+ *          - 24: float  stop-band attenuation in dB, default 60
+ *          A factor of 1, or P equal to Q, passes the samples through unfiltered. The bandwidth must be
+ *          in (0, 0.5] and the attenuation above 0.
+ *          Decimators consume whole blocks of M (or Q) samples. Trailing samples that do not fill a
+ *          block are dropped, so streams should send blocks that are multiples of it.
+ */
+
+#define FS_WS_DSP_RESAMP_FACTOR_MAX 1024
+#define FS_WS_DSP_RESAMP_CACHE      32
+
+/**
+ * @brief Resampler checked out of the design cache.
+ */
+struct fs_ws_dsp_resamp {
+    uint32_t type;                  ///< Command type the resampler was built for.
+    unsigned int interp;            ///< Output samples per block.
+    unsigned int decim;             ///< Input samples per block.
+    firdecim_crcf decimator;        ///< FS_WS_DSP_CMD_DECIM.
+    firinterp_crcf interpolator;    ///< FS_WS_DSP_CMD_INTERP.
+    rresamp_crcf resampler;         ///< FS_WS_DSP_CMD_RESAMP.
+    size_t key_len;                 ///< Byte length of key.
+    char key[];                     ///< Design the object was built from.
+};
+
+/**
+ * @brief Rate change of a resampling command, reduced to lowest terms.
+ * @param[in]  command - DECIM, INTERP, RESAMP or DDC command.
+ * @param[out] interp  - Output samples per block.
+ * @param[out] decim   - Input samples per block.
+ * @returns 0 on success, -1 if the command is not a resampler or its factors are out of range.
+ */
+int fs_ws_dsp_resamp_factors(struct fs_ws_dsp_command *command, unsigned int *interp, unsigned int *decim);
+
+/**
+ * @brief Check out a resampler matching the command parameters, designing it on a cache miss.
+ * @details The resampler is reset before it is returned.
+ * @param[in] command - Processing request command details.
+ * @returns Resampler or NULL if the parameters are invalid or memory ran out.
+ */
+struct fs_ws_dsp_resamp *fs_ws_dsp_resamp_acquire(struct fs_ws_dsp_command *command);
+
+/**
+ * @brief Check out a resampler by its design, creating it on a cache miss.
+ * @details For stages that resample as part of a larger operation. The resampler is reset. At a rate
+ *          of 1/1 it has no liquid object and callers pass the samples through.
+ * @param[in] type   - FS_WS_DSP_CMD_DECIM, FS_WS_DSP_CMD_INTERP or FS_WS_DSP_CMD_RESAMP.
+ * @param[in] interp - Output samples per block, in lowest terms with decim.
+ * @param[in] decim  - Input samples per block.
+ * @param[in] m      - Filter semi-length.
+ * @param[in] bw     - Bandwidth, FS_WS_DSP_CMD_RESAMP only.
+ * @param[in] As     - Stop-band attenuation in dB.
+ * @returns Resampler or NULL if the design is invalid or memory ran out.
+ */
+struct fs_ws_dsp_resamp *fs_ws_dsp_resamp_design(uint32_t type, unsigned int interp, unsigned int decim,
+                                                 unsigned int m, float bw, float As);
+
+/**
+ * @brief Return a resampler to the design cache.
+ * @param[in] resamp - Resampler from fs_ws_dsp_resamp_acquire.
+ */
+void fs_ws_dsp_resamp_release(struct fs_ws_dsp_resamp *resamp);
+
+/**
+ * @brief Change the sample rate by a rational factor. Serves DECIM, INTERP and RESAMP commands.
+ * @param[in]     command  - Processing request command details.
+ * @param[in]     request  - Full request from client.
+ * @param[in out] response - Response to be sent back to client. May contain data from previous processing command.
+ */
+void fs_ws_dsp_cmd_resamp(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response);
@@ -0,0 +1,35 @@
+/**
+ * @file fs_ws_dsp_cmd_stft.h
+ * @brief Short time fourier transform: spectrogram or Welch averaged power spectrum.
+ * @details Splits the block into overlapping frames, windows and transforms each with one cached plan
+ *          per thread, and returns either every frame (a waterfall, frame after frame) or the average
+ *          power of all frames. Large blocks are spread across cores with fs_ws_dsp_fork_run.
+ *          Command parameters, all little endian:
+ *          - 0:  uint32 sample rate
+ *          - 4:  uint32 sample format (see fs_ws_dsp_convert.h)
+ *          - 8:  uint32 frame length (transform size), default 1024
+ *          - 12: uint32 hop between frame starts, default half the frame length
+ *          - 16: uint32 output, FS_WS_DSP_STFT_SPECTROGRAM or FS_WS_DSP_STFT_WELCH
+ *          - 20: spectrum parameters (see fs_ws_dsp_cmd_fft.h). The window defaults to Hann here.
+ *                Welch output is never complex, and the averaging factor applies to Welch output only.
+ *          Trailing samples that do not fill a frame are ignored. A short hop multiplies the data, so
+ *          the command fails when the output would exceed FS_WS_DSP_STFT_OUTPUT_MAX.
+ */
+
+#define FS_WS_DSP_STFT_FRAME_MAX  (1024 * 1024)
+#define FS_WS_DSP_STFT_OUTPUT_MAX (256 * 1024 * 1024) ///< Bytes of output at most, as much as a message may bring.
+#define FS_WS_DSP_STFT_GRAIN     (64 * 1024) ///< Samples of work below which frames are not split across cores.
+
+/**
+ * STFT outputs.
+ */
+const static uint32_t FS_WS_DSP_STFT_SPECTROGRAM = 0; ///< Every frame, in order.
+const static uint32_t FS_WS_DSP_STFT_WELCH = 1;       ///< Average power over all frames.
+
+/**
+ * @brief Short time fourier transform.
+ * @param[in]     command  - Processing request command details.
+ * @param[in]     request  - Full request from client.
+ * @param[in out] response - Response to be sent back to client. May contain data from previous processing command.
+ */
+void fs_ws_dsp_cmd_stft(struct fs_ws_dsp_command *command, struct fs_ws_dsp_message request, struct fs_ws_dsp_message *response);
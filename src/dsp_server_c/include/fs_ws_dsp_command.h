@@ -9,6 +9,14 @@
 const static uint8_t FS_WS_DSP_CMD_ECHO = 1;
 const static uint8_t FS_WS_DSP_CMD_FFT = 2;
 const static uint8_t FS_WS_DSP_CMD_FIRFILT = 3;
+const static uint8_t FS_WS_DSP_CMD_FASTFILT = 4;
+const static uint8_t FS_WS_DSP_CMD_CONVERT = 5;
+const static uint8_t FS_WS_DSP_CMD_STFT = 6;
+const static uint8_t FS_WS_DSP_CMD_DECIM = 7;
+const static uint8_t FS_WS_DSP_CMD_INTERP = 8;
+const static uint8_t FS_WS_DSP_CMD_RESAMP = 9;
+const static uint8_t FS_WS_DSP_CMD_DDC = 10;
+const static uint8_t FS_WS_DSP_CMD_CHANNELIZE = 11;
 
 /**
  * @brief Signal processing to transform data with.
@@ -17,10 +25,30 @@ struct fs_ws_dsp_command {
     uint32_t type;       ///< Type of processing request.
     uint32_t params_len; ///< Length in bytes of parameters.
     char *params;        ///< Parameter data.
+    void *state;         ///< Processing state (filters, oscillators) kept for the life of the command.
+    void (*release)(struct fs_ws_dsp_command *command); ///< Releases state. Called when the command is freed.
 };
 
+/**
+ * @brief Read an unsigned 32 bit parameter.
+ * @param[in] command  Signal processing command.
+ * @param[in] offset   Byte offset into params.
+ * @param[in] fallback Value returned when params is too short.
+ */
+uint32_t fs_ws_dsp_command_param_u32(struct fs_ws_dsp_command *command, uint32_t offset, uint32_t fallback);
+
+/**
+ * @brief Read a 32 bit float parameter.
+ * @param[in] command  Signal processing command.
+ * @param[in] offset   Byte offset into params.
+ * @param[in] fallback Value returned when params is too short.
+ */
+float fs_ws_dsp_command_param_f32(struct fs_ws_dsp_command *command, uint32_t offset, float fallback);
+
 /**
  * @brief Free memory associated with signal processing command.
+ * @details Releases any processing state the command built up. The command itself, and its params,
+ *          belong to the message it was parsed from.
  * @param[in] command Signal processing command.
  */
 struct fs_ws_dsp_command* fs_ws_dsp_command_free(struct fs_ws_dsp_command *command);
@@ -28,9 +56,13 @@ struct fs_ws_dsp_command* fs_ws_dsp_command_free(struct fs_ws_dsp_command *comma
 /**
  * @brief Parse signal processing command.
  * @details Parse binary stream of a signal processing command into fs_ws_dsp_command structure.
- * @param[in] stream Serialized signal processing command.
+ *          Params point into stream, they are not copied.
+ * @param[out] command Parsed command.
+ * @param[in]  stream Serialized signal processing command.
+ * @param[in]  stream_len Bytes available in stream.
+ * @returns Bytes used by the command, or -1 if it does not fit in stream_len.
  */
-struct fs_ws_dsp_command* fs_ws_dsp_command_parse(char *stream);
+int fs_ws_dsp_command_parse(struct fs_ws_dsp_command *command, char *stream, size_t stream_len);
 
 /**
  * @brief Serialize signal processing command to a single memory array.
@@ -0,0 +1,76 @@
+/**
+ * @file fs_ws_dsp_convert.h
+ * @brief Conversion of raw interleaved IQ input to float complex samples.
+ * @details The sample format is the "sample size" parameter every command carries at offset 4. The
+ *          original values 1, 2 and 4 keep their meaning as the byte size of one I (or Q) value.
+ *          Kernels are picked once, at first use, for the best instruction set the CPU supports.
+ */
+
+/**
+ * Sample formats.
+ * - INT8:     signed 8 bit I, signed 8 bit Q.
+ * - INT16:    signed 16 bit little endian I, then Q.
+ * - FLOAT32:  32 bit float I, then Q.
+ * - PACKED12: signed 12 bit I and Q in 3 bytes: b0 = I[7:0], b1 = Q[3:0] << 4 | I[11:8], b2 = Q[11:4].
+ * - UINT8:    offset binary 8 bit I, then Q, 128 is zero (RTL-SDR style).
+ */
+const static uint32_t FS_WS_DSP_FORMAT_INT8 = 1;
+const static uint32_t FS_WS_DSP_FORMAT_INT16 = 2;
+const static uint32_t FS_WS_DSP_FORMAT_FLOAT32 = 4;
+const static uint32_t FS_WS_DSP_FORMAT_PACKED12 = 12;
+const static uint32_t FS_WS_DSP_FORMAT_UINT8 = 17;
+
+/**
+ * @brief Converts count interleaved I and Q values (twice the number of samples) to float.
+ * @param[in]  src   - Raw input, any alignment.
+ * @param[out] dst   - count floats.
+ * @param[in]  count - Number of values.
+ * @param[in]  scale - Factor applied to every value.
+ */
+typedef void (*fs_ws_dsp_convert_kernel)(const void *src, float *dst, size_t count, float scale);
+
+/**
+ * @brief Bytes of one IQ sample in a format.
+ * @param[in] format - Sample format.
+ * @returns Bytes per sample, or 0 for an unknown format.
+ */
+unsigned int fs_ws_dsp_format_frame(uint32_t format);
+
+/**
+ * @brief Convert raw IQ input to float complex samples.
+ * @details Trailing bytes that do not make up a whole sample are ignored.
+ * @param[in]  format  - Sample format.
+ * @param[in]  src     - Raw input.
+ * @param[in]  src_len - Byte length of src.
+ * @param[out] x       - Converted samples, src_len / fs_ws_dsp_format_frame(format) long.
+ * @param[in]  scale   - Factor applied to every value, 1 keeps the integer range.
+ * @returns Number of samples converted.
+ */
+unsigned int fs_ws_dsp_convert(uint32_t format, const void *src, size_t src_len, float _Complex *x, float scale);
+
+/**
+ * @brief Subtract the mean of a block of samples from each of them.
+ * @param[in out] x     - Samples.
+ * @param[in]     n_len - Number of samples.
+ */
+void fs_ws_dsp_convert_dc(float _Complex *x, unsigned int n_len);
+
+/**
+ * @brief Scale a block of samples in place.
+ * @param[in out] x     - Samples.
+ * @param[in]     n_len - Number of samples.
+ * @param[in]     scale - Factor.
+ */
+void fs_ws_dsp_convert_scale(float _Complex *x, unsigned int n_len, float scale);
+
+/**
+ * @brief Force the kernel set, ie to compare them in a benchmark.
+ * @param[in] isa - "scalar", "sse2" or "avx2".
+ * @returns 0 on success, -1 if the CPU or build does not support it.
+ */
+int fs_ws_dsp_convert_select(const char *isa);
+
+/**
+ * @brief Name of the kernel set in use.
+ */
+const char *fs_ws_dsp_convert_isa();
@@ -0,0 +1,65 @@
+/**
+ * @file fs_ws_dsp_fft.h
+ * @brief Process wide cache of FFT plans.
+ * @details Liquid binds a plan to its input and output arrays when the plan is created, and creating
+ *          the plan costs more than running it at the sizes clients send. Plans are kept together with
+ *          their arrays, keyed by length, direction and flags, and checked out by one thread at a time.
+ */
+
+#include <liquid/liquid.h>
+
+#define FS_WS_DSP_FFT_CACHE_PLANS 64
+#define FS_WS_DSP_FFT_CACHE_BYTES (64 * 1024 * 1024)
+
+/**
+ * @brief FFT plan with the arrays it was created against.
+ */
+struct fs_ws_dsp_fft_plan {
+    unsigned int n;      ///< Transform length.
+    int direction;       ///< LIQUID_FFT_FORWARD or LIQUID_FFT_BACKWARD.
+    int flags;           ///< Liquid FFT flags.
+    float _Complex *x;   ///< Input array, n samples.
+    float _Complex *y;   ///< Output array, n samples.
+    fftplan plan;        ///< Liquid plan bound to x and y.
+};
+
+/**
+ * @brief Check out a plan, creating it on a cache miss.
+ * @details Fill plan->x, call fft_execute(plan->plan), read plan->y, then release the plan.
+ * @param[in] n         - Transform length.
+ * @param[in] direction - LIQUID_FFT_FORWARD or LIQUID_FFT_BACKWARD.
+ * @param[in] flags     - Liquid FFT flags.
+ * @returns Plan or NULL if out of memory.
+ */
+struct fs_ws_dsp_fft_plan *fs_ws_dsp_fft_plan_acquire(unsigned int n, int direction, int flags);
+
+/**
+ * @brief Return a plan to the cache.
+ * @param[in] plan - Plan from fs_ws_dsp_fft_plan_acquire.
+ */
+void fs_ws_dsp_fft_plan_release(struct fs_ws_dsp_fft_plan *plan);
+
+/**
+ * @brief Create forward plans ahead of the first request.
+ * @param[in] sizes - Transform lengths.
+ * @param[in] count - Number of sizes.
+ */
+void fs_ws_dsp_fft_warm(const unsigned int *sizes, unsigned int count);
+
+/**
+ * @brief Change how many plans, and how many bytes of plan arrays, the cache keeps.
+ * @param[in] plans     - Maximum number of idle plans. 0 disables caching.
+ * @param[in] max_bytes - Maximum bytes of plan arrays. 0 is unbounded.
+ */
+void fs_ws_dsp_fft_cache_bound(unsigned int plans, size_t max_bytes);
+
+/**
+ * @brief Read plan cache hit and miss counters.
+ * @param[out] stats - Counters.
+ */
+void fs_ws_dsp_fft_cache_stats(struct fs_ws_dsp_cache_stats *stats);
+
+/**
+ * @brief Destroy every cached plan.
+ */
+void fs_ws_dsp_fft_cache_clear();
@@ -0,0 +1,38 @@
+/**
+ * @file fs_ws_dsp_fork.h
+ * @brief Fork-join helper threads that split one large processing stage across cores.
+ * @details The calling thread always works on its own task, so a fork never waits on helpers that are
+ *          busy elsewhere; helpers only make it finish sooner. With no helpers every range runs inline.
+ */
+
+#define FS_WS_DSP_FORK_THREADS_MAX 256
+
+/**
+ * @brief Body of a fork.
+ * @param[in] arg   - Argument given to fs_ws_dsp_fork_run.
+ * @param[in] begin - First index of the range.
+ * @param[in] end   - One past the last index.
+ */
+typedef void (*fs_ws_dsp_fork_fn)(void *arg, unsigned int begin, unsigned int end);
+
+/**
+ * @brief Start helper threads.
+ * @param[in] threads - Number of helpers. 0 runs every fork on the calling thread.
+ * @returns 0 on success, -1 if threads could not be created.
+ */
+int fs_ws_dsp_fork_start(unsigned int threads);
+
+/**
+ * @brief Run fn over 0..count in ranges of grain indices, on the calling thread and any idle helpers.
+ * @details Returns once every range has run. Ranges start on multiples of grain.
+ * @param[in] count - Number of indices.
+ * @param[in] grain - Indices per range, at least 1.
+ * @param[in] fn    - Body, called concurrently for disjoint ranges.
+ * @param[in] arg   - Passed to fn.
+ */
+void fs_ws_dsp_fork_run(unsigned int count, unsigned int grain, fs_ws_dsp_fork_fn fn, void *arg);
+
+/**
+ * @brief Stop and join the helper threads.
+ */
+void fs_ws_dsp_fork_stop();
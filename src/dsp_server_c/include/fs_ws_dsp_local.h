@@ -0,0 +1,58 @@
+/**
+ * @file fs_ws_dsp_local.h
+ * @brief Shared memory transport for clients on the server host.
+ * @details A local client connects to a SOCK_SEQPACKET unix socket and attaches a memfd, sealed
+ *          against shrinking, by sending FS_WS_DSP_LOCAL_ATTACH with the descriptor. From then on it
+ *          writes serialized messages into the shared memory and sends FS_WS_DSP_LOCAL_REQUEST frames
+ *          pointing at them, along with the range the response may be written to. The server parses
+ *          and processes the message where it lies, writes the serialized response into the range and
+ *          answers with FS_WS_DSP_LOCAL_RESPONSE. Messages and responses have the websocket format,
+ *          streams and capture requests included. How the client lays out the memory, ie as request
+ *          and response rings, is up to the client; it must not touch a range while the server uses it.
+ *          A client that does anyway only garbles its own results: the server reads every field of a
+ *          message once into memory of its own before using it, and does not cache results of shared
+ *          data. Only the user running the server may connect.
+ *          Each client is served by a thread of its own, one request at a time and in order. Topics,
+ *          see fs_ws_dsp_topic.h, are only served over the websocket.
+ */
+
+#define FS_WS_DSP_LOCAL_CLIENTS_MAX 64 ///< Most local clients connected at once.
+
+/**
+ * Frame operations.
+ * - ATTACH:   client, with a memfd as SCM_RIGHTS. Replaces the shared memory. Answered by ATTACH with
+ *             len the size of the memory, or ERROR.
+ * - REQUEST:  client. Message of len bytes at offset, response to go to out_size bytes at out_offset.
+ * - RESPONSE: server. Response of len bytes at offset.
+ * - ERROR:    server. The request id was malformed or refused, or, with out_size set, its response
+ *             needs out_size bytes.
+ */
+const static uint32_t FS_WS_DSP_LOCAL_ATTACH = 1;
+const static uint32_t FS_WS_DSP_LOCAL_REQUEST = 2;
+const static uint32_t FS_WS_DSP_LOCAL_RESPONSE = 3;
+const static uint32_t FS_WS_DSP_LOCAL_ERROR = 4;
+
+/**
+ * @brief Control frame exchanged over the unix socket. Offsets are relative to the shared memory.
+ */
+struct fs_ws_dsp_local_frame {
+    uint32_t op;         ///< Frame operation.
+    uint32_t id;         ///< Id of the message the frame is about.
+    uint64_t offset;     ///< Start of the message or response.
+    uint64_t len;        ///< Byte length of the message or response.
+    uint64_t out_offset; ///< Request: start of the room for the response.
+    uint64_t out_size;   ///< Request: byte length of that room. Error: bytes the response needs.
+};
+
+/**
+ * @brief Listen for local clients.
+ * @details Replaces a stale socket left at path. Clients are served until fs_ws_dsp_local_stop.
+ * @param[in] path Unix socket path.
+ * @returns 0 on success, -1 if the socket cannot be created.
+ */
+int fs_ws_dsp_local_start(const char *path);
+
+/**
+ * @brief Stop listening, disconnect every local client and wait for their threads.
+ */
+void fs_ws_dsp_local_stop();
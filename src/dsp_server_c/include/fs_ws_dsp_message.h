@@ -3,6 +3,60 @@
  * @brief Websocket server subprotocol for digital signal processing messages
  */
 
+/**
+ * Message format versions.
+ * - REQUEST:      version, id, commands_count, commands, data_len, data.
+ * - STREAM_OPEN:  as REQUEST. Builds the command chain once and keeps it, with its filter state, under
+ *                 the id as stream handle. Data, if any, is processed as the first block of the stream.
+ * - STREAM_DATA:  version, id, stream, data_len, data. Runs data through the chain of an open stream.
+ * - STREAM_CLOSE: version, id, stream. Releases the stream.
+ * - CAPTURE:      version, id, commands_count, commands, name_len, name, offset (uint64), data_len.
+ *                 As REQUEST, with the data read from a capture file on the server instead of sent
+ *                 along, see fs_ws_dsp_capture.h. data_len 0 reads to the end of the file.
+ * - BATCH:        version, id, data_len, data. Data packs sub-messages, each a uint32 byte length and
+ *                 a REQUEST or CAPTURE message. Answered by one BATCH response whose data holds the
+ *                 responses of the sub-messages back to back, in order.
+ * - PUBLISH:      version, id, commands_count, commands, name_len, name, data_len, data. As STREAM_OPEN,
+ *                 but the results of every block of the stream go to the subscribers of the topic it
+ *                 names, see fs_ws_dsp_topic.h. The publisher gets a response without data per block.
+ *                 The stream is fed with STREAM_DATA and closed with STREAM_CLOSE as usual.
+ * - SUBSCRIBE:    version, id, name_len, name. Answered with the 4 byte topic id as data. From then on
+ *                 the results published to the topic arrive as responses of version SUBSCRIBE with
+ *                 the topic id as id. Results the subscriber is too slow for are dropped.
+ * - UNSUBSCRIBE:  version, id, topic id. Stops the results of the topic.
+ * - SCHEDULED:    version, priority, deadline, then a whole REQUEST, CAPTURE or BATCH message. Runs the
+ *                 message ahead of queued work of lower priority, see FS_WS_DSP_PRIORITIES. A deadline
+ *                 other than 0 gives the milliseconds from receipt after which the result is no longer
+ *                 wanted. Parsed as the message it wraps, with priority and deadline filled in.
+ * - CANCEL:       version, id, request id. The result of the request is no longer wanted. Not answered.
+ * Responses are always version, id, data_len, data. A request whose result is dropped because it was
+ * cancelled or ran past its deadline is answered by a response of version CANCEL without data. A request
+ * a command fails on, such as for parameters it cannot be designed with, is not answered.
+ */
+const static uint8_t FS_WS_DSP_MSG_REQUEST = 1;
+const static uint8_t FS_WS_DSP_MSG_STREAM_OPEN = 2;
+const static uint8_t FS_WS_DSP_MSG_STREAM_DATA = 3;
+const static uint8_t FS_WS_DSP_MSG_STREAM_CLOSE = 4;
+const static uint8_t FS_WS_DSP_MSG_CAPTURE = 5;
+const static uint8_t FS_WS_DSP_MSG_BATCH = 6;
+const static uint8_t FS_WS_DSP_MSG_PUBLISH = 7;
+const static uint8_t FS_WS_DSP_MSG_SUBSCRIBE = 8;
+const static uint8_t FS_WS_DSP_MSG_UNSUBSCRIBE = 9;
+const static uint8_t FS_WS_DSP_MSG_SCHEDULED = 10;
+const static uint8_t FS_WS_DSP_MSG_CANCEL = 11;
+
+/**
+ * Byte length of a serialized response without its data: version, id, data_len.
+ */
+#define FS_WS_DSP_MSG_HEAD_SIZE 9
+
+/**
+ * Byte length of the envelope of a SCHEDULED message: version, priority, deadline.
+ */
+#define FS_WS_DSP_MSG_SCHEDULE_SIZE 9
+
+struct fs_ws_dsp_job;
+
 /**
  * @brief Signal processing message.
  * @details Messages are exchanged between the client and server.
@@ -10,19 +64,72 @@
 struct fs_ws_dsp_message {
     uint8_t _version;                    ///< Version of the request format.
     uint32_t id;                         ///< Each request must have a unique tracking identifier.
+    uint32_t stream;                     ///< Stream handle, for stream data and close messages. Topic id to unsubscribe from. Request id to cancel.
     uint32_t commands_count;             ///< Number of commands.
     struct fs_ws_dsp_command **commands; ///< Pointer to array of command pointers.
     uint32_t data_len;                   ///< Byte length of data to be processed.
     void *data;                          ///< Data specific to the processing request.
+    char *buffer;                        ///< Receive buffer of a parsed message. Command params and data point into it.
+    struct fs_ws_dsp_arena *arena;       ///< Scratch buffers of a response. Data borrowed from it is not freed.
+    char *capture;                       ///< Capture file name of a capture request, not terminated. Points into buffer.
+    uint32_t capture_len;                ///< Byte length of the capture name.
+    uint64_t capture_offset;             ///< Byte offset of the data in the capture file.
+    void *map;                           ///< Mapping of a capture file that data points into.
+    size_t map_len;                      ///< Byte length of the mapping.
+    char *topic;                         ///< Topic name of a publish or subscribe message, not terminated. Points into buffer.
+    uint32_t topic_len;                  ///< Byte length of the topic name.
+    uint32_t priority;                   ///< Priority of a scheduled message, 0 for others.
+    uint32_t deadline;                   ///< Milliseconds from receipt a scheduled message is wanted for, 0 without deadline.
+    const struct fs_ws_dsp_job *job;     ///< Job processing the message, NULL outside the pool. Work stops once it is no longer wanted.
+    uint8_t shared;                      ///< Data lies in memory a local client may write to meanwhile. Its results are not cached.
+    uint8_t failed;                      ///< Response to a request a command failed on. Carries no data, the request is dropped.
 };
 
 /**
  * @brief Parse message.
- * @details Parse binary stream of message into fs_ws_dsp_message structure.
- * @param[in] data Signal processing message.
- * @param[in] data_len Byte length of message data.
+ * @details Parse binary stream of message into fs_ws_dsp_message structure without copying. Command
+ *          params and data point into buffer, which the message takes ownership of and frees in
+ *          fs_ws_dsp_message_free, whether or not parsing succeeds. Every length is checked against
+ *          the buffer and fields are read at any alignment.
+ * @param[out] message Parsed message.
+ * @param[in]  buffer Signal processing message. Must be allocated with malloc.
+ * @param[in]  buffer_len Byte length of buffer.
+ * @returns 0 on success, -1 if the message is malformed or memory ran out.
+ */
+int fs_ws_dsp_message_parse(struct fs_ws_dsp_message *message, char *buffer, size_t buffer_len);
+
+/**
+ * @brief Measure the part of a request message in front of its data.
+ * @details Lets a message be handled before all of its data has arrived.
+ * @param[in]  buffer     Start of a FS_WS_DSP_MSG_REQUEST or FS_WS_DSP_MSG_STREAM_OPEN message.
+ * @param[in]  buffer_len Bytes of it received so far.
+ * @param[out] data_len   Byte length of data the message announces.
+ * @returns Bytes up to and including data_len, 0 if more bytes are needed, -1 if the message is not
+ *          a request or is malformed.
+ */
+int fs_ws_dsp_message_head_size(char *buffer, size_t buffer_len, uint32_t *data_len);
+
+/**
+ * @brief Read the fixed header of a serialized message without parsing it.
+ * @param[in]  data     Serialized message.
+ * @param[in]  data_len Byte length of data.
+ * @param[out] version  Message version.
+ * @param[out] id       Message id.
+ * @details A SCHEDULED message is read as the message it wraps.
+ * @param[out] stream   Stream handle, topic id or request id, 0 for messages without one.
+ * @returns 0 on success, -1 if data is too short.
  */
-struct fs_ws_dsp_message fs_ws_dsp_message_parse(char *data, size_t data_len);
+int fs_ws_dsp_message_peek(char *data, size_t data_len, uint8_t *version, uint32_t *id, uint32_t *stream);
+
+/**
+ * @brief Read the envelope of a SCHEDULED message without parsing it.
+ * @param[in]  data     Serialized message.
+ * @param[in]  data_len Byte length of data.
+ * @param[out] priority Priority, left alone for other messages.
+ * @param[out] deadline Deadline in milliseconds from receipt, left alone for other messages.
+ * @returns 1 for a scheduled message, 0 for others, -1 if data is too short.
+ */
+int fs_ws_dsp_message_peek_schedule(char *data, size_t data_len, uint32_t *priority, uint32_t *deadline);
 
 /**
  * @brief Calculate size_t required to malloc a serialized form of signal processing message.
@@ -36,8 +143,31 @@ size_t fs_ws_dsp_message_serialize_size(struct fs_ws_dsp_message);
  */
 char *fs_ws_dsp_message_serialize(struct fs_ws_dsp_message);
 
+/**
+ * @brief Serialize signal processing message structure into memory the caller provides.
+ * @param[in]  message Signal processing message.
+ * @param[out] dest At least fs_ws_dsp_message_serialize_size bytes.
+ * @returns dest
+ */
+char *fs_ws_dsp_message_serialize_into(struct fs_ws_dsp_message message, char *dest);
+
+/**
+ * @brief Serialize everything in front of the data, for a message whose data is already in place.
+ * @param[in]  message Signal processing message.
+ * @param[out] dest FS_WS_DSP_MSG_HEAD_SIZE bytes, directly in front of message data.
+ * @returns dest
+ */
+char *fs_ws_dsp_message_serialize_head(struct fs_ws_dsp_message message, char *dest);
+
 /**
  * @brief Free memory associated with signal processing message.
  * @param[in] message Signal processing request.
  */
 void fs_ws_dsp_message_free(struct fs_ws_dsp_message message);
+
+/**
+ * @brief Free a message parsed from memory it does not own, such as part of a larger buffer.
+ * @details Releases what parsing and capture mapping added, but neither the buffer nor the data.
+ * @param[in] message Parsed message.
+ */
+void fs_ws_dsp_message_free_view(struct fs_ws_dsp_message message);
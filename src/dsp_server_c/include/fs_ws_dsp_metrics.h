@@ -0,0 +1,132 @@
+/**
+ * @file fs_ws_dsp_metrics.h
+ * @brief Counters and latency histograms, rendered in the Prometheus text format.
+ * @details Every thread that records gets a shard of its own on first use, so recording is a plain
+ *          load and store of its own counters and never contends. Rendering sums the shards. Shards
+ *          of threads that exit are folded into one kept for them. Latencies go into log-linear
+ *          histograms in the manner of HDR histograms: 4 buckets per power of two microseconds, so
+ *          any quantile is known within a quarter, from 1 microsecond to 67 seconds.
+ */
+
+#include <stdarg.h>
+
+/**
+ * Counters.
+ */
+const static uint8_t FS_WS_DSP_METRIC_RX_BYTES = 0;               ///< Websocket message bytes received.
+const static uint8_t FS_WS_DSP_METRIC_RX_MESSAGES = 1;            ///< Websocket messages received.
+const static uint8_t FS_WS_DSP_METRIC_TX_BYTES = 2;               ///< Websocket message bytes written.
+const static uint8_t FS_WS_DSP_METRIC_TX_MESSAGES = 3;            ///< Websocket messages written.
+const static uint8_t FS_WS_DSP_METRIC_SESSIONS_OPENED = 4;        ///< Websocket sessions established.
+const static uint8_t FS_WS_DSP_METRIC_SESSIONS_CLOSED = 5;        ///< Websocket sessions closed.
+const static uint8_t FS_WS_DSP_METRIC_FLOW_CONTROL = 6;           ///< Times a session stopped being read.
+const static uint8_t FS_WS_DSP_METRIC_TX_QUEUED = 7;              ///< Responses queued for writing.
+const static uint8_t FS_WS_DSP_METRIC_TX_DEQUEUED = 8;            ///< Responses written or discarded.
+const static uint8_t FS_WS_DSP_METRIC_DROP_MALFORMED = 9;         ///< Messages dropped as malformed.
+const static uint8_t FS_WS_DSP_METRIC_DROP_UNAVAILABLE = 10;      ///< Messages naming a capture or topic that is unavailable.
+const static uint8_t FS_WS_DSP_METRIC_DROP_OOM = 11;              ///< Messages or responses dropped for lack of memory.
+const static uint8_t FS_WS_DSP_METRIC_DROP_RX_TOO_LARGE = 12;     ///< Messages too large to receive.
+const static uint8_t FS_WS_DSP_METRIC_DROP_TX_QUEUE_FULL = 13;    ///< Responses dropped as the session queue was full.
+const static uint8_t FS_WS_DSP_METRIC_DROP_BAD_HANDLE = 14;       ///< Messages naming a stream or topic they cannot use.
+const static uint8_t FS_WS_DSP_METRIC_DROP_SUBSCRIBER_BEHIND = 15; ///< Published results a subscriber was too slow for.
+const static uint8_t FS_WS_DSP_METRIC_DROP_CANCELLED = 16;        ///< Results dropped as cancelled or past their deadline.
+const static uint8_t FS_WS_DSP_METRIC_DROP_FAILED = 17;           ///< Messages dropped as a command of theirs failed.
+#define FS_WS_DSP_METRICS_COUNTERS 18
+
+/**
+ * Phases of a message, each with a histogram per message version.
+ * - PARSE:     parsing the request, and mapping its capture.
+ * - QUEUE:     from receipt until a worker starts on it, waiting behind its stream included.
+ * - EXECUTE:   running its commands.
+ * - SERIALIZE: building the response, and handing it to subscribers.
+ * - WRITE:     from queueing the response until its last byte is written.
+ */
+const static uint8_t FS_WS_DSP_PHASE_PARSE = 0;
+const static uint8_t FS_WS_DSP_PHASE_QUEUE = 1;
+const static uint8_t FS_WS_DSP_PHASE_EXECUTE = 2;
+const static uint8_t FS_WS_DSP_PHASE_SERIALIZE = 3;
+const static uint8_t FS_WS_DSP_PHASE_WRITE = 4;
+#define FS_WS_DSP_METRICS_PHASES   5
+#define FS_WS_DSP_METRICS_VERSIONS 12 ///< Message versions with histograms, 0 unused.
+
+const static uint8_t FS_WS_DSP_METRICS_FUSED = 0; ///< Command histogram of stages run fused, the others go by command type.
+#define FS_WS_DSP_METRICS_COMMANDS 12
+
+#define FS_WS_DSP_METRICS_BUCKETS  101 ///< Histogram buckets: 0 to 4 us one each, 4 per power of two up to 2^26 us, overflow.
+
+/**
+ * @brief Latency histogram.
+ */
+struct fs_ws_dsp_histogram {
+    _Atomic uint64_t buckets[FS_WS_DSP_METRICS_BUCKETS]; ///< Samples per bucket.
+    _Atomic uint64_t sum;                                ///< Sum of all samples, in nanoseconds.
+};
+
+/**
+ * @brief Metrics recorded by one thread.
+ */
+struct fs_ws_dsp_metrics_shard {
+    struct fs_ws_dsp_metrics_shard *next;                                ///< Next live shard. Guarded by the metrics lock.
+    _Atomic uint64_t counters[FS_WS_DSP_METRICS_COUNTERS];               ///< Counters, written only by the owning thread.
+    struct fs_ws_dsp_histogram commands[FS_WS_DSP_METRICS_COMMANDS];     ///< Execution time per command type.
+    struct fs_ws_dsp_histogram phases[FS_WS_DSP_METRICS_PHASES][FS_WS_DSP_METRICS_VERSIONS]; ///< Phase time per message version.
+};
+
+/**
+ * @brief Growing text buffer metrics are rendered into.
+ */
+struct fs_ws_dsp_metrics_text {
+    char *data;      ///< headroom bytes, then the text. malloc'd, free when done.
+    size_t len;      ///< Byte length of the text.
+    size_t size;     ///< Bytes available for text.
+    size_t headroom; ///< Bytes reserved in front of the text.
+    uint8_t failed;  ///< Memory ran out, the text is incomplete.
+};
+
+/**
+ * @brief Monotonic clock in nanoseconds, that latencies are measured with.
+ */
+uint64_t fs_ws_dsp_metrics_now_ns();
+
+/**
+ * @brief Add to a counter of the calling thread.
+ * @param[in] counter - FS_WS_DSP_METRIC_*.
+ * @param[in] n       - Amount.
+ */
+void fs_ws_dsp_metrics_count(uint8_t counter, uint64_t n);
+
+/**
+ * @brief Record the execution time of a command.
+ * @param[in] type - Command type, or FS_WS_DSP_METRICS_FUSED.
+ * @param[in] ns   - Nanoseconds.
+ */
+void fs_ws_dsp_metrics_time_command(uint32_t type, uint64_t ns);
+
+/**
+ * @brief Record the time a message spent in one phase.
+ * @param[in] phase   - FS_WS_DSP_PHASE_*.
+ * @param[in] version - Message version. A scheduled message counts as the message it wraps.
+ * @param[in] ns      - Nanoseconds.
+ */
+void fs_ws_dsp_metrics_time_phase(uint8_t phase, uint8_t version, uint64_t ns);
+
+/**
+ * @brief Prepare an empty text buffer.
+ * @param[out] text     - Text buffer.
+ * @param[in]  headroom - Bytes to reserve in front of the text.
+ */
+void fs_ws_dsp_metrics_text_init(struct fs_ws_dsp_metrics_text *text, size_t headroom);
+
+/**
+ * @brief Append formatted text, growing the buffer. Sets failed if memory runs out.
+ * @param[in out] text   - Text buffer.
+ * @param[in]     format - printf format.
+ */
+void fs_ws_dsp_metrics_printf(struct fs_ws_dsp_metrics_text *text, const char *format, ...);
+
+/**
+ * @brief Render every counter and histogram, summed over all threads, and the cache statistics.
+ * @details Histograms without samples are left out. Callers may append metrics of their own.
+ * @param[in out] text - Text buffer.
+ */
+void fs_ws_dsp_metrics_render(struct fs_ws_dsp_metrics_text *text);
@@ -0,0 +1,155 @@
+/**
+ * @file fs_ws_dsp_pool.h
+ * @brief Worker thread pool that runs signal processing jobs off the websocket service thread.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define FS_WS_DSP_PRIORITIES       4 ///< Priority levels. Queued jobs of a higher level run first.
+#define FS_WS_DSP_PRIORITY_DEFAULT 1 ///< Level of jobs for messages that are not scheduled.
+#define FS_WS_DSP_POOL_OVERTAKE    8 ///< Jobs that may overtake a waiting lower level job before it gets a turn.
+
+struct fs_ws_dsp_job;
+struct fs_ws_dsp_worker;
+
+/**
+ * @brief Unit of work handed to the pool.
+ * @details Jobs are linked intrusively so neither the pending queue nor the completion queue allocates.
+ */
+struct fs_ws_dsp_job {
+    struct fs_ws_dsp_job *next;      ///< Link used by whichever queue currently holds the job.
+    void *owner;                     ///< Opaque to the pool. Identifies who receives the result.
+    struct fs_ws_dsp_stream *stream; ///< Stream the request belongs to, NULL for one-off requests.
+    uint8_t version;                 ///< Message version, read by the submitter.
+    uint32_t id;                     ///< Message id, read by the submitter.
+    char *request;                   ///< Serialized request message. Consumed by the job runner.
+    size_t request_len;              ///< Byte length of request.
+    char *response;                  ///< Result of the job runner, handed back through the completion queue.
+    size_t response_len;             ///< Byte length of response.
+    char *response_buffer;           ///< Pooled buffer response lives in. Return with fs_ws_dsp_buffer_put.
+    uint32_t serial;                 ///< Incremental response the job produces a fragment of, 0 for whole responses.
+    unsigned int queue;              ///< Index of the submitting thread, ie the completion queue the job returns to.
+    uint8_t first:1;                 ///< Response starts a websocket message.
+    uint8_t final:1;                 ///< Response ends a websocket message. Set on the last piece of an incremental request.
+    uint8_t shared:1;                ///< Response buffer is sent by other jobs too and must not be written to.
+    uint8_t priority;                ///< Level below FS_WS_DSP_PRIORITIES the job is queued at.
+    uint64_t deadline;               ///< fs_ws_dsp_now_ms after which the result is no longer wanted, 0 for never.
+    _Atomic uint8_t cancelled;       ///< Set by the submitter once the result is no longer wanted.
+    struct fs_ws_dsp_job *sibling;   ///< Next job of the same owner that may be cancelled. Kept by the owner.
+    struct fs_ws_dsp_job **sibling_slot; ///< Link pointing at the job while it may be cancelled, else NULL.
+    uint64_t queued_ns;              ///< fs_ws_dsp_metrics_now_ns when submitted, for its queue time.
+};
+
+/**
+ * @brief Lock-free multiple producer, single consumer completion queue.
+ * @details Workers push finished jobs; only the thread that owns the queue drains it.
+ */
+struct fs_ws_dsp_completion {
+    _Atomic(struct fs_ws_dsp_job *) head; ///< Most recently completed job (LIFO until drained).
+};
+
+/**
+ * @brief Job runner executed on a worker thread.
+ * @param[in out] job    - Job to run. Fill in response and response_len.
+ * @param[in]     worker - Worker the job is running on.
+ */
+typedef void (*fs_ws_dsp_job_run)(struct fs_ws_dsp_job *job, struct fs_ws_dsp_worker *worker);
+
+/**
+ * @brief Called on the worker thread once a job has run.
+ * @param[in] job - Finished job.
+ * @param[in] arg - Argument supplied to fs_ws_dsp_pool_start.
+ */
+typedef void (*fs_ws_dsp_job_done)(struct fs_ws_dsp_job *job, void *arg);
+
+/**
+ * @brief Per thread state of a worker.
+ */
+struct fs_ws_dsp_worker {
+    struct fs_ws_dsp_pool *pool;  ///< Pool the worker belongs to.
+    unsigned int index;           ///< Worker number, 0 based.
+    pthread_t thread;             ///< Worker thread.
+    struct fs_ws_dsp_arena arena; ///< Scratch buffers reused by every job the worker runs.
+};
+
+/**
+ * @brief Pool of worker threads sharing one pending job queue per priority level.
+ * @details Workers take the oldest job of the highest level with any queued. So that a busy level
+ *          cannot starve those below it, every FS_WS_DSP_POOL_OVERTAKE jobs the next lower level
+ *          waiting gets a turn.
+ */
+struct fs_ws_dsp_pool {
+    pthread_mutex_t lock;                  ///< Guards the pending queues and stopping flag.
+    pthread_cond_t wake;                   ///< Signalled when a job is queued or the pool stops.
+    struct fs_ws_dsp_job *pending_head[FS_WS_DSP_PRIORITIES]; ///< Oldest queued job of each level.
+    struct fs_ws_dsp_job *pending_tail[FS_WS_DSP_PRIORITIES]; ///< Newest queued job of each level.
+    unsigned int pending_count;            ///< Jobs queued at any level.
+    unsigned int overtaken;                ///< Jobs taken while a lower level waited since it last got a turn.
+    unsigned int workers_count;            ///< Number of worker threads. 0 runs jobs on the submitting thread.
+    struct fs_ws_dsp_worker *workers;      ///< Array of workers_count workers.
+    unsigned int inline_count;             ///< Number of threads that may submit jobs.
+    struct fs_ws_dsp_worker *inline_workers; ///< Worker state for jobs run on the submitting thread, one per queue.
+    fs_ws_dsp_job_run run;                 ///< Job runner.
+    fs_ws_dsp_job_done done;               ///< Completion notification.
+    void *done_arg;                        ///< Argument passed to done.
+    uint8_t stopping;                      ///< Set when workers should exit.
+};
+
+/**
+ * @brief Start worker threads.
+ * @param[out] pool          - Pool to initialize.
+ * @param[in]  workers_count - Number of threads. 0 runs every job inline in fs_ws_dsp_pool_submit.
+ * @param[in]  queues        - Number of threads that submit jobs. Jobs name theirs in job->queue.
+ * @param[in]  headroom      - Bytes every worker arena reserves in front of its buffers.
+ * @param[in]  run           - Job runner.
+ * @param[in]  done          - Called after each job has run.
+ * @param[in]  done_arg      - Argument passed to done.
+ * @returns 0 on success, -1 if threads could not be created.
+ */
+int fs_ws_dsp_pool_start(struct fs_ws_dsp_pool *pool, unsigned int workers_count, unsigned int queues, size_t headroom,
+                         fs_ws_dsp_job_run run, fs_ws_dsp_job_done done, void *done_arg);
+
+/**
+ * @brief Queue a job for the next free worker.
+ * @details Safe from any of the submitting threads. Without workers the job runs right away, with
+ *          the scratch buffers of its queue. Otherwise it waits behind the jobs of its level, and
+ *          ahead of lower levels.
+ * @param[in] pool - Worker pool.
+ * @param[in] job  - Job to run. Ownership passes to the pool until done is called.
+ */
+void fs_ws_dsp_pool_submit(struct fs_ws_dsp_pool *pool, struct fs_ws_dsp_job *job);
+
+/**
+ * @brief Stop and join all worker threads.
+ * @details Jobs still queued are run before the workers exit.
+ * @param[in] pool - Worker pool.
+ */
+void fs_ws_dsp_pool_stop(struct fs_ws_dsp_pool *pool);
+
+/**
+ * @brief Push a finished job onto a completion queue. Safe from any thread.
+ * @param[in] completion - Completion queue.
+ * @param[in] job        - Finished job.
+ */
+void fs_ws_dsp_completion_push(struct fs_ws_dsp_completion *completion, struct fs_ws_dsp_job *job);
+
+/**
+ * @brief Take every finished job from a completion queue. Only the owning thread may drain.
+ * @param[in] completion - Completion queue.
+ * @returns Linked list of jobs in completion order, or NULL if empty.
+ */
+struct fs_ws_dsp_job *fs_ws_dsp_completion_drain(struct fs_ws_dsp_completion *completion);
+
+/**
+ * @brief Monotonic clock, in milliseconds, that job deadlines are measured with.
+ */
+uint64_t fs_ws_dsp_now_ms();
+
+/**
+ * @brief Check whether the result of a job is still wanted: it is not cancelled and not past its deadline.
+ * @details Safe from any thread. Job runners check it before they start and between stages.
+ * @param[in] job - Job.
+ * @returns 1 if the job should run on, 0 if its result would be dropped.
+ */
+int fs_ws_dsp_job_wanted(const struct fs_ws_dsp_job *job);
@@ -0,0 +1,56 @@
+/**
+ * @file fs_ws_dsp_result.h
+ * @brief Process wide cache of request results.
+ * @details Retries, page reloads and several analysts looking at the same capture send identical
+ *          requests. Results are kept keyed by the commands of the request and a seeded 64 bit hash
+ *          and the length of its data, and a repeated request is answered from the cache with only
+ *          its id changed, without running any command. Off unless given a byte budget. Streams are
+ *          never cached, as their results depend on the blocks before.
+ */
+
+#define FS_WS_DSP_RESULT_CACHE_ENTRIES 65536 ///< Most results cached, whatever their size.
+
+/**
+ * @brief Cached result.
+ */
+struct fs_ws_dsp_result {
+    uint8_t version;   ///< Response version.
+    uint32_t data_len; ///< Byte length of data.
+    char data[];       ///< Response data.
+};
+
+/**
+ * @brief Snapshot of result cache counters.
+ */
+struct fs_ws_dsp_result_stats {
+    struct fs_ws_dsp_cache_stats cache; ///< Hits, misses, evictions and what is held.
+    uint64_t bytes_saved;               ///< Response bytes served from the cache.
+};
+
+/**
+ * @brief Process a REQUEST or CAPTURE message, answering from the cache where possible.
+ * @details As fs_ws_dsp_process, which it calls on a miss. The response data lives in the arena
+ *          either way.
+ * @param[in] message Parsed message.
+ * @param[in] arena Scratch buffers of the calling thread.
+ */
+struct fs_ws_dsp_message fs_ws_dsp_process_cached(struct fs_ws_dsp_message message, struct fs_ws_dsp_arena *arena);
+
+/**
+ * @brief Set how many bytes of results, keys included, the cache keeps. Picks a new hash seed.
+ * @details Call before requests are processed. Results larger than an eighth of the budget are not
+ *          cached, so one large result cannot flush all others.
+ * @param[in] max_bytes - Byte budget. 0 disables the cache.
+ */
+void fs_ws_dsp_result_cache_bound(size_t max_bytes);
+
+/**
+ * @brief Read result cache counters.
+ * @param[out] stats - Counters.
+ */
+void fs_ws_dsp_result_cache_stats(struct fs_ws_dsp_result_stats *stats);
+
+/**
+ * @brief Drop every cached result.
+ */
+void fs_ws_dsp_result_cache_clear();
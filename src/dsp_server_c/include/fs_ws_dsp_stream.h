@@ -0,0 +1,60 @@
+/**
+ * @file fs_ws_dsp_stream.h
+ * @brief Persistent command chains that carry processing state from one message to the next.
+ * @details A stream is opened with the command chain of a FS_WS_DSP_MSG_STREAM_OPEN message. Later
+ *          FS_WS_DSP_MSG_STREAM_DATA messages carry only the stream handle and samples, and are run
+ *          through the same commands, so filter history continues across message boundaries.
+ *          Blocks of one stream must be processed one at a time and in order.
+ */
+
+struct fs_ws_dsp_job;
+struct fs_ws_dsp_topic;
+
+/**
+ * @brief Open stream.
+ */
+struct fs_ws_dsp_stream {
+    struct fs_ws_dsp_stream *next;      ///< Next stream of the same session.
+    uint32_t handle;                    ///< Id of the message that opened the stream.
+    struct fs_ws_dsp_message chain;     ///< Open message. Its commands hold the processing state.
+    struct fs_ws_dsp_job *queued_head;  ///< Blocks waiting for the stream. Owned by the submitting thread.
+    struct fs_ws_dsp_job *queued_tail;  ///< Last waiting block.
+    uint32_t serial;                    ///< Non-zero for the implicit stream of a request processed as it arrives.
+    uint64_t in_left;                   ///< Implicit stream: request data bytes announced but not processed yet.
+    uint64_t out_len;                   ///< Implicit stream: response data bytes announced in the response head.
+    uint64_t out_done;                  ///< Implicit stream: response data bytes produced so far.
+    struct fs_ws_dsp_topic *topic;      ///< Topic the results go to, for a stream opened by FS_WS_DSP_MSG_PUBLISH.
+    uint8_t busy:1;                     ///< A block is being processed.
+    uint8_t closing:1;                  ///< No more blocks are accepted.
+    uint8_t head_sent;                  ///< Implicit stream: response head has been produced. Written by workers only.
+    uint8_t failed;                     ///< Implicit stream: a piece failed, the response is dropped. Written by workers only.
+};
+
+/**
+ * @brief Take over the commands of an open message and process its data, if any.
+ * @details The command params are copied out and the message buffer is freed once its data has been
+ *          processed, so the stream holds no more than its commands for the rest of its lifetime.
+ * @param[in out] stream  - Stream to open.
+ * @param[in]     request - Parsed FS_WS_DSP_MSG_STREAM_OPEN or FS_WS_DSP_MSG_PUBLISH message. Ownership
+ *                          passes to the stream.
+ * @param[in]     arena   - Scratch buffers of the calling thread.
+ * @returns Response for the open message.
+ */
+struct fs_ws_dsp_message fs_ws_dsp_stream_open(struct fs_ws_dsp_stream *stream, struct fs_ws_dsp_message request,
+                                               struct fs_ws_dsp_arena *arena);
+
+/**
+ * @brief Run one block of samples through the stream.
+ * @param[in] stream  - Open stream.
+ * @param[in] request - Parsed FS_WS_DSP_MSG_STREAM_DATA message. Still owned by the caller.
+ * @param[in] arena   - Scratch buffers of the calling thread.
+ * @returns Response for the block.
+ */
+struct fs_ws_dsp_message fs_ws_dsp_stream_process(struct fs_ws_dsp_stream *stream, struct fs_ws_dsp_message request,
+                                                  struct fs_ws_dsp_arena *arena);
+
+/**
+ * @brief Release the command chain and its processing state. Safe to call more than once.
+ * @param[in] stream - Stream.
+ */
+void fs_ws_dsp_stream_close(struct fs_ws_dsp_stream *stream);
@@ -0,0 +1,102 @@
+/**
+ * @file fs_ws_dsp_topic.h
+ * @brief Named topics that share the results of one published stream with many subscribers.
+ * @details A FS_WS_DSP_MSG_PUBLISH message opens a stream whose results go to the topic it names
+ *          rather than back to the publisher. Every block is processed once and its serialized
+ *          response is handed, as the same buffer, to each subscriber of the topic. A topic exists
+ *          while it has a publisher or subscribers, so clients may subscribe before publishing starts.
+ *          The registry is process wide and safe from any thread.
+ */
+
+#define FS_WS_DSP_TOPIC_NAME_MAX 255 ///< Longest topic name.
+
+struct fs_ws_dsp_topic;
+
+/**
+ * @brief Subscription of one owner to one topic.
+ * @details Held by the topic while subscribed, and by every frame on its way to the owner.
+ */
+struct fs_ws_dsp_subscriber {
+    struct fs_ws_dsp_subscriber *next;    ///< Next subscriber of the same topic. Guarded by the registry lock.
+    struct fs_ws_dsp_subscriber *sibling; ///< Next subscription of the same owner. Kept by the owner.
+    struct fs_ws_dsp_topic *topic;        ///< Topic subscribed to, NULL once unsubscribed.
+    uint32_t topic_id;                    ///< Id of the topic, stays valid after unsubscribing.
+    void *owner;                          ///< Opaque to the registry. Receives the frames.
+    unsigned int queue;                   ///< Opaque to the registry. Completion queue of the owner.
+    _Atomic unsigned int refs;            ///< Topic membership plus frames in flight.
+};
+
+/**
+ * @brief Named topic.
+ */
+struct fs_ws_dsp_topic {
+    struct fs_ws_dsp_topic *next;             ///< Next topic of the registry.
+    char name[FS_WS_DSP_TOPIC_NAME_MAX];      ///< Name, not terminated.
+    uint32_t name_len;                        ///< Byte length of name.
+    uint32_t id;                              ///< Server assigned id, unique among topics ever created.
+    unsigned int refs;                        ///< Publisher plus subscribers. Guarded by the registry lock.
+    uint8_t published:1;                      ///< A stream publishes to the topic.
+    struct fs_ws_dsp_subscriber *subscribers; ///< Subscribers. Guarded by the registry lock.
+};
+
+/**
+ * @brief Called for each subscriber of a topic while a frame is published.
+ * @details Runs with the registry locked, so must not call back into it. Take a reference on the
+ *          subscriber with fs_ws_dsp_subscriber_hold for as long as the frame refers to it.
+ * @param[in] subscriber - Subscriber.
+ * @param[in] arg        - Argument passed to fs_ws_dsp_topic_fanout.
+ */
+typedef void (*fs_ws_dsp_topic_frame)(struct fs_ws_dsp_subscriber *subscriber, void *arg);
+
+/**
+ * @brief Become the publisher of a topic, creating it if needed.
+ * @param[in] name     - Topic name.
+ * @param[in] name_len - Byte length of name, 1 to FS_WS_DSP_TOPIC_NAME_MAX.
+ * @returns Topic, or NULL if the name is invalid, already published or memory ran out.
+ */
+struct fs_ws_dsp_topic *fs_ws_dsp_topic_publish(const char *name, uint32_t name_len);
+
+/**
+ * @brief Stop publishing. The topic goes away with its last subscriber.
+ * @param[in] topic - Topic from fs_ws_dsp_topic_publish, or NULL.
+ */
+void fs_ws_dsp_topic_unpublish(struct fs_ws_dsp_topic *topic);
+
+/**
+ * @brief Subscribe to a topic, creating it if needed.
+ * @param[in] name     - Topic name.
+ * @param[in] name_len - Byte length of name, 1 to FS_WS_DSP_TOPIC_NAME_MAX.
+ * @param[in] owner    - Receiver of the frames.
+ * @param[in] queue    - Completion queue of the owner.
+ * @returns Subscription, or NULL if the name is invalid or memory ran out.
+ */
+struct fs_ws_dsp_subscriber *fs_ws_dsp_topic_subscribe(const char *name, uint32_t name_len, void *owner,
+                                                       unsigned int queue);
+
+/**
+ * @brief Leave the topic. Frames already on their way keep the subscription until released.
+ * @details Only the owner may unsubscribe, and only once.
+ * @param[in] subscriber - Subscription.
+ */
+void fs_ws_dsp_topic_unsubscribe(struct fs_ws_dsp_subscriber *subscriber);
+
+/**
+ * @brief Call frame for every current subscriber of a topic.
+ * @param[in] topic - Published topic.
+ * @param[in] frame - Called once per subscriber.
+ * @param[in] arg   - Passed to frame.
+ * @returns Number of subscribers.
+ */
+unsigned int fs_ws_dsp_topic_fanout(struct fs_ws_dsp_topic *topic, fs_ws_dsp_topic_frame frame, void *arg);
+
+/**
+ * @brief Take a reference on a subscription. Safe from any thread.
+ * @param[in] subscriber - Subscription.
+ */
+void fs_ws_dsp_subscriber_hold(struct fs_ws_dsp_subscriber *subscriber);
+
+/**
+ * @brief Release a reference on a subscription, freeing it with the last one. Safe from any thread.
+ * @param[in] subscriber - Subscription.
+ */
+void fs_ws_dsp_subscriber_release(struct fs_ws_dsp_subscriber *subscriber);
@@ -0,0 +1,45 @@
+/**
+ * @file fs_ws_dsp_window.h
+ * @brief Process wide cache of spectral analysis windows.
+ * @details Windows are periodic (DFT-even), which is what spectral estimates want, and are cached by
+ *          type, length and shape parameter like the FFT plans they are used with. Windows longer
+ *          than an eighth of the byte budget are computed for each use instead of crowding out the rest.
+ */
+
+#define FS_WS_DSP_WINDOW_CACHE 32
+#define FS_WS_DSP_WINDOW_CACHE_BYTES (16 * 1024 * 1024)
+
+/**
+ * Window types.
+ */
+const static uint32_t FS_WS_DSP_WINDOW_NONE = 0;
+const static uint32_t FS_WS_DSP_WINDOW_HANN = 1;
+const static uint32_t FS_WS_DSP_WINDOW_BLACKMANHARRIS = 2;
+const static uint32_t FS_WS_DSP_WINDOW_KAISER = 3;
+
+/**
+ * @brief Window coefficients checked out of the cache.
+ */
+struct fs_ws_dsp_window {
+    uint32_t type;  ///< Window type.
+    unsigned int n; ///< Number of coefficients.
+    float beta;     ///< Kaiser shape parameter, 0 for other types.
+    float sum;      ///< Sum of the coefficients (coherent gain times n).
+    float power;    ///< Sum of the squared coefficients.
+    float w[];      ///< Coefficients.
+};
+
+/**
+ * @brief Check out a window, computing it on a cache miss.
+ * @param[in] type - Window type, not FS_WS_DSP_WINDOW_NONE.
+ * @param[in] n    - Length.
+ * @param[in] beta - Kaiser shape parameter, ignored for other types.
+ * @returns Window or NULL if the type is unknown or memory ran out.
+ */
+struct fs_ws_dsp_window *fs_ws_dsp_window_acquire(uint32_t type, unsigned int n, float beta);
+
+/**
+ * @brief Return a window to the cache.
+ * @param[in] window - Window from fs_ws_dsp_window_acquire.
+ */
+void fs_ws_dsp_window_release(struct fs_ws_dsp_window *window);
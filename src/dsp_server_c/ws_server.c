@@ -3,21 +3,55 @@
 #include <libwebsockets.h>
 #include <string.h>
 #include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
 
 #define LWS_PLUGIN_STATIC
 #include "ws_server_dsp.c"
 
 static struct lws_protocols protocols[] = {
 	LWS_PLUGIN_PROTOCOL_MINIMAL_SERVER_ECHO,
+	LWS_PLUGIN_PROTOCOL_DSP_METRICS,
 	{ NULL, NULL, 0, 0 } /* terminator */
 };
 
-static int interrupted, port = 7681, options;
+static int interrupted, port = 7681, options, workers = -1, fork_threads = -1, service_threads = 1;
+static struct lws_context *context;
+static int tx_fragment = 64 * 1024, tx_backlog = 64 * 1024 * 1024, tx_budget = 1024 * 1024 * 1024;
 
 /* pass pointers to shared vars to the protocol */
 
-static const struct lws_protocol_vhost_options pvo_options = {
+static const struct lws_protocol_vhost_options pvo_tx_budget = {
+	NULL,
+	NULL,
+	"tx_budget",		/* pvo name */
+	(void *)&tx_budget	/* pvo value */
+};
+
+static const struct lws_protocol_vhost_options pvo_tx_backlog = {
+	&pvo_tx_budget,
+	NULL,
+	"tx_backlog",		/* pvo name */
+	(void *)&tx_backlog	/* pvo value */
+};
+
+static const struct lws_protocol_vhost_options pvo_tx_fragment = {
+	&pvo_tx_backlog,
+	NULL,
+	"tx_fragment",		/* pvo name */
+	(void *)&tx_fragment	/* pvo value */
+};
+
+static const struct lws_protocol_vhost_options pvo_workers = {
+	&pvo_tx_fragment,
 	NULL,
+	"workers",		/* pvo name */
+	(void *)&workers	/* pvo value */
+};
+
+static const struct lws_protocol_vhost_options pvo_options = {
+	&pvo_workers,
 	NULL,
 	"options",		/* pvo name */
 	(void *)&options	/* pvo value */
@@ -36,6 +70,14 @@ static const struct lws_protocol_vhost_options pvo = {
 	"lws-minimal-server-echo",	/* protocol name we belong to on this vhost */
 	""				/* ignored */
 };
+/* HTTP GET /metrics is answered by the metrics protocol. */
+static const struct lws_http_mount metrics_mount = {
+	.mountpoint		= "/metrics",
+	.origin			= "fs-ws-dsp-metrics",
+	.origin_protocol	= LWSMPRO_CALLBACK,
+	.mountpoint_len		= 8,
+};
+
 static const struct lws_extension extensions[] = {
 	// {
 	// 	"permessage-deflate",
@@ -50,13 +92,67 @@ static const struct lws_extension extensions[] = {
 void sigint_handler(int sig)
 {
 	interrupted = 1;
+	/* Wake every service thread, not just the one the signal landed on. */
+	if (context)
+		lws_cancel_service(context);
+}
+
+/* Serve connections of service thread tsi until interrupted. Thread 0 is the main thread. */
+static void *service_thread(void *tsi)
+{
+	int n = 0;
+
+	while (n >= 0 && !interrupted)
+		n = lws_service_tsi(context, 0, (int)(intptr_t)tsi);
+	return NULL;
+}
+
+/* Read the value of a numeric option. A value that is not wholly a decimal number from min to max
+ * is refused, rather than read as 0 or wrapped around. */
+static int option_number(const char *name, const char *p, long long min, long long max, long long *value)
+{
+	char *end;
+
+	errno = 0;
+	*value = strtoll(p, &end, 10);
+	if (end == p || *end || errno || *value < min || *value > max) {
+		lwsl_err("%s takes a number from %lld to %lld, not \"%s\"\n", name, min, max, p);
+		return -1;
+	}
+	return 0;
+}
+
+/* Build FFT plans for a comma separated list of sizes, ie "1024,4096,65536". */
+static int fft_warm(const char *list)
+{
+	unsigned int sizes[64];
+	unsigned int count = 0;
+	char *end;
+	unsigned long size;
+
+	while (*list && count < sizeof(sizes) / sizeof(sizes[0])) {
+		errno = 0;
+		size = strtoul(list, &end, 10);
+		if (end == list || errno || size == 0 || size > FS_WS_DSP_STFT_FRAME_MAX || (*end && *end != ',')) {
+			lwsl_err("--fft-warm takes sizes from 1 to %d separated by commas\n", FS_WS_DSP_STFT_FRAME_MAX);
+			return -1;
+		}
+		sizes[count++] = (unsigned int)size;
+		list = (*end == ',') ? end + 1 : end;
+	}
+	fs_ws_dsp_fft_warm(sizes, count);
+	lwsl_user("Prepared %u FFT plans\n", count);
+	return 0;
 }
 
 int main(int argc, const char **argv)
 {
 	struct lws_context_creation_info info;
-	struct lws_context *context;
+	struct fs_ws_dsp_cache_stats fft_stats;
+	struct fs_ws_dsp_result_stats result_stats;
+	pthread_t threads[64];
 	const char *p;
+	long long value;
 	int n = 0, logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE
 			/* for LLL_ verbosity above NOTICE to be built into lws,
 			 * lws must have been configured and built with
@@ -67,27 +163,119 @@ int main(int argc, const char **argv)
 
 	signal(SIGINT, sigint_handler);
 
-	if ((p = lws_cmdline_option(argc, argv, "-d")))
-		logs = atoi(p);
+	if ((p = lws_cmdline_option(argc, argv, "-d"))) {
+		if (option_number("-d", p, 0, INT_MAX, &value))
+			return 1;
+		logs = (int)value;
+	}
 
 	lws_set_log_level(logs, NULL);
 	lwsl_user("LWS minimal ws client echo + permessage-deflate + multifragment bulk message\n");
-	lwsl_user("   lws-minimal-ws-client-echo [-n (no exts)] [-p port] [-o (once)]\n");
+	lwsl_user("   lws-minimal-ws-client-echo [-n (no exts)] [-p port] [-o (once)] [-w dsp workers]\n");
+	lwsl_user("   [--fft-plans cached plans] [--fft-warm size,size,...] [--fastfilt-crossover taps]\n");
+	lwsl_user("   [--tx-fragment bytes] [--tx-backlog bytes] [--tx-budget bytes] [--fork-threads threads]\n");
+	lwsl_user("   [--capture-dir directory] [--local-socket path] [-t service threads] [--result-cache bytes]\n");
+	lwsl_user("   [--metrics (serve GET /metrics)]\n");
+	lwsl_user("Sample conversion kernels: %s\n", fs_ws_dsp_convert_isa());
 
 
-	if ((p = lws_cmdline_option(argc, argv, "-p")))
-		port = atoi(p);
+	if ((p = lws_cmdline_option(argc, argv, "-p"))) {
+		if (option_number("-p", p, 0, 65535, &value))
+			return 1;
+		port = (int)value;
+	}
 
 	if (lws_cmdline_option(argc, argv, "-o"))
 		options |= 1;
 
+	/* Default to one dsp worker per core. 0 runs dsp on the service thread. */
+	if ((p = lws_cmdline_option(argc, argv, "-w"))) {
+		if (option_number("-w", p, -1, 1024, &value))
+			return 1;
+		workers = (int)value;
+	}
+	if (workers < 0)
+		workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers < 0)
+		workers = 0;
+
+	if ((p = lws_cmdline_option(argc, argv, "--fft-plans"))) {
+		if (option_number("--fft-plans", p, 0, UINT_MAX, &value))
+			return 1;
+		fs_ws_dsp_fft_cache_bound((unsigned int)value, FS_WS_DSP_FFT_CACHE_BYTES);
+	}
+	if ((p = lws_cmdline_option(argc, argv, "--fft-warm")) && fft_warm(p))
+		return 1;
+	if ((p = lws_cmdline_option(argc, argv, "--fastfilt-crossover"))) {
+		if (option_number("--fastfilt-crossover", p, 0, UINT_MAX, &value))
+			return 1;
+		fs_ws_dsp_fastfilt_crossover((unsigned int)value);
+	}
+	/* Repeated requests are answered from up to this many bytes of earlier results. */
+	if ((p = lws_cmdline_option(argc, argv, "--result-cache"))) {
+		if (option_number("--result-cache", p, 0, LLONG_MAX, &value))
+			return 1;
+		fs_ws_dsp_result_cache_bound((size_t)value);
+	}
+
+	/* Responses are written in fragments of tx_fragment bytes, 0 writes them whole. A session
+	 * stops being read while more than tx_backlog bytes of its responses are waiting to be sent. */
+	if ((p = lws_cmdline_option(argc, argv, "--tx-fragment"))) {
+		if (option_number("--tx-fragment", p, 0, INT_MAX, &value))
+			return 1;
+		tx_fragment = (int)value;
+	}
+	if ((p = lws_cmdline_option(argc, argv, "--tx-backlog"))) {
+		if (option_number("--tx-backlog", p, 0, INT_MAX, &value))
+			return 1;
+		tx_backlog = (int)value;
+	}
+	/* Sessions with responses queued also stop being read while all sessions together hold more
+	 * than tx_budget bytes of responses. */
+	if ((p = lws_cmdline_option(argc, argv, "--tx-budget"))) {
+		if (option_number("--tx-budget", p, 0, INT_MAX, &value))
+			return 1;
+		tx_budget = (int)value;
+	}
+
+	/* Large STFT blocks are split across helper threads, one less than the cores by default as
+	 * the thread that forks works too. 0 keeps every command on one thread. */
+	if ((p = lws_cmdline_option(argc, argv, "--fork-threads"))) {
+		if (option_number("--fork-threads", p, -1, FS_WS_DSP_FORK_THREADS_MAX, &value))
+			return 1;
+		fork_threads = (int)value;
+	}
+	if (fork_threads < 0)
+		fork_threads = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	if (fork_threads > 0 && fs_ws_dsp_fork_start((unsigned int)fork_threads))
+		lwsl_warn("Could not start %d fork threads\n", fork_threads);
+
+	/* Capture requests may only read files directly inside this directory. */
+	if ((p = lws_cmdline_option(argc, argv, "--capture-dir")) && fs_ws_dsp_capture_dir(p))
+		lwsl_warn("Could not open capture directory %s\n", p);
+
+	/* Clients on this host may exchange messages through shared memory instead of the websocket. */
+	if ((p = lws_cmdline_option(argc, argv, "--local-socket")) && fs_ws_dsp_local_start(p))
+		lwsl_warn("Could not listen on local socket %s\n", p);
+
+	/* Connections are spread over this many threads, each with its own lws service loop. */
+	if ((p = lws_cmdline_option(argc, argv, "-t"))) {
+		if (option_number("-t", p, 1, (long long)(sizeof(threads) / sizeof(threads[0])), &value))
+			return 1;
+		service_threads = (int)value;
+	}
+
 	memset(&info, 0, sizeof info); /* otherwise uninitialized garbage */
 	info.port = port;
 	info.protocols = protocols;
 	info.pvo = &pvo;
 	if (!lws_cmdline_option(argc, argv, "-n"))
 		info.extensions = extensions;
+	/* Counters and latency histograms for Prometheus, off unless asked for. */
+	if (lws_cmdline_option(argc, argv, "--metrics"))
+		info.mounts = &metrics_mount;
 	info.pt_serv_buf_size = 32 * 1024;
+	info.count_threads = (unsigned int)service_threads;
 	info.options = LWS_SERVER_OPTION_VALIDATE_UTF8 |
 		LWS_SERVER_OPTION_HTTP_HEADERS_SECURITY_BEST_PRACTICES_ENFORCE;
 
@@ -97,10 +285,37 @@ int main(int argc, const char **argv)
 		return 1;
 	}
 
-	while (n >= 0 && !interrupted)
-		n = lws_service(context, 0);
+	/* lws may have been built for fewer threads than asked for. */
+	service_threads = lws_get_count_threads(context);
+	lwsl_user("Serving on %d threads\n", service_threads);
+	for (n = 1; n < service_threads; n++)
+		if (pthread_create(&threads[n], NULL, service_thread, (void *)(intptr_t)n)) {
+			lwsl_err("Could not start service thread %d\n", n);
+			interrupted = 1;
+			break;
+		}
+	service_threads = n;
+
+	service_thread((void *)0);
+	for (n = 1; n < service_threads; n++)
+		pthread_join(threads[n], NULL);
 
 	lws_context_destroy(context);
+	fs_ws_dsp_local_stop();
+	fs_ws_dsp_fork_stop();
+	fs_ws_dsp_capture_close();
+
+	fs_ws_dsp_fft_cache_stats(&fft_stats);
+	lwsl_user("FFT plan cache: %llu hits, %llu misses\n",
+		  (unsigned long long)fft_stats.hits, (unsigned long long)fft_stats.misses);
+	fs_ws_dsp_fft_cache_clear();
+	fs_ws_dsp_result_cache_stats(&result_stats);
+	if (result_stats.cache.hits + result_stats.cache.misses)
+		lwsl_user("Result cache: %llu hits, %llu misses, %llu bytes saved\n",
+			  (unsigned long long)result_stats.cache.hits, (unsigned long long)result_stats.cache.misses,
+			  (unsigned long long)result_stats.bytes_saved);
+	fs_ws_dsp_result_cache_clear();
+	fs_ws_dsp_buffer_clear();
 
 	lwsl_user("Completed %s\n", interrupted == 2 ? "OK" : "failed");
 
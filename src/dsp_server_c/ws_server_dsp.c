@@ -14,23 +14,79 @@
 #include "include/fs_ws_dsp.h"
 #include "fs_ws_dsp.c"
 
-#define RING_DEPTH 1024 * 32
+/* Response queues start empty, grow by doubling from TX_QUEUE_MIN slots up to TX_QUEUE_MAX and
+ * shrink back once drained, so idle sessions hold no queue memory. */
+#define TX_QUEUE_MIN 8
+#define TX_QUEUE_MAX (1024 * 32)
+#define RX_MESSAGE_MAX (256 * 1024 * 1024)
+/* Room in front of response data for the lws frame header and the response head. Rounded up
+ * so the samples that follow stay 16 byte aligned. */
+#define TX_HEADROOM ((LWS_PRE + FS_WS_DSP_MSG_HEAD_SIZE + 15) & ~(size_t)15)
+/* Requests announcing at least RX_INCREMENTAL_MIN bytes of data are processed while they arrive,
+ * in pieces of at least RX_PIECE bytes, when their command chain allows it. */
+#define RX_INCREMENTAL_MIN (1024 * 1024)
+#define RX_PIECE (256 * 1024)
+/* version, id, stream, data_len of a FS_WS_DSP_MSG_STREAM_DATA message */
+#define STREAM_DATA_HEAD 13
+/* Most lws service threads, each with its own completion queue */
+#define SERVICE_THREADS_MAX 64
+/* Published results a subscriber may have waiting to be written. Newer ones are dropped meanwhile. */
+#define SUBSCRIBER_FRAMES 4
 
 /* one of these created for each message fragment */
 struct msg {
-	void *payload; /* is malloc'd */
+	void *payload; /* LWS_PRE bytes in front of the message, inside buffer */
+	char *buffer; /* from fs_ws_dsp_buffer_get */
 	size_t len;
 	char binary;
 	char first;
 	char final;
+	char shared; /* buffer is sent by other sessions too */
+	uint8_t version; /* of the response, for its write time */
+	uint64_t queued_ns;
+};
+
+/* Responses waiting to be written, oldest at head */
+struct tx_queue {
+	struct msg *slots; /* NULL while empty */
+	uint32_t size;
+	uint32_t head;
+	uint32_t count;
+	uint32_t shared; /* queued responses with a shared buffer */
+};
+
+struct session_data;
+
+/* Service thread handle on a session. Outlives the session while jobs are in flight. */
+struct session_link {
+	struct lws *wsi;
+	struct session_data *session;
+	uint32_t jobs; /* submitted to the pool and not yet delivered */
+	struct fs_ws_dsp_stream *streams; /* streams opened by the session */
+	uint32_t serials; /* last serial handed to an implicit stream */
+	struct fs_ws_dsp_subscriber *subscriptions; /* topics the session is subscribed to */
+	struct fs_ws_dsp_job *requests; /* requests in flight that are not part of a stream, may be cancelled */
+	int tsi; /* service thread the session belongs to */
+	uint8_t closed:1;
 };
 
 struct session_data {
-	struct lws_ring *frag_ring;
-	uint32_t frag_tail;
-	struct lws_ring *ring;
-	uint32_t tail;
-	uint32_t msglen;
+	struct session_link *link;
+	char *rx; /* fragments of the message being received, is malloc'd */
+	size_t rx_len;
+	size_t rx_size;
+	struct fs_ws_dsp_stream *rx_stream; /* implicit stream of the request being processed as it arrives */
+	size_t rx_left; /* request data of rx_stream still to come */
+	uint32_t rx_frame; /* pieces of rx_stream are a multiple of this */
+	struct tx_queue tx;
+	size_t tx_bytes; /* responses in tx and not yet fully written */
+	size_t tx_sent; /* bytes of the response at the head of tx already written */
+	uint32_t tx_serial; /* fragmented response partly in tx, 0 for none */
+	struct fs_ws_dsp_job *deferred_head; /* responses held back until tx_serial is complete */
+	struct fs_ws_dsp_job *deferred_tail;
+	uint8_t rx_discard:1;
+	uint8_t rx_whole:1; /* message is buffered whole */
+	uint8_t tx_failed:1; /* a fragmented response cannot be completed, close once tx drains */
 	uint8_t completed:1;
 	uint8_t flow_controlled:1;
 	uint8_t write_consume_pending:1;
@@ -41,17 +97,879 @@ struct vhd_minimal_server_echo {
 	struct lws_vhost *vhost;
 	int *interrupted;
 	int *options;
+	int *workers;
+	int *tx_fragment;
+	int *tx_backlog;
+	int *tx_budget;
+	_Atomic size_t tx_total; /* bytes queued in every session of every service thread */
+	int service_threads;
+	struct fs_ws_dsp_pool pool;
+	/* A session is only touched by its own service thread, so each has its own completion queue */
+	struct fs_ws_dsp_completion completion[SERVICE_THREADS_MAX];
 };
 
 static void __minimal_destroy_message(void *_msg)
 {
 	struct msg *msg = _msg;
-	free(msg->payload);
+	fs_ws_dsp_buffer_put(msg->buffer);
+	msg->buffer = NULL;
 	msg->payload = NULL;
 	msg->len = 0;
 }
 
-#include <assert.h>
+/* Queue a response, growing the queue if it is full. */
+static int __tx_queue_push(struct tx_queue *tx, const struct msg *msg)
+{
+	struct msg *slots;
+	uint32_t size, i;
+
+	if (tx->count == tx->size) {
+		if (tx->size >= TX_QUEUE_MAX)
+			return -1;
+		size = tx->size ? tx->size * 2 : TX_QUEUE_MIN;
+		slots = malloc(size * sizeof(struct msg));
+		if (!slots)
+			return -1;
+		for (i = 0; i < tx->count; i++)
+			slots[i] = tx->slots[(tx->head + i) % tx->size];
+		free(tx->slots);
+		tx->slots = slots;
+		tx->size  = size;
+		tx->head  = 0;
+	}
+	tx->slots[(tx->head + tx->count) % tx->size] = *msg;
+	tx->count++;
+	tx->shared += msg->shared ? 1 : 0;
+	fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_TX_QUEUED, 1);
+	return 0;
+}
+
+static struct msg *__tx_queue_peek(struct tx_queue *tx)
+{
+	return tx->count ? &tx->slots[tx->head] : NULL;
+}
+
+/* Release the oldest response. A drained queue gives back memory beyond its first allocation. */
+static void __tx_queue_pop(struct tx_queue *tx)
+{
+	tx->shared -= tx->slots[tx->head].shared ? 1 : 0;
+	__minimal_destroy_message(&tx->slots[tx->head]);
+	fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_TX_DEQUEUED, 1);
+	tx->head = (tx->head + 1) % tx->size;
+	if (--tx->count == 0 && tx->size > TX_QUEUE_MIN) {
+		free(tx->slots);
+		tx->slots = NULL;
+		tx->size  = 0;
+		tx->head  = 0;
+	}
+}
+
+static void __tx_queue_free(struct tx_queue *tx)
+{
+	while (tx->count)
+		__tx_queue_pop(tx);
+	free(tx->slots);
+	memset(tx, 0, sizeof(struct tx_queue));
+}
+
+/* Append a fragment to the receive buffer, growing it geometrically. */
+static int __dsp_rx_append(struct session_data *session, const void *in, size_t len)
+{
+	size_t size = session->rx_size ? session->rx_size : 4096;
+	char *rx;
+
+	if (session->rx_len + len > RX_MESSAGE_MAX)
+		return -1;
+	while (size < session->rx_len + len)
+		size *= 2;
+	if (size != session->rx_size) {
+		rx = realloc(session->rx, size);
+		if (!rx)
+			return -1;
+		session->rx      = rx;
+		session->rx_size = size;
+	}
+	memcpy(session->rx + session->rx_len, in, len);
+	session->rx_len += len;
+	return 0;
+}
+
+/* Runs on a worker thread. Turn the output for one piece of an incrementally received request into
+ * the next fragment of its response. The first fragment carries the response head announcing the
+ * length of the whole response. A piece that fails, or a request that comes up short of the data it
+ * announced, drops the response: the remaining pieces produce nothing, and once the head is out the
+ * missing final fragment closes the session. */
+static void __dsp_job_fragment(struct fs_ws_dsp_job *job, struct fs_ws_dsp_worker *worker, uint32_t in_len,
+			       struct fs_ws_dsp_message s_response)
+{
+	struct fs_ws_dsp_stream *stream = job->stream;
+	struct fs_ws_dsp_message head;
+	size_t head_len = stream->head_sent ? 0 : FS_WS_DSP_MSG_HEAD_SIZE;
+	size_t want = stream->out_len - stream->out_done;
+	size_t len = s_response.data ? s_response.data_len : 0;
+
+	int short_input;
+
+	stream->in_left -= in_len < stream->in_left ? in_len : stream->in_left;
+	short_input = job->final && stream->in_left;
+	if (!stream->failed && (s_response.failed || short_input || len > want || (job->final && len < want))) {
+		if (short_input) {
+			lwsl_warn("Message %u came up short: dropping\n", stream->handle);
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_MALFORMED, 1);
+		} else {
+			lwsl_warn("Message %u failed: dropping\n", stream->handle);
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_FAILED, 1);
+		}
+		stream->failed = 1;
+	}
+	if (stream->failed || (!head_len && !len && !job->final)) {
+		fs_ws_dsp_message_free(s_response);
+		return;
+	}
+	if (len && !fs_ws_dsp_arena_detach(&worker->arena, s_response.data, &job->response_buffer)) {
+		/* Arena headroom fits the lws header and, on the first fragment, the response head. */
+		job->response = (char *)s_response.data - head_len - LWS_PRE;
+		s_response.data = NULL;
+	} else {
+		job->response_buffer = fs_ws_dsp_buffer_get(LWS_PRE + head_len + len);
+		job->response = job->response_buffer;
+		if (job->response && len)
+			memcpy(job->response + LWS_PRE + head_len, s_response.data, len);
+	}
+	fs_ws_dsp_message_free(s_response);
+	if (!job->response)
+		return;
+
+	if (head_len) {
+		memset(&head, 0, sizeof(struct fs_ws_dsp_message));
+		head._version = FS_WS_DSP_MSG_REQUEST;
+		head.id       = stream->handle;
+		head.data_len = (uint32_t)stream->out_len;
+		fs_ws_dsp_message_serialize_head(head, job->response + LWS_PRE);
+		stream->head_sent = 1;
+	}
+	stream->out_done  += len;
+	job->first        = head_len != 0;
+	job->response_len = head_len + len;
+}
+
+/* Frames of one published block on their way to the subscribers */
+struct publish {
+	struct fs_ws_dsp_job *block;
+	struct fs_ws_dsp_job *frames;
+};
+
+/* Runs on a worker thread with the topic registry locked. Make a frame for one subscriber, sharing
+ * the response buffer of the block. */
+static void __dsp_publish_frame(struct fs_ws_dsp_subscriber *subscriber, void *arg)
+{
+	struct publish *publish = (struct publish *)arg;
+	struct fs_ws_dsp_job *frame = malloc(sizeof(struct fs_ws_dsp_job));
+
+	if (!frame)
+		return;
+	memset(frame, 0, sizeof(struct fs_ws_dsp_job));
+	fs_ws_dsp_subscriber_hold(subscriber);
+	fs_ws_dsp_buffer_hold(publish->block->response_buffer, 1);
+	frame->owner           = subscriber;
+	frame->queue           = subscriber->queue;
+	frame->version         = FS_WS_DSP_MSG_SUBSCRIBE;
+	frame->response        = publish->block->response;
+	frame->response_len    = publish->block->response_len;
+	frame->response_buffer = publish->block->response_buffer;
+	frame->first           = 1;
+	frame->final           = 1;
+	frame->shared          = 1;
+	frame->next            = publish->frames;
+	publish->frames        = frame;
+}
+
+/* Runs on a worker thread. Hand the response of a block of a published stream to every subscriber
+ * of its topic, each through the completion queue of its service thread, and answer the publisher
+ * with a response without data. */
+static void __dsp_publish(struct vhd_minimal_server_echo *vhost, struct fs_ws_dsp_job *job)
+{
+	struct fs_ws_dsp_topic *topic = job->stream->topic;
+	struct fs_ws_dsp_message ack;
+	struct publish publish;
+	struct fs_ws_dsp_job *frame;
+	char *head = job->response + LWS_PRE;
+
+	memset(&ack, 0, sizeof(struct fs_ws_dsp_message));
+	ack._version = FS_WS_DSP_MSG_REQUEST;
+	memcpy(&ack.id, head + 1, 4);
+	/* Subscribers tell the results of their topics apart by topic id. */
+	head[0] = FS_WS_DSP_MSG_SUBSCRIBE;
+	memcpy(head + 1, &topic->id, 4);
+
+	publish.block  = job;
+	publish.frames = NULL;
+	if (fs_ws_dsp_topic_fanout(topic, __dsp_publish_frame, &publish)) {
+		while ((frame = publish.frames)) {
+			publish.frames = frame->next;
+			fs_ws_dsp_completion_push(&vhost->completion[frame->queue], frame);
+		}
+		lws_cancel_service(vhost->context);
+	}
+	fs_ws_dsp_buffer_put(job->response_buffer);
+
+	job->response_len    = FS_WS_DSP_MSG_HEAD_SIZE;
+	job->response_buffer = fs_ws_dsp_buffer_get(LWS_PRE + job->response_len);
+	job->response        = job->response_buffer;
+	if (job->response)
+		fs_ws_dsp_message_serialize_head(ack, job->response + LWS_PRE);
+}
+
+/* Replace the response of a job whose result is no longer wanted by a response of version
+ * FS_WS_DSP_MSG_CANCEL without data, so the client learns it is not coming. */
+static void __dsp_job_cancel(struct fs_ws_dsp_job *job)
+{
+	struct fs_ws_dsp_message cancel;
+
+	memset(&cancel, 0, sizeof(struct fs_ws_dsp_message));
+	cancel._version = FS_WS_DSP_MSG_CANCEL;
+	cancel.id       = job->id;
+	fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_CANCELLED, 1);
+	fs_ws_dsp_buffer_put(job->response_buffer);
+	job->response_len    = FS_WS_DSP_MSG_HEAD_SIZE;
+	job->response_buffer = fs_ws_dsp_buffer_get(LWS_PRE + job->response_len);
+	job->response        = job->response_buffer;
+	if (job->response)
+		fs_ws_dsp_message_serialize_head(cancel, job->response + LWS_PRE);
+}
+
+/* Runs on a worker thread. Must not touch the session or its rings. */
+static void __dsp_job_run(struct fs_ws_dsp_job *job, struct fs_ws_dsp_worker *worker)
+{
+	struct fs_ws_dsp_message s_request;
+	struct fs_ws_dsp_message s_response;
+	uint64_t started = fs_ws_dsp_metrics_now_ns(), parsed, executed;
+
+	fs_ws_dsp_metrics_time_phase(FS_WS_DSP_PHASE_QUEUE, job->version, started - job->queued_ns);
+	/* Cancelled or expired while queued: not even parsed. */
+	if (!fs_ws_dsp_job_wanted(job)) {
+		free(job->request);
+		job->request = NULL;
+		__dsp_job_cancel(job);
+		return;
+	}
+	/* The parsed request owns job->request from here on. */
+	if (fs_ws_dsp_message_parse(&s_request, job->request, job->request_len)) {
+		lwsl_warn("Malformed message %u: dropping\n", s_request.id);
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_MALFORMED, 1);
+		fs_ws_dsp_message_free(s_request);
+		job->request = NULL;
+		return;
+	}
+	/* Capture requests carry a file reference, map it as their data. */
+	if (job->version == FS_WS_DSP_MSG_CAPTURE && fs_ws_dsp_capture_map(&s_request)) {
+		lwsl_warn("Capture of message %u unavailable: dropping\n", s_request.id);
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_UNAVAILABLE, 1);
+		fs_ws_dsp_message_free(s_request);
+		job->request = NULL;
+		return;
+	}
+	parsed = fs_ws_dsp_metrics_now_ns();
+	fs_ws_dsp_metrics_time_phase(FS_WS_DSP_PHASE_PARSE, job->version, parsed - started);
+	if (job->version == FS_WS_DSP_MSG_STREAM_OPEN || job->version == FS_WS_DSP_MSG_PUBLISH) {
+		/* A topic takes one publisher, the stream of any other keeps its results to itself. */
+		if (job->version == FS_WS_DSP_MSG_PUBLISH &&
+		    !(job->stream->topic = fs_ws_dsp_topic_publish(s_request.topic, s_request.topic_len))) {
+			lwsl_warn("Topic of stream %u unavailable: not publishing\n", s_request.id);
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_UNAVAILABLE, 1);
+		}
+		/* The stream keeps the request's commands. */
+		s_response = fs_ws_dsp_stream_open(job->stream, s_request, &worker->arena);
+	} else if (job->version == FS_WS_DSP_MSG_STREAM_DATA) {
+		s_response = fs_ws_dsp_stream_process(job->stream, s_request, &worker->arena);
+		fs_ws_dsp_message_free(s_request);
+		if (job->serial) {
+			executed = fs_ws_dsp_metrics_now_ns();
+			fs_ws_dsp_metrics_time_phase(FS_WS_DSP_PHASE_EXECUTE, job->version, executed - parsed);
+			__dsp_job_fragment(job, worker, s_request.data_len, s_response);
+			job->request = NULL;
+			fs_ws_dsp_metrics_time_phase(FS_WS_DSP_PHASE_SERIALIZE, job->version,
+						     fs_ws_dsp_metrics_now_ns() - executed);
+			return;
+		}
+	} else if (job->version == FS_WS_DSP_MSG_STREAM_CLOSE) {
+		fs_ws_dsp_stream_close(job->stream);
+		memset(&s_response, 0, sizeof(struct fs_ws_dsp_message));
+		s_response._version = FS_WS_DSP_MSG_REQUEST;
+		s_response.id       = s_request.id;
+		fs_ws_dsp_message_free(s_request);
+	} else if (job->version == FS_WS_DSP_MSG_BATCH) {
+		s_request.job = job;
+		s_response = fs_ws_dsp_process_batch(s_request, &worker->arena);
+		fs_ws_dsp_message_free(s_request);
+	} else {
+		s_request.job = job;
+		s_response = fs_ws_dsp_process_cached(s_request, &worker->arena);
+		fs_ws_dsp_message_free(s_request);
+	}
+	executed = fs_ws_dsp_metrics_now_ns();
+	fs_ws_dsp_metrics_time_phase(FS_WS_DSP_PHASE_EXECUTE, job->version, executed - parsed);
+	/* A command failed: there is no result to answer with. */
+	if (s_response.failed) {
+		lwsl_warn("Message %u failed: dropping\n", s_response.id);
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_FAILED, 1);
+		fs_ws_dsp_message_free(s_response);
+		job->request = NULL;
+		return;
+	}
+	/* Stopped between stages as no longer wanted. */
+	if (s_response._version == FS_WS_DSP_MSG_CANCEL)
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_CANCELLED, 1);
+	/* Response data lives in the worker's arena. Serialize it straight behind the lws headroom. */
+	job->response_len = fs_ws_dsp_message_serialize_size(s_response);
+	if (s_response.data && !fs_ws_dsp_arena_detach(&worker->arena, s_response.data, &job->response_buffer)) {
+		/* The last stage wrote into an arena buffer with TX_HEADROOM in front. Send it as is. */
+		job->response = (char *)s_response.data - FS_WS_DSP_MSG_HEAD_SIZE - LWS_PRE;
+		fs_ws_dsp_message_serialize_head(s_response, job->response + LWS_PRE);
+		s_response.data = NULL;
+	} else {
+		job->response_buffer = fs_ws_dsp_buffer_get(LWS_PRE + job->response_len);
+		job->response = job->response_buffer;
+		if (job->response)
+			fs_ws_dsp_message_serialize_into(s_response, job->response + LWS_PRE);
+	}
+
+	fs_ws_dsp_message_free(s_response);
+	job->request = NULL;
+
+	if (job->response && job->stream && job->stream->topic && job->version != FS_WS_DSP_MSG_STREAM_CLOSE)
+		__dsp_publish((struct vhd_minimal_server_echo *)worker->pool->done_arg, job);
+	fs_ws_dsp_metrics_time_phase(FS_WS_DSP_PHASE_SERIALIZE, job->version, fs_ws_dsp_metrics_now_ns() - executed);
+}
+
+/* Runs on the worker thread. Hand the job back to the service thread of its session and wake it. */
+static void __dsp_job_done(struct fs_ws_dsp_job *job, void *arg)
+{
+	struct vhd_minimal_server_echo *vhost = (struct vhd_minimal_server_echo *)arg;
+	fs_ws_dsp_completion_push(&vhost->completion[job->queue], job);
+	lws_cancel_service(vhost->context);
+}
+
+/* Service thread. Start a job, or park it behind the block its stream is already running. */
+static void __dsp_submit(struct vhd_minimal_server_echo *vhost, struct fs_ws_dsp_job *job)
+{
+	struct fs_ws_dsp_stream *stream = job->stream;
+
+	if (stream && stream->busy) {
+		job->next = NULL;
+		if (stream->queued_tail)
+			stream->queued_tail->next = job;
+		else
+			stream->queued_head = job;
+		stream->queued_tail = job;
+		return;
+	}
+	if (stream)
+		stream->busy = 1;
+	fs_ws_dsp_pool_submit(&vhost->pool, job);
+}
+
+static struct fs_ws_dsp_stream *__dsp_stream_find(struct session_link *link, uint32_t handle)
+{
+	struct fs_ws_dsp_stream *stream;
+
+	/* Implicit streams are not addressable by the client. */
+	for (stream = link->streams; stream; stream = stream->next)
+		if (stream->handle == handle && !stream->serial)
+			return stream;
+	return NULL;
+}
+
+static void __dsp_stream_free(struct session_link *link, struct fs_ws_dsp_stream *stream)
+{
+	struct fs_ws_dsp_stream **slot = &link->streams;
+
+	while (*slot != stream)
+		slot = &(*slot)->next;
+	*slot = stream->next;
+	fs_ws_dsp_topic_unpublish(stream->topic);
+	fs_ws_dsp_stream_close(stream);
+	free(stream);
+}
+
+/* Service thread. A block of the stream finished. Start the next one or retire the stream. */
+static void __dsp_stream_idle(struct vhd_minimal_server_echo *vhost, struct session_link *link,
+			      struct fs_ws_dsp_stream *stream)
+{
+	struct fs_ws_dsp_job *job = stream->queued_head;
+
+	stream->busy = 0;
+	if (job) {
+		stream->queued_head = job->next;
+		if (!stream->queued_head)
+			stream->queued_tail = NULL;
+		__dsp_submit(vhost, job);
+	} else if (stream->closing) {
+		__dsp_stream_free(link, stream);
+	}
+}
+
+/* Service thread. Drop every stream of a closed session, waiting for blocks in flight. */
+static void __dsp_stream_close_all(struct session_link *link)
+{
+	struct fs_ws_dsp_stream *stream = link->streams;
+	struct fs_ws_dsp_stream *next;
+	struct fs_ws_dsp_job *job;
+
+	while (stream) {
+		next = stream->next;
+		while ((job = stream->queued_head)) {
+			stream->queued_head = job->next;
+			free(job->request);
+			free(job);
+			link->jobs--;
+		}
+		stream->queued_tail = NULL;
+		stream->closing = 1;
+		if (!stream->busy)
+			__dsp_stream_free(link, stream);
+		stream = next;
+	}
+}
+
+/* Service thread. Wrap a serialized request in a job and start it. Takes ownership of message.
+ * Requests outside streams may be cancelled until they are delivered. deadline is in
+ * fs_ws_dsp_now_ms time, 0 for none. */
+static int __dsp_job_submit(struct vhd_minimal_server_echo *vhost, struct session_link *link,
+			    struct fs_ws_dsp_stream *stream, uint8_t version, uint32_t id, char *message,
+			    size_t message_len, uint8_t final, uint8_t priority, uint64_t deadline)
+{
+	struct fs_ws_dsp_job *job = malloc(sizeof(struct fs_ws_dsp_job));
+
+	if (!job) {
+		lwsl_user("OOM: dropping\n");
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_OOM, 1);
+		free(message);
+		return -1;
+	}
+	memset(job, 0, sizeof(struct fs_ws_dsp_job));
+	job->owner       = link;
+	job->queue       = (unsigned int)link->tsi;
+	job->stream      = stream;
+	job->serial      = stream ? stream->serial : 0;
+	job->version     = version;
+	job->id          = id;
+	job->request     = message;
+	job->request_len = message_len;
+	job->first       = 1;
+	job->final       = final;
+	job->priority    = priority;
+	job->deadline    = deadline;
+	job->queued_ns   = fs_ws_dsp_metrics_now_ns();
+	if (!stream) {
+		job->sibling = link->requests;
+		if (job->sibling)
+			job->sibling->sibling_slot = &job->sibling;
+		job->sibling_slot = &link->requests;
+		link->requests    = job;
+	}
+	link->jobs++;
+	__dsp_submit(vhost, job);
+	return 0;
+}
+
+/* Service thread. Once the commands of a large request are in, process its data in pieces on an
+ * implicit stream instead of buffering the whole message. */
+static void __dsp_rx_begin(struct session_data *session)
+{
+	struct session_link *link = session->link;
+	struct fs_ws_dsp_stream *stream;
+	struct fs_ws_dsp_message chain;
+	uint32_t data_len, frame, zero = 0;
+	int head_len = fs_ws_dsp_message_head_size(session->rx, session->rx_len, &data_len);
+	uint64_t out_len;
+	char *head;
+
+	if (head_len == 0)
+		return;
+	/* Whatever is decided here holds for the rest of the message. */
+	session->rx_whole = 1;
+	/* Data handed on in pieces never piles up in rx, so the limit is checked against what is announced. */
+	if (head_len > 0 && data_len > RX_MESSAGE_MAX - (uint32_t)head_len) {
+		lwsl_user("dropping!\n");
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_RX_TOO_LARGE, 1);
+		session->rx_discard = 1;
+		free(session->rx);
+		session->rx      = NULL;
+		session->rx_len  = 0;
+		session->rx_size = 0;
+		return;
+	}
+	if (head_len < 0 || data_len < RX_INCREMENTAL_MIN || (uint8_t)session->rx[0] != FS_WS_DSP_MSG_REQUEST)
+		return;
+
+	/* The chain is the head with no data, parsed like a stream open message. */
+	head = malloc(head_len);
+	if (!head)
+		return;
+	memcpy(head, session->rx, head_len);
+	memcpy(head + head_len - 4, &zero, 4);
+	if (fs_ws_dsp_message_parse(&chain, head, head_len) ||
+	    !fs_ws_dsp_process_incremental(chain, data_len, &frame, &out_len)) {
+		fs_ws_dsp_message_free(chain);
+		return;
+	}
+	stream = malloc(sizeof(struct fs_ws_dsp_stream));
+	if (!stream) {
+		fs_ws_dsp_message_free(chain);
+		return;
+	}
+	memset(stream, 0, sizeof(struct fs_ws_dsp_stream));
+	if (++link->serials == 0)
+		link->serials = 1;
+	stream->handle  = chain.id;
+	stream->chain   = chain;
+	stream->serial  = link->serials;
+	stream->in_left = data_len;
+	stream->out_len = out_len;
+	stream->next    = link->streams;
+	link->streams   = stream;
+
+	session->rx_whole  = 0;
+	session->rx_stream = stream;
+	session->rx_frame  = frame;
+	session->rx_left   = data_len;
+	/* rx holds only request data from here on. */
+	session->rx_len -= head_len;
+	memmove(session->rx, session->rx + head_len, session->rx_len);
+}
+
+/* Service thread. Hand the whole frames received so far to the implicit stream, or everything
+ * once the message is complete. A partial frame stays in rx for the next piece. */
+static void __dsp_rx_piece(struct vhd_minimal_server_echo *vhost, struct session_data *session, int final)
+{
+	struct fs_ws_dsp_stream *stream = session->rx_stream;
+	size_t take = session->rx_len < session->rx_left ? session->rx_len : session->rx_left;
+	uint32_t take32;
+	char *message;
+
+	if (!final) {
+		if (take < RX_PIECE)
+			return;
+		take -= take % session->rx_frame;
+	}
+	take32 = (uint32_t)take;
+	message = malloc(STREAM_DATA_HEAD + take);
+	if (message) {
+		message[0] = FS_WS_DSP_MSG_STREAM_DATA;
+		memcpy(message + 1,  &stream->handle, 4);
+		memcpy(message + 5,  &stream->handle, 4);
+		memcpy(message + 9,  &take32, 4);
+		memcpy(message + STREAM_DATA_HEAD, session->rx, take);
+	} else {
+		lwsl_user("OOM: dropping\n");
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_OOM, 1);
+	}
+	session->rx_left -= take;
+	session->rx_len  -= take;
+	memmove(session->rx, session->rx + take, session->rx_len);
+	if (final) {
+		/* The stream retires once its last piece has been delivered. */
+		stream->closing    = 1;
+		session->rx_stream = NULL;
+	}
+	if ((!message || __dsp_job_submit(vhost, session->link, stream, FS_WS_DSP_MSG_STREAM_DATA, stream->handle,
+					  message, STREAM_DATA_HEAD + take, final, FS_WS_DSP_PRIORITY_DEFAULT, 0)) && final) {
+		/* Without its last piece the response cannot be finished. */
+		session->tx_failed = 1;
+		if (!stream->busy && !stream->queued_head)
+			__dsp_stream_free(session->link, stream);
+		lws_callback_on_writable(session->link->wsi);
+	}
+}
+
+static void __dsp_send(struct vhd_minimal_server_echo *vhost, struct session_data *session,
+		       struct fs_ws_dsp_job *job);
+
+/* Service thread. Join or leave a topic and answer right away, nothing needs a worker. Subscribing
+ * again to a topic answers with the same topic id. Takes ownership of message. */
+static void __dsp_subscribe(struct vhd_minimal_server_echo *vhost, struct session_link *link,
+			    char *message, size_t message_len)
+{
+	struct fs_ws_dsp_subscriber *subscriber, **slot;
+	struct fs_ws_dsp_message request, response;
+	struct fs_ws_dsp_topic *topic;
+	struct fs_ws_dsp_job *job;
+	uint32_t topic_id;
+
+	if (fs_ws_dsp_message_parse(&request, message, message_len)) {
+		lwsl_warn("Malformed message %u: dropping\n", request.id);
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_MALFORMED, 1);
+		fs_ws_dsp_message_free(request);
+		return;
+	}
+	memset(&response, 0, sizeof(struct fs_ws_dsp_message));
+	response._version = FS_WS_DSP_MSG_REQUEST;
+	response.id       = request.id;
+	if (request._version == FS_WS_DSP_MSG_SUBSCRIBE) {
+		/* Topics of subscriptions stay alive, their names do not change. */
+		for (subscriber = link->subscriptions; subscriber; subscriber = subscriber->sibling) {
+			topic = subscriber->topic;
+			if (topic->name_len == request.topic_len && !memcmp(topic->name, request.topic, request.topic_len))
+				break;
+		}
+		if (!subscriber) {
+			subscriber = fs_ws_dsp_topic_subscribe(request.topic, request.topic_len, link, (unsigned int)link->tsi);
+			if (!subscriber) {
+				lwsl_warn("Cannot subscribe message %u: dropping\n", request.id);
+				fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_UNAVAILABLE, 1);
+				fs_ws_dsp_message_free(request);
+				return;
+			}
+			subscriber->sibling = link->subscriptions;
+			link->subscriptions = subscriber;
+		}
+		topic_id          = subscriber->topic_id;
+		response.data     = &topic_id;
+		response.data_len = 4;
+	} else {
+		for (slot = &link->subscriptions; *slot; slot = &(*slot)->sibling)
+			if ((*slot)->topic_id == request.stream)
+				break;
+		if (!*slot) {
+			lwsl_warn("Not subscribed to topic %u: dropping\n", request.stream);
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_BAD_HANDLE, 1);
+			fs_ws_dsp_message_free(request);
+			return;
+		}
+		subscriber = *slot;
+		*slot = subscriber->sibling;
+		fs_ws_dsp_topic_unsubscribe(subscriber);
+	}
+	fs_ws_dsp_message_free(request);
+
+	job = malloc(sizeof(struct fs_ws_dsp_job));
+	if (!job) {
+		lwsl_user("OOM: dropping\n");
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_OOM, 1);
+		return;
+	}
+	memset(job, 0, sizeof(struct fs_ws_dsp_job));
+	job->version         = request._version;
+	job->response_len    = fs_ws_dsp_message_serialize_size(response);
+	job->response_buffer = fs_ws_dsp_buffer_get(LWS_PRE + job->response_len);
+	job->response        = job->response_buffer;
+	job->first           = 1;
+	job->final           = 1;
+	if (!job->response) {
+		lwsl_user("OOM: dropping\n");
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_OOM, 1);
+		free(job);
+		return;
+	}
+	fs_ws_dsp_message_serialize_into(response, job->response + LWS_PRE);
+	__dsp_send(vhost, link->session, job);
+}
+
+/* Service thread. Route a complete message to the pool. Takes ownership of message. */
+static void __dsp_receive(struct vhd_minimal_server_echo *vhost, struct session_link *link,
+			  char *message, size_t message_len)
+{
+	struct fs_ws_dsp_stream *stream = NULL;
+	struct fs_ws_dsp_job *job;
+	uint32_t id, handle, priority = FS_WS_DSP_PRIORITY_DEFAULT, deadline = 0;
+	uint8_t version;
+	int scheduled = fs_ws_dsp_message_peek_schedule(message, message_len, &priority, &deadline);
+
+	if (scheduled < 0 || fs_ws_dsp_message_peek(message, message_len, &version, &id, &handle)) {
+		lwsl_warn("Malformed message: dropping\n");
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_MALFORMED, 1);
+		free(message);
+		return;
+	}
+	/* Stream blocks must run in order and all of them, so only one-off requests can be scheduled. */
+	if (scheduled && version != FS_WS_DSP_MSG_REQUEST && version != FS_WS_DSP_MSG_CAPTURE &&
+	    version != FS_WS_DSP_MSG_BATCH) {
+		lwsl_warn("Message %u cannot be scheduled: dropping\n", id);
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_MALFORMED, 1);
+		free(message);
+		return;
+	}
+	if (version == FS_WS_DSP_MSG_CANCEL) {
+		/* Delivered requests have left the list. The others are answered with a CANCEL response. */
+		for (job = link->requests; job; job = job->sibling)
+			if (job->id == handle)
+				atomic_store_explicit(&job->cancelled, 1, memory_order_relaxed);
+		free(message);
+		return;
+	}
+	if (version == FS_WS_DSP_MSG_SUBSCRIBE || version == FS_WS_DSP_MSG_UNSUBSCRIBE) {
+		__dsp_subscribe(vhost, link, message, message_len);
+		return;
+	}
+	if (version == FS_WS_DSP_MSG_STREAM_OPEN || version == FS_WS_DSP_MSG_PUBLISH) {
+		if (__dsp_stream_find(link, id)) {
+			lwsl_warn("Stream %u already open: dropping\n", id);
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_BAD_HANDLE, 1);
+			free(message);
+			return;
+		}
+		stream = malloc(sizeof(struct fs_ws_dsp_stream));
+		if (!stream) {
+			lwsl_user("OOM: dropping\n");
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_OOM, 1);
+			free(message);
+			return;
+		}
+		memset(stream, 0, sizeof(struct fs_ws_dsp_stream));
+		stream->handle = id;
+		stream->next   = link->streams;
+		link->streams  = stream;
+	} else if (version == FS_WS_DSP_MSG_STREAM_DATA || version == FS_WS_DSP_MSG_STREAM_CLOSE) {
+		stream = __dsp_stream_find(link, handle);
+		if (!stream || stream->closing) {
+			lwsl_warn("No open stream %u: dropping\n", handle);
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_BAD_HANDLE, 1);
+			free(message);
+			return;
+		}
+		if (version == FS_WS_DSP_MSG_STREAM_CLOSE)
+			stream->closing = 1;
+	}
+
+	if (priority >= FS_WS_DSP_PRIORITIES)
+		priority = FS_WS_DSP_PRIORITIES - 1;
+	/* An open stream with nothing to run would never be retired. */
+	if (__dsp_job_submit(vhost, link, stream, version, id, message, message_len, 1, (uint8_t)priority,
+			     deadline ? fs_ws_dsp_now_ms() + deadline : 0) &&
+	    (version == FS_WS_DSP_MSG_STREAM_OPEN || version == FS_WS_DSP_MSG_PUBLISH))
+		__dsp_stream_free(link, stream);
+}
+
+/* Service thread. Queue a finished response for writing. Websocket messages cannot interleave, so
+ * while a fragmented response is partly queued, responses to other messages wait behind it. */
+static void __dsp_send(struct vhd_minimal_server_echo *vhost, struct session_data *session,
+		       struct fs_ws_dsp_job *job)
+{
+	struct fs_ws_dsp_job *deferred, *next;
+	struct msg fragment;
+	uint8_t closes;
+
+	if (session->tx_serial && job->serial != session->tx_serial) {
+		job->next = NULL;
+		if (session->deferred_tail)
+			session->deferred_tail->next = job;
+		else
+			session->deferred_head = job;
+		session->deferred_tail = job;
+		return;
+	}
+	fragment.first   = job->first;
+	fragment.final   = job->final;
+	fragment.binary  = 1;
+	fragment.len     = job->response_len;
+	fragment.payload = job->response;
+	fragment.buffer  = job->response_buffer;
+	fragment.shared  = job->shared;
+	fragment.version = job->version;
+	fragment.queued_ns = fs_ws_dsp_metrics_now_ns();
+	if (__tx_queue_push(&session->tx, &fragment)) {
+		fprintf(stderr, "Response queue is full!\n");
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_TX_QUEUE_FULL, 1);
+		__minimal_destroy_message(&fragment);
+		if (job->serial)
+			session->tx_failed = 1;
+	} else {
+		session->tx_bytes += fragment.len;
+		vhost->tx_total  += fragment.len;
+	}
+	/* Stop reading requests from a client that is not keeping up with its responses, or from any
+	 * client with responses queued while all of them together hold more than the budget. */
+	if (!session->flow_controlled && (session->tx_bytes > (size_t)*vhost->tx_backlog ||
+	    (session->tx_bytes && vhost->tx_total > (size_t)*vhost->tx_budget))) {
+		lws_rx_flow_control(session->link->wsi, 0);
+		session->flow_controlled = 1;
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_FLOW_CONTROL, 1);
+	}
+	lws_callback_on_writable(session->link->wsi);
+
+	closes = job->serial && job->final;
+	if (job->serial)
+		session->tx_serial = job->final ? 0 : job->serial;
+	free(job);
+	if (closes && session->deferred_head) {
+		deferred = session->deferred_head;
+		session->deferred_head = NULL;
+		session->deferred_tail = NULL;
+		while (deferred) {
+			next = deferred->next;
+			__dsp_send(vhost, session, deferred);
+			deferred = next;
+		}
+	}
+}
+
+/* Service thread. Queue a published result for a subscriber, unless it has left the topic or is
+ * still behind. A fragmented response being sent counts as behind, as the result would have to
+ * wait for all of it. */
+static void __dsp_deliver_frame(struct vhd_minimal_server_echo *vhost, struct fs_ws_dsp_job *job)
+{
+	struct fs_ws_dsp_subscriber *subscriber = (struct fs_ws_dsp_subscriber *)job->owner;
+	/* Sessions leave their topics when they close, so the link is valid while subscribed. */
+	struct session_link *link = (struct session_link *)subscriber->owner;
+
+	if (subscriber->topic && !link->session->tx_serial && link->session->tx.shared < SUBSCRIBER_FRAMES) {
+		__dsp_send(vhost, link->session, job);
+	} else {
+		if (subscriber->topic)
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_SUBSCRIBER_BEHIND, 1);
+		fs_ws_dsp_buffer_put(job->response_buffer);
+		free(job);
+	}
+	fs_ws_dsp_subscriber_release(subscriber);
+}
+
+/* Runs on service thread tsi. Move finished responses into the rings of its sessions. */
+static void __dsp_deliver(struct vhd_minimal_server_echo *vhost, int tsi)
+{
+	struct fs_ws_dsp_job *job = fs_ws_dsp_completion_drain(&vhost->completion[tsi]);
+	struct fs_ws_dsp_job *next;
+	struct fs_ws_dsp_stream *stream;
+	struct session_link *link;
+
+	while (job) {
+		next = job->next;
+		if (job->shared) {
+			__dsp_deliver_frame(vhost, job);
+			job = next;
+			continue;
+		}
+		link = (struct session_link *)job->owner;
+		stream = job->stream;
+		link->jobs--;
+		if (job->sibling_slot) {
+			*job->sibling_slot = job->sibling;
+			if (job->sibling)
+				job->sibling->sibling_slot = job->sibling_slot;
+			/* Cancelled or expired while it ran: its result is not sent. */
+			if (!link->closed && job->response && !fs_ws_dsp_job_wanted(job))
+				__dsp_job_cancel(job);
+		}
+		if (link->closed || !job->response) {
+			/* A fragmented response without its last piece cannot be finished. One whose head is
+			 * not out yet is dropped without a trace. */
+			if (!link->closed && job->serial && job->final && stream->head_sent) {
+				link->session->tx_failed = 1;
+				lws_callback_on_writable(link->wsi);
+			}
+			fs_ws_dsp_buffer_put(job->response_buffer);
+			free(job);
+		} else {
+			__dsp_send(vhost, link->session, job);
+		}
+		if (stream)
+			__dsp_stream_idle(vhost, link, stream);
+		if (link->closed && !link->jobs)
+			free(link);
+		job = next;
+	}
+}
+
 /**
  * @brief Websocket event callback.
  * 
@@ -74,9 +992,12 @@ static int callback_dsp(
 			(struct vhd_minimal_server_echo *)
 			lws_protocol_vh_priv_get(lws_get_vhost(wsi), lws_get_protocol(wsi));
 	const struct msg *request; /* Client message */
-	struct msg response; 	/* Resposne message */
-	struct msg fragment;
-	int m, ring_capacity, flags;
+	struct fs_ws_dsp_job *job;
+	struct fs_ws_dsp_subscriber *subscriber;
+	unsigned char *out;
+	char *bounce;
+	size_t chunk;
+	int m, flags, final;
 
 	switch (reason) {
 
@@ -89,21 +1010,52 @@ static int callback_dsp(
 		/* get the pointers we were passed in pvo */
 		vhost->interrupted = (int *)lws_pvo_search((const struct lws_protocol_vhost_options *)in, "interrupted")->value;
 		vhost->options = (int *)lws_pvo_search((const struct lws_protocol_vhost_options *)in, "options")->value;
+		vhost->workers = (int *)lws_pvo_search((const struct lws_protocol_vhost_options *)in, "workers")->value;
+		vhost->tx_fragment = (int *)lws_pvo_search((const struct lws_protocol_vhost_options *)in, "tx_fragment")->value;
+		vhost->tx_backlog = (int *)lws_pvo_search((const struct lws_protocol_vhost_options *)in, "tx_backlog")->value;
+		vhost->tx_budget = (int *)lws_pvo_search((const struct lws_protocol_vhost_options *)in, "tx_budget")->value;
+		vhost->service_threads = lws_get_count_threads(vhost->context);
+		if (vhost->service_threads > SERVICE_THREADS_MAX) {
+			lwsl_err("At most %d service threads\n", SERVICE_THREADS_MAX);
+			return -1;
+		}
+		if (fs_ws_dsp_pool_start(&vhost->pool, (unsigned int)*vhost->workers, (unsigned int)vhost->service_threads,
+					 TX_HEADROOM, __dsp_job_run, __dsp_job_done, vhost)) {
+			lwsl_err("Unable to start %d dsp workers\n", *vhost->workers);
+			return -1;
+		}
+		lwsl_user("Started %d dsp workers\n", *vhost->workers);
+		break;
+
+	case LWS_CALLBACK_PROTOCOL_DESTROY:
+		if (!vhost)
+			break;
+		/* Workers finish whatever is queued before they exit. */
+		fs_ws_dsp_pool_stop(&vhost->pool);
+		for (m = 0; m < vhost->service_threads; m++)
+			__dsp_deliver(vhost, m);
+		break;
+
+	case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+		/* Every service thread is woken, each takes the responses of its own sessions. */
+		if (vhost)
+			__dsp_deliver(vhost, lws_get_tsi(wsi));
 		break;
 
 	case LWS_CALLBACK_ESTABLISHED:
 //		lwsl_warn("LWS_CALLBACK_ESTABLISHED\n");
-		session->ring      = lws_ring_create(sizeof(struct msg), RING_DEPTH, __minimal_destroy_message);
-		session->frag_ring = lws_ring_create(sizeof(struct msg), RING_DEPTH, __minimal_destroy_message);
-		if (!session->ring || !session->frag_ring) {
-			if (session->ring)
-				lws_ring_destroy(session->ring);
-			if (session->frag_ring)
-				lws_ring_destroy(session->ring);
-			return 1;
+		session->link = malloc(sizeof(struct session_link));
+		if (!session->link) {
+			/* Nothing else is held yet. CLOSED finds no link and leaves the session counts alone. */
+			lwsl_err("OOM: closing session\n");
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_OOM, 1);
+			return -1;
 		}
-		session->tail      = 0;
-		session->frag_tail = 0;
+		memset(session->link, 0, sizeof(struct session_link));
+		session->link->wsi     = wsi;
+		session->link->tsi     = lws_get_tsi(wsi);
+		session->link->session = session;
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_SESSIONS_OPENED, 1);
 		break;
 
 	case LWS_CALLBACK_SERVER_WRITEABLE:
@@ -111,120 +1063,153 @@ static int callback_dsp(
 
 		if (session->write_consume_pending) {
 			/* perform the deferred fifo consume */
-			lws_ring_consume_single_tail(session->ring, &session->tail, 1);
+			__tx_queue_pop(&session->tx);
 			session->write_consume_pending = 0;
 		}
 
-		request = lws_ring_get_element(session->ring, &session->tail);
+		request = __tx_queue_peek(&session->tx);
 		if (!request) {
-//			lwsl_user(" (nothing in ring)\n");
+//			lwsl_user(" (nothing queued)\n");
+			if (session->tx_failed)
+				return -1;
+			break;
+		}
+		/* Kernel send buffer is full. Wait for it to drain rather than buffer inside lws. */
+		if (lws_send_pipe_choked(wsi)) {
+			lws_callback_on_writable(wsi);
 			break;
 		}
+		/* Large responses go out one fragment per callback. */
+		chunk = request->len - session->tx_sent;
+		if (*vhost->tx_fragment > 0 && chunk > (size_t)*vhost->tx_fragment)
+			chunk = (size_t)*vhost->tx_fragment;
 		flags = lws_write_ws_flags(
 			request->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT,
-			request->first, request->final);
-		/* Send to client. Notice we allowed for LWS_PRE in the payload already */
-		m = lws_write(wsi, ((unsigned char *)request->payload) + LWS_PRE, request->len, (enum lws_write_protocol)flags);
-		if (m < (int)request->len) {
+			request->first && session->tx_sent == 0,
+			request->final && session->tx_sent + chunk == request->len);
+		/* Send to client. Notice we allowed for LWS_PRE in the payload already. Later fragments
+		 * have bytes already sent in front of them, which lws may overwrite with its header. */
+		out = ((unsigned char *)request->payload) + LWS_PRE + session->tx_sent;
+		bounce = NULL;
+		if (request->shared) {
+			/* Other sessions send the same buffer, so lws gets a copy to write its header in front of. */
+			bounce = fs_ws_dsp_buffer_get(LWS_PRE + chunk);
+			if (!bounce) {
+				lwsl_err("OOM writing to ws socket\n");
+				return -1;
+			}
+			memcpy(bounce + LWS_PRE, out, chunk);
+			out = (unsigned char *)bounce + LWS_PRE;
+		}
+		m = lws_write(wsi, out, chunk, (enum lws_write_protocol)flags);
+		fs_ws_dsp_buffer_put(bounce);
+		if (m < (int)chunk) {
 			lwsl_err("ERROR %d writing to ws socket\n", m);
 			return -1;
 		}
 //		lwsl_user(" wrote %d: flags: 0x%x first: %d final %d\n", m, flags, request->first, request->final);
+		session->tx_sent += chunk;
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_TX_BYTES, chunk);
 
-		/*
-		 * Workaround deferred deflate in pmd extension by only
-		 * consuming the fifo entry when we are certain it has been
-		 * fully deflated at the next WRITABLE callback.  You only need
-		 * this if you're using pmd.
-		 */
-		session->write_consume_pending = 1;
+		if (session->tx_sent == request->len) {
+			fs_ws_dsp_metrics_time_phase(FS_WS_DSP_PHASE_WRITE, request->version,
+						     fs_ws_dsp_metrics_now_ns() - request->queued_ns);
+			if (request->final)
+				fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_TX_MESSAGES, 1);
+			session->tx_bytes -= request->len;
+			vhost->tx_total  -= request->len;
+			session->tx_sent = 0;
+			/*
+			 * Workaround deferred deflate in pmd extension by only
+			 * consuming the fifo entry when we are certain it has been
+			 * fully deflated at the next WRITABLE callback.  You only need
+			 * this if you're using pmd.
+			 */
+			session->write_consume_pending = 1;
+			if ((*vhost->options & 1) && request->final)
+				session->completed = 1;
+		}
 		lws_callback_on_writable(wsi);
-		/* Session ring has recovered room. turn off flow control. */
+		/* Backlog has drained. Turn off flow control. A session that has sent everything resumes
+		 * even while others keep the total over budget, as it would not be woken again. */
 		if (session->flow_controlled &&
-		    (int)lws_ring_get_count_free_elements(session->ring) > RING_DEPTH - 5) {
+		    session->tx_bytes <= (size_t)*vhost->tx_backlog / 2 &&
+		    (!session->tx_bytes || vhost->tx_total <= (size_t)*vhost->tx_budget / 2)) {
 			lws_rx_flow_control(wsi, 1);
 			session->flow_controlled = 0;
 		}
 
-		if ((*vhost->options & 1) && request && request->final)
-			session->completed = 1;
-
 		break;
 
 	case LWS_CALLBACK_RECEIVE:
 //		lwsl_user("LWS_CALLBACK_RECEIVE\n");
-		/* If final fragment then concat all saved fragments and process message, otherwise add fragment to ring. */
-    	if (lws_is_final_fragment(wsi)) {
-			/* Compile contents of fragment ring into single array */
-			char *message = malloc(session->msglen + len);
-			char *dest = message;
-			struct msg *compile_frag;
-			compile_frag = (struct msg *) lws_ring_get_element(session->frag_ring, &session->frag_tail);
-			while (compile_frag) {
-				memcpy(dest, compile_frag->payload, compile_frag->len);
-				dest += compile_frag->len;
-				lws_ring_consume_single_tail(session->frag_ring, &session->frag_tail, 1);
-				compile_frag = (struct msg *) lws_ring_get_element(session->frag_ring, &session->frag_tail);
-			}
-			memcpy(dest, in, len);
-
-			struct fs_ws_dsp_message s_request = fs_ws_dsp_message_parse(message, session->msglen + len);
-			struct fs_ws_dsp_message s_response = fs_ws_dsp_process(s_request);
-			uint32_t response_len = fs_ws_dsp_message_serialize_size(s_response);
-			char *response_payload = fs_ws_dsp_message_serialize(s_response);
-
-			/* APPEND TO RING */
-			fragment.first   = 1;
-			fragment.final   = 1;
-			fragment.binary  = 1;
-			fragment.len     = response_len;
-			fragment.payload = malloc(LWS_PRE + response_len);
-			memcpy(fragment.payload + LWS_PRE, response_payload, response_len);
-			if (!lws_ring_insert(session->ring, &fragment, 1)) {
-				fprintf(stderr, "Response ring is full!\n");
-				__minimal_destroy_message(&fragment);
-			}
-			free(message);
-
-			fs_ws_dsp_message_free(s_response);
-			fs_ws_dsp_message_free(s_request);
-
-			lws_callback_on_writable(wsi);
-			session->msglen = 0;
-	    } else {
-			/* Discard this fragment if we are out of room. */
-			ring_capacity = (int)lws_ring_get_count_free_elements(session->frag_ring);
-			if (!ring_capacity) {
-				lwsl_user("dropping!\n");
-				break;
-			}
-			fragment.first   = (char)lws_is_first_fragment(wsi);
-			fragment.final   = (char)lws_is_final_fragment(wsi);
-			fragment.binary  = (char)lws_frame_is_binary(wsi);
-			fragment.len     = len;
-			fragment.payload = malloc(len);
-			if (!fragment.payload) {
-				lwsl_user("OOM: dropping\n");
-				break;
-			}
-			memcpy((char *)fragment.payload, in, len);
-			if (!lws_ring_insert(session->frag_ring, &fragment, 1)) {
-				__minimal_destroy_message(&fragment);
-				lwsl_user("dropping!\n");
+		/* Fragments are appended to one buffer, which is parsed in place once the message is complete.
+		 * Large requests whose commands can work on pieces are handed on while they arrive instead. */
+		if (!session->rx_discard && __dsp_rx_append(session, in, len)) {
+			lwsl_user("dropping!\n");
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_DROP_RX_TOO_LARGE, 1);
+			session->rx_discard = 1;
+		}
+		final = lws_is_final_fragment(wsi);
+		fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_RX_BYTES, len);
+		if (final)
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_RX_MESSAGES, 1);
+		if (!final && !session->rx_stream && !session->rx_whole && !session->rx_discard)
+			__dsp_rx_begin(session);
+		if (session->rx_stream) {
+			__dsp_rx_piece(vhost, session, final);
+			if (!final)
 				break;
-			}
-			/* Ring is almost full. Switch on flow control. */
-			if (ring_capacity < 3 && !session->flow_controlled) {
-				session->flow_controlled = 1;
-				lws_rx_flow_control(wsi, 0);
-			}
-			session->msglen += (uint32_t)len;
+			free(session->rx);
+		} else if (final) {
+			/* Hand the message to a worker. The response comes back through __dsp_deliver. */
+			if (session->rx_discard)
+				free(session->rx);
+			else
+				__dsp_receive(vhost, session->link, session->rx, session->rx_len);
+		} else {
+			break;
 		}
+		session->rx         = NULL;
+		session->rx_len     = 0;
+		session->rx_size    = 0;
+		session->rx_discard = 0;
+		session->rx_whole   = 0;
 		break;
 
 	case LWS_CALLBACK_CLOSED:
 		lwsl_user("LWS_CALLBACK_CLOSED\n");
-		lws_ring_destroy(session->ring);
+		if (session->link)
+			fs_ws_dsp_metrics_count(FS_WS_DSP_METRIC_SESSIONS_CLOSED, 1);
+		vhost->tx_total -= session->tx_bytes;
+		session->tx_bytes = 0;
+		__tx_queue_free(&session->tx);
+		free(session->rx);
+		session->rx = NULL;
+		session->rx_stream = NULL;
+		while ((job = session->deferred_head)) {
+			session->deferred_head = job->next;
+			fs_ws_dsp_buffer_put(job->response_buffer);
+			free(job);
+		}
+		session->deferred_tail = NULL;
+		/* Responses still being computed are discarded when they are delivered. */
+		if (session->link) {
+			/* Results published after this are dropped when they are delivered. */
+			while ((subscriber = session->link->subscriptions)) {
+				session->link->subscriptions = subscriber->sibling;
+				fs_ws_dsp_topic_unsubscribe(subscriber);
+			}
+			/* Requests still queued are dropped unprocessed. */
+			for (job = session->link->requests; job; job = job->sibling)
+				atomic_store_explicit(&job->cancelled, 1, memory_order_relaxed);
+			__dsp_stream_close_all(session->link);
+			if (session->link->jobs)
+				session->link->closed = 1;
+			else
+				free(session->link);
+			session->link = NULL;
+		}
 		if (*vhost->options & 1) {
 			if (!*vhost->interrupted)
 				*vhost->interrupted = 1 + session->completed;
@@ -247,3 +1232,113 @@ static int callback_dsp(
 		1024, \
 		0, NULL, 0 \
 	}
+
+/* Metrics being sent on one HTTP connection */
+struct metrics_data {
+	char *body; /* LWS_PRE bytes in front of the text, is malloc'd */
+	size_t len;
+	size_t sent;
+};
+
+/**
+ * @brief HTTP event callback of the metrics endpoint, mounted at /metrics.
+ *
+ * @param[in]	wsi		Connection.
+ * @param[in]	reason	Event identification.
+ * @param[in]	user	Connection data.
+ * @param[in]	in		Requested URL.
+ * @param[in]	len		Byte length of in.
+ */
+static int callback_dsp_metrics(
+	struct lws *wsi,
+	enum lws_callback_reasons reason,
+	void *user,
+	void *in,
+	size_t len)
+{
+	struct metrics_data *data = (struct metrics_data *) user;
+	struct vhd_minimal_server_echo *vhost;
+	struct fs_ws_dsp_metrics_text text;
+	unsigned char headers[LWS_PRE + 256], *start = &headers[LWS_PRE], *p = start, *end = &headers[sizeof(headers) - 1];
+	unsigned int pending;
+	size_t chunk;
+
+	switch (reason) {
+
+	case LWS_CALLBACK_HTTP:
+		fs_ws_dsp_metrics_text_init(&text, LWS_PRE);
+		fs_ws_dsp_metrics_render(&text);
+		/* What only the websocket protocol knows: its vhost data, looked up by name. */
+		vhost = (struct vhd_minimal_server_echo *)lws_protocol_vh_priv_get(lws_get_vhost(wsi),
+				lws_vhost_name_to_protocol(lws_get_vhost(wsi), "lws-minimal-server-echo"));
+		if (vhost) {
+			pthread_mutex_lock(&vhost->pool.lock);
+			pending = vhost->pool.pending_count;
+			pthread_mutex_unlock(&vhost->pool.lock);
+			fs_ws_dsp_metrics_printf(&text,
+				"# HELP fs_ws_dsp_tx_queue_bytes Response bytes queued for writing in all sessions.\n"
+				"# TYPE fs_ws_dsp_tx_queue_bytes gauge\n"
+				"fs_ws_dsp_tx_queue_bytes %zu\n"
+				"# HELP fs_ws_dsp_pool_pending Requests waiting for a worker.\n"
+				"# TYPE fs_ws_dsp_pool_pending gauge\n"
+				"fs_ws_dsp_pool_pending %u\n"
+				"# HELP fs_ws_dsp_workers Worker threads.\n"
+				"# TYPE fs_ws_dsp_workers gauge\n"
+				"fs_ws_dsp_workers %d\n",
+				(size_t)vhost->tx_total, pending, *vhost->workers);
+		}
+		if (text.failed) {
+			free(text.data);
+			lws_return_http_status(wsi, HTTP_STATUS_INTERNAL_SERVER_ERROR, NULL);
+			return -1;
+		}
+		data->body = text.data;
+		data->len  = text.len;
+		data->sent = 0;
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "text/plain; version=0.0.4",
+						(lws_filepos_t)data->len, &p, end) ||
+		    lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+		lws_callback_on_writable(wsi);
+		return 0;
+
+	case LWS_CALLBACK_HTTP_WRITEABLE:
+		if (!data->body)
+			break;
+		chunk = data->len - data->sent;
+		if (chunk > 4096)
+			chunk = 4096;
+		if (lws_write(wsi, (unsigned char *)data->body + LWS_PRE + data->sent, chunk,
+			      data->sent + chunk == data->len ? LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP) < (int)chunk)
+			return 1;
+		data->sent += chunk;
+		if (data->sent < data->len) {
+			lws_callback_on_writable(wsi);
+			break;
+		}
+		free(data->body);
+		data->body = NULL;
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+		break;
+
+	case LWS_CALLBACK_CLOSED_HTTP:
+		free(data->body);
+		data->body = NULL;
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+#define LWS_PLUGIN_PROTOCOL_DSP_METRICS \
+	{ \
+		"fs-ws-dsp-metrics", \
+		callback_dsp_metrics, \
+		sizeof(struct metrics_data), \
+		0, \
+		0, NULL, 0 \
+	}